@@ -207,19 +207,10 @@ include_directories(
 
 add_subdirectory(${PROJECT_ROOT}/src ${CMAKE_BINARY_DIR}/src)
 
-# if(BUILD_TESTS)
-        # add_executable(${PROJECT_NAME}_test
-                # "${CMAKE_CURRENT_LIST_DIR}/../test/main_test.cpp"
-                # "${CMAKE_CURRENT_LIST_DIR}/../test/BitcoinKeyGenerator_test.cpp"
-                # "${CMAKE_CURRENT_LIST_DIR}/../test/EthereumKeyGenerator_test.cpp"
-                # "${CMAKE_CURRENT_LIST_DIR}/../test/ElGamalKeyGenerator_test.cpp"
-                # "${CMAKE_CURRENT_LIST_DIR}/../test/ECElGamalKeyGenerator_test.cpp"
-                # "${CMAKE_CURRENT_LIST_DIR}/../test/TransactionVerifierCircuit_test.cpp"
-                # "${CMAKE_CURRENT_LIST_DIR}/../test/MPCVerifierCircuit_test.cpp"
-                # "${CMAKE_CURRENT_LIST_DIR}/../test/Requestor.cpp"
-        # )
-        # target_link_libraries(${PROJECT_NAME}_test PUBLIC ${PROJECT_NAME} SGProofCircuits GTest::gtest Boost::random)
-# endif()
+if(BUILD_TESTS)
+        enable_testing()
+        add_subdirectory(${PROJECT_ROOT}/test ${CMAKE_BINARY_DIR}/test)
+endif()
 
 # Install Headers
 install(DIRECTORY "${CMAKE_SOURCE_DIR}/include/" DESTINATION "${CMAKE_INSTALL_INCLUDEDIR}/SGProcessingManager" FILES_MATCHING PATTERN "*.h*")
@@ -1,10 +1,62 @@
+#ifndef IMAGE_SPLITTER_HPP
+#define IMAGE_SPLITTER_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <openssl/evp.h>
-#include <cstring>
+#include <gsl/span>
 //#include <libp2p/multi/content_identifier_codec.hpp>
 
 namespace sgns::sgprocessing
 {
+    /**
+    * Strided view of image bytes: rows of equal length, a fixed pitch apart. Does not own the bytes.
+    */
+    struct ImagePartView
+    {
+        const uint8_t *data     = nullptr;
+        uint64_t       rowBytes = 0;
+        uint64_t       rowPitch = 0;
+        uint64_t       rows     = 0;
+
+        /** Get number of bytes in the view, excluding the gaps between rows
+        */
+        uint64_t GetSize() const
+        {
+            return rowBytes * rows;
+        }
+
+        /** Check whether the rows follow each other without gaps
+        */
+        bool IsContiguous() const
+        {
+            return rows <= 1 || rowPitch == rowBytes;
+        }
+
+        /** Copy the rows back to back
+        * @param destination - At least GetSize() bytes
+        */
+        void CopyTo( uint8_t *destination ) const
+        {
+            for ( uint64_t row = 0; row < rows; ++row )
+            {
+                std::memcpy( destination + row * rowBytes, data + row * rowPitch, rowBytes );
+            }
+        }
+    };
+
+    /**
+    * Splits an image into blocks without copying it. Parts are strided views into the source,
+    * computed when asked for, and CIDs are only hashed the first time one is requested.
+    *
+    * Only the rvalue vector constructor takes ownership of its bytes. With every other constructor
+    * the caller keeps the bytes alive and unchanged for as long as the splitter, any part view it
+    * returned, or any splitter built from such a view is used. Moving the splitter keeps its views
+    * valid.
+    */
     class ImageSplitter
     {
     public:
@@ -33,7 +85,7 @@ namespace sgns::sgprocessing
                        uint64_t                 blocklen,
                        int                      channels );
 
-        /** Split an image loaded from raw RGBA bytes
+        /** Split an image loaded from raw RGBA bytes. The buffer must outlive the splitter.
         * @param buffer - Raw RGBA
         * @param blockstride - Stride to use for access pattern
         * @param blocklinestride - Line stride in bytes to get to next block start
@@ -45,21 +97,81 @@ namespace sgns::sgprocessing
                        uint64_t                    blocklen,
                        int                         channels );
 
-        ~ImageSplitter()
-        {
-            //free(inputImage);
-        }
+        /** Split raw RGBA bytes the splitter takes ownership of, for buffers that do not outlive it
+        * @param buffer - Raw RGBA
+        * @param blockstride - Stride to use for access pattern
+        * @param blocklinestride - Line stride in bytes to get to next block start
+        * @param blocklen - Block Length in bytes
+        */
+        ImageSplitter( std::vector<uint8_t> &&buffer,
+                       uint64_t               blockstride,
+                       uint64_t               blocklinestride,
+                       uint64_t               blocklen,
+                       int                    channels );
 
-        /** Get data of part
+        /** Split an image from raw RGBA bytes owned elsewhere, e.g. a memory mapped file.
+        * The bytes must outlive the splitter, so never pass a span over a temporary.
+        * @param buffer - Raw RGBA
+        * @param blockstride - Stride to use for access pattern
+        * @param blocklinestride - Line stride in bytes to get to next block start
+        * @param blocklen - Block Length in bytes
+        */
+        ImageSplitter( gsl::span<const uint8_t> buffer,
+                       uint64_t                 blockstride,
+                       uint64_t                 blocklinestride,
+                       uint64_t                 blocklen,
+                       int                      channels );
+
+        /** Split a part of another splitter further, reading the bytes in place where the
+        * geometry allows and copying the part once otherwise. The bytes of the view, and so the
+        * splitter it came from, must outlive this splitter.
+        * @param source - Part view, e.g. from GetPartView of the outer splitter
+        * @param blockstride - Stride to use for access pattern
+        * @param blocklinestride - Line stride in bytes to get to next block start
+        * @param blocklen - Block Length in bytes
+        */
+        ImageSplitter( const ImagePartView &source,
+                       uint64_t             blockstride,
+                       uint64_t             blocklinestride,
+                       uint64_t             blocklen,
+                       int                  channels );
+
+        ImageSplitter( ImageSplitter && )            = default;
+        ImageSplitter &operator=( ImageSplitter && ) = default;
+
+        // Views point into ownedImage_, a copy would point into the original
+        ImageSplitter( const ImageSplitter & )            = delete;
+        ImageSplitter &operator=( const ImageSplitter & ) = delete;
+
+        /** Get a copy of the data of part
+        * @param part - index
+        */
+        std::vector<uint8_t> GetPart( int part ) const;
+
+        /** Get the data of part in place. The view points into the source bytes or into the
+        * splitter's own copy, so it is only valid while both are alive.
+        * @param part - index
+        */
+        ImagePartView GetPartView( int part ) const;
+
+        /** Copy the data of part into a caller provided buffer
         * @param part - index
+        * @param destination - Buffer of at least GetPartSize( part ) bytes
         */
-        std::vector<uint8_t> GetPart( int part );
+        void CopyPart( int part, gsl::span<uint8_t> destination ) const;
 
         /** Get index of a part by CID
         * @param cid - CID of part
+        * @return Index of the first part with this CID, or -1 if there is none
         */
         size_t GetPartByCid( const std::vector<uint8_t> &cid ) const;
 
+        /** Get indices of many parts by CID, e.g. to verify every chunk of a result
+        * @param cids - CIDs of parts
+        * @return One index per CID as returned by GetPartByCid
+        */
+        std::vector<size_t> GetPartsByCid( const std::vector<std::vector<uint8_t>> &cids ) const;
+
         /** Get size of part in bytes
         * @param part - index
         */
@@ -80,6 +192,16 @@ namespace sgns::sgprocessing
         */
         int GetPartHeightActual( int part ) const;
 
+        /** Set how many threads hash CIDs, parts are only split over threads when there are
+        * enough of them. The CIDs do not depend on this value.
+        * @param workerCount - Number of threads, 0 for the hardware thread count
+        */
+        void SetWorkerCount( size_t workerCount );
+
+        /** Get number of threads used to hash CIDs
+        */
+        size_t GetWorkerCount() const;
+
         /** Get total number of parts
         */
         size_t GetPartCount() const;
@@ -91,21 +213,43 @@ namespace sgns::sgprocessing
         std::vector<uint8_t> GetPartCID( int part ) const;
 
     private:
-        /** Function that actually splits image data
+        /** Function that actually splits image data, checks the part geometry against the source
         */
         void SplitImageData();
 
-        std::vector<std::vector<uint8_t>>             splitparts_;
+        /** Offset of the first byte of part, counted in the rows of the source laid end to end
+        */
+        uint64_t GetPartOffset( uint64_t part ) const;
+
+        /** Hash all parts on first use. Safe to call from several threads, all but the first wait
+        * for the hashes instead of computing them again.
+        */
+        void ComputeCids() const;
+
+        /** Hash all parts and build the CID index, run once by ComputeCids
+        */
+        void BuildCids() const;
+
+        /** Find a CID in the index built by ComputeCids
+        */
+        size_t FindCid( const std::vector<uint8_t> &cid ) const;
+
         int                                           partwidth_  = 32;
         int                                           partheight_ = 32;
-        uint64_t                                      blockstride_;
-        uint64_t                                      blocklinestride_;
-        uint64_t                                      blocklen_;
-        int                                           channels_;
-        const unsigned char                          *inputImage;
-        uint64_t                                      imageSize;
-        std::vector<int>                              chunkWidthActual_;
-        std::vector<int>                              chunkHeightActual_;
-        std::vector<std::vector<uint8_t>>             cids_;
+        uint64_t                                      blockstride_ = 0;
+        uint64_t                                      blocklinestride_ = 0;
+        uint64_t                                      blocklen_ = 0;
+        int                                           channels_ = 0;
+        ImagePartView                                 source_;
+        std::vector<uint8_t>                          ownedImage_;
+        uint64_t                                      partCount_ = 0;
+        size_t                                        workerCount_ = 0;
+        /// Heap allocated so the splitter stays movable
+        std::unique_ptr<std::once_flag>               cidsOnce_ = std::make_unique<std::once_flag>();
+        mutable std::vector<std::vector<uint8_t>>     cids_;
+        /// Open addressing table over cids_, part index + 1 per slot and 0 for empty
+        mutable std::vector<uint32_t>                 cidIndex_;
     };
 }
+
+#endif
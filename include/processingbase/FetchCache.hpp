@@ -0,0 +1,119 @@
+/**
+* Header file for the on-disk cache of fetched models and inputs. Files are stored once per content
+* hash, an index maps source URIs to them, and the least recently used entries are evicted once the
+* cache grows past its size cap. A hit is only served if the file still hashes to the content hash
+* it was stored under; a file is hashed on its first hit and again only when its size or
+* modification time changes. The loaders report no ETag or modification time, so a source that changes
+* behind an unchanged URI is not noticed; only cache immutable sources.
+*/
+#ifndef FETCH_CACHE_HPP_
+#define FETCH_CACHE_HPP_
+
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <gsl/span>
+#include <util/MappedFile.hpp>
+#include <util/sgprocmgr-logger.hpp>
+
+namespace sgns::sgprocessing
+{
+    class FetchCache
+    {
+    public:
+        /** Open or create a cache directory
+        * @param directory - Directory holding cached files and the index
+        * @param maxBytes - Upper bound on the total size of cached files
+        */
+        FetchCache( std::filesystem::path directory, uint64_t maxBytes );
+
+        /** Write the index if it changed
+        */
+        ~FetchCache();
+
+        FetchCache( const FetchCache & )            = delete;
+        FetchCache &operator=( const FetchCache & ) = delete;
+
+        /** Look up a previously fetched source and mark it as recently used. The cached file is
+        * hashed if it was not verified yet or changed since, and dropped if it no longer matches its
+        * content hash.
+        * @param uri - Source URI as given in the processing json
+        * @return Read-only mapping of the cached bytes, nullptr on a miss
+        */
+        std::shared_ptr<MappedFile> Find( const std::string &uri );
+
+        /** Add fetched bytes for a source, evicting old entries if needed
+        * @param uri - Source URI as given in the processing json
+        * @param data - Fetched bytes
+        * @return true if the bytes are cached
+        */
+        bool Store( const std::string &uri, gsl::span<const char> data );
+
+        /** Write the index if any entry was added, used or removed since the last write. Called once
+        * per job after its sources are fetched, so lookups and stores do not each rewrite the index.
+        */
+        void Flush();
+
+        /** Get total size of cached files in bytes
+        */
+        uint64_t GetSize() const;
+
+    private:
+        struct Entry
+        {
+            std::string                      hash;
+            uint64_t                         size;
+            uint64_t                         lastUse;
+            std::list<std::string>::iterator recent;
+        };
+
+        /** On-disk size and modification time of a file when it last matched its content hash
+        */
+        struct Stamp
+        {
+            uint64_t                        size;
+            std::filesystem::file_time_type modified;
+
+            bool operator==( const Stamp & ) const = default;
+        };
+
+        /** Size of a stored file, the number of URIs pointing at it and when it was last verified
+        */
+        struct File
+        {
+            uint64_t             size;
+            size_t               references;
+            std::optional<Stamp> verified;
+        };
+
+        void                  LoadIndex();
+        void                  SaveIndex();
+        void                  Add( const std::string &uri, const std::string &hash, uint64_t size, uint64_t lastUse );
+        void                  Touch( Entry &entry );
+        void                  Evict();
+        void                  Remove( const std::string &uri );
+        std::filesystem::path PathFor( const std::string &hash ) const;
+
+        /** Get size and modification time of a stored file, nullopt if it cannot be read
+        */
+        static std::optional<Stamp> StampOf( const std::filesystem::path &path );
+
+        std::filesystem::path                  directory_;
+        uint64_t                               maxBytes_;
+        uint64_t                               useClock_  = 0;
+        uint64_t                               totalSize_ = 0;
+        bool                                   dirty_     = false;
+        std::unordered_map<std::string, Entry> entries_;
+        std::unordered_map<std::string, File>  files_;
+        std::list<std::string>                 recent_; ///< URIs, most recently used first
+        mutable std::mutex                     mutex_;
+        sgns::sgprocmanager::Logger m_logger = sgns::sgprocmanager::createLogger( "FetchCache" );
+    };
+}
+
+#endif
@@ -0,0 +1,127 @@
+/**
+* Header file for saving processing outputs off the processing thread. Saves run on an io_context
+* of their own, driven by one background thread, so a job's outputs are written while the next
+* job is already fetching and processing. FileManager does not document whether it may be used from
+* several threads at once, so every call into it, from the saver thread or a processing thread, is
+* made under GetFileManagerMutex.
+*/
+#ifndef OUTPUT_SAVER_HPP_
+#define OUTPUT_SAVER_HPP_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <util/sgprocmgr-logger.hpp>
+
+namespace sgns::sgprocessing
+{
+    class OutputSaver
+    {
+    public:
+        /** File names and contents of one save, as FileManager takes them
+        */
+        using SaveBuffers = std::shared_ptr<std::pair<std::vector<std::string>, std::vector<std::vector<char>>>>;
+
+        /** Start one save and call done( succeeded ) once it finished, on any thread
+        */
+        using SaveFunction = std::function<void( const std::string                             &url,
+                                                 SaveBuffers                                     buffers,
+                                                 const std::shared_ptr<boost::asio::io_context> &ioc,
+                                                 std::function<void( bool )>                     done )>;
+
+        /** Longest the destructor waits for queued saves by default
+        */
+        static constexpr std::chrono::milliseconds DEFAULT_SHUTDOWN_TIMEOUT{ 60000 };
+
+        /** Start the background io thread
+        * @param shutdownTimeout - Longest the destructor waits for queued saves before cancelling them
+        * @param save - Starts one save, FileManager::SaveASync on the io thread's context if empty
+        */
+        explicit OutputSaver( std::chrono::milliseconds shutdownTimeout = DEFAULT_SHUTDOWN_TIMEOUT,
+                              SaveFunction              save            = nullptr );
+
+        /** Wait up to the shutdown timeout for queued saves, then stop the io thread. Jobs whose saves
+        * did not finish by then report false, saves completing later are ignored.
+        */
+        ~OutputSaver();
+
+        OutputSaver( const OutputSaver & )            = delete;
+        OutputSaver &operator=( const OutputSaver & ) = delete;
+
+        /** Get the mutex every call into FileManager is made under
+        */
+        static std::mutex &GetFileManagerMutex();
+
+        /** Queue the saves of one job and return at once
+        * @param saves - Output URL and buffers of each save
+        * @param succeeded - false if outputs of the job that were saved elsewhere already failed
+        * @return Becomes ready once every save finished, true if all of them and succeeded are true
+        */
+        std::shared_future<bool> SaveAll( std::vector<std::pair<std::string, SaveBuffers>> saves,
+                                          bool                                             succeeded = true );
+
+        /** Block until every save queued so far has finished
+        */
+        void WaitIdle();
+
+        /** Block until every save queued so far has finished or the timeout passes
+        * @return false on timeout
+        */
+        bool WaitIdle( std::chrono::milliseconds timeout );
+
+        /** Get the number of saves queued or still running
+        */
+        size_t GetPendingCount() const;
+
+    private:
+        /** Completion of the saves of one job
+        */
+        struct Job
+        {
+            size_t             remaining;
+            bool               succeeded = true;
+            std::promise<bool> saved;
+        };
+
+        /** Everything save completions touch. Completions hold it by shared_ptr, so one arriving from
+        * another thread while or after the saver is destroyed still finds it alive.
+        */
+        struct State
+        {
+            std::mutex                               mutex;
+            std::condition_variable                  idle;
+            size_t                                   pending = 0;
+            std::unordered_set<std::shared_ptr<Job>> jobs; ///< Jobs still saving
+        };
+
+        static void OnSaved( const std::shared_ptr<State> &state, const std::shared_ptr<Job> &job, bool succeeded );
+
+        /** Default SaveFunction, FileManager::SaveASync under the FileManager mutex
+        */
+        static void SaveWithFileManager( const std::string                              &url,
+                                         SaveBuffers                                     buffers,
+                                         const std::shared_ptr<boost::asio::io_context> &ioc,
+                                         std::function<void( bool )>                     done );
+
+        std::chrono::milliseconds                                                shutdownTimeout_;
+        SaveFunction                                                             save_;
+        std::shared_ptr<State>                                                   state_;
+        std::shared_ptr<boost::asio::io_context>                                 ioc_;
+        boost::asio::executor_work_guard<boost::asio::io_context::executor_type> workGuard_;
+        std::thread                                                              thread_;
+        sgns::sgprocmanager::Logger m_logger = sgns::sgprocmanager::createLogger( "OutputSaver" );
+    };
+}
+
+#endif
@@ -3,6 +3,10 @@
 
 #include <outcome/sgprocmgr-outcome.hpp>
 #include <util/sgprocmgr-logger.hpp>
+#include <util/MappedFile.hpp>
+#include <util/ProgressiveInput.hpp>
+#include <processingbase/FetchCache.hpp>
+#include <processingbase/OutputSaver.hpp>
 #include <SGNSProcMain.hpp>
 #include <processors/processing_processor_mnn_image.hpp>
 #include <processors/processing_processor_mnn_string.hpp>
@@ -21,6 +25,9 @@
 #include <processors/processing_processor_mnn_float.hpp>
 #include <processors/processing_processor_mnn_int.hpp>
 #include <boost/asio/io_context.hpp>
+#include <filesystem>
+#include <functional>
+#include <future>
 #include <iostream>
 
 
@@ -31,6 +38,33 @@ namespace sgns::sgprocessing
     using ProcessingProcessor = sgns::sgprocessing::ProcessingProcessor;
 
 
+    /** Bytes of a loaded model or input. Local files are memory mapped, inputs of a progressive
+    * loader may still be arriving, anything else is downloaded into buffer.
+    */
+    struct SourceBuffer
+    {
+        std::shared_ptr<MappedFile>        mapping;
+        std::shared_ptr<std::vector<char>> buffer;
+        std::shared_ptr<ProgressiveInput>  progressive;
+
+        gsl::span<const char> GetData() const
+        {
+            if ( mapping )
+            {
+                return mapping->GetData();
+            }
+            if ( progressive )
+            {
+                return progressive->GetData();
+            }
+            if ( buffer )
+            {
+                return gsl::span<const char>( buffer->data(), buffer->size() );
+            }
+            return {};
+        }
+    };
+
     class ProcessingManager
     {
     public:
@@ -62,6 +96,64 @@ namespace sgns::sgprocessing
             m_processorFactories[name] = std::move( factoryFunction );
         }
 
+        /** Serve repeat fetches of the same model or input URI from a local cache
+        * @param cache - Cache shared between managers, nullptr to always fetch
+        */
+        void SetFetchCache( std::shared_ptr<FetchCache> cache )
+        {
+            m_fetchCache = std::move( cache );
+        }
+
+        /** Start loading url into input, from a thread of the loader, and return at once. The loader
+        * sets the size, appends the bytes in order and finishes the input.
+        * @return false if the loader cannot load url progressively, FileManager then loads it whole
+        */
+        using ProgressiveLoader = std::function<bool( const std::string &url, std::shared_ptr<ProgressiveInput> input )>;
+
+        /** Let processors that read their input front to back start on the first windows while the rest
+        * of the input is still downloading. FileManager only delivers whole files, so this is off
+        * unless a loader that can deliver partial data is set.
+        * @param loader - Loader tried for every input before FileManager, nullptr to always load inputs whole
+        */
+        void SetProgressiveLoader( ProgressiveLoader loader )
+        {
+            m_progressiveLoader = std::move( loader );
+        }
+
+        /** Save outputs on a background io thread so Process returns without waiting for them
+        * @param saver - Saver shared between managers, nullptr to save on the io_context passed to Process
+        */
+        void SetOutputSaver( std::shared_ptr<OutputSaver> saver )
+        {
+            m_outputSaver = std::move( saver );
+        }
+
+        /** Allow jobs to stream large stitched outputs through spool files in a directory of the node.
+        * Streaming stays off unless this is set, and a job can only turn it on, never pick the path.
+        * Only jobs whose declared outputs are all file:// URLs stream, the spool file is moved into place.
+        * @param directory - Directory for spool files, empty to keep every output in memory
+        */
+        void SetStreamDirectory( std::filesystem::path directory )
+        {
+            m_streamDirectory = std::move( directory );
+        }
+
+        /** Save processor outputs to the declared outputs of the processing json. Process calls this
+        * with the outputs of its processor.
+        * @param ioc - Context the saves run on when no output saver is set
+        * @param resultBuffers - Outputs in the order of the declared outputs, or one output for all of them
+        */
+        void SaveOutputs( std::shared_ptr<boost::asio::io_context> ioc, std::vector<OutputBuffer> &resultBuffers );
+
+        /** Get the completion of the output saves of the last Process call
+        * @return Becomes true once all saves succeeded, false if any failed. Ready at once when
+        * there was nothing to save or no output saver is set.
+        */
+        std::shared_future<bool> GetOutputsSaved() const
+        {
+            return m_outputsSaved;
+        }
+
         /** Get Processing Data item which can be used to access any processing data, inputs, or params.
         */
         sgns::SgnsProcessing GetProcessingData();
@@ -84,11 +176,23 @@ namespace sgns::sgprocessing
     private:
         ProcessingManager() = default;
         outcome::result<void>       Init( const std::string &jsondata ); 
-        outcome::result<std::shared_ptr<std::pair<std::shared_ptr<std::vector<char>>, std::shared_ptr<std::vector<char>>>>>
+        outcome::result<std::shared_ptr<std::pair<SourceBuffer, SourceBuffer>>>
              GetCidForProc( std::shared_ptr<boost::asio::io_context> ioc, sgns::ModelNode &model );
+        bool MapSource( const std::string &url, SourceBuffer &source );
+
+        /** Start loading an input with the progressive loader, if one is set and the processor can
+        * read an input that is still arriving
+        */
+        bool StartProgressiveLoad( const std::string &url, SourceBuffer &source );
+
+        /** Check whether the job may stream its outputs: a stream directory is set and, when the job
+        * asks for streaming, every declared output is a local file
+        */
+        bool CanStreamOutputs( const std::vector<sgns::Parameter> *parameters );
         void GetSubCidForProc( std::shared_ptr<boost::asio::io_context> ioc,
                                                   std::string                              url,
-                                                  std::shared_ptr<std::vector<char>>       results );
+                                                  std::shared_ptr<std::vector<char>>       results,
+                                                  std::function<void()>                    onLoaded = nullptr );
 
         bool SetProcessorByName( const int &name )
         {
@@ -105,6 +209,11 @@ namespace sgns::sgprocessing
         sgns::sgprocmanager::Logger m_logger = sgns::sgprocmanager::createLogger( "SGProcessingManager" );
         sgns::SgnsProcessing        processing_;
         std::unique_ptr<ProcessingProcessor> m_processor;
+        std::shared_ptr<FetchCache>          m_fetchCache;
+        std::shared_ptr<OutputSaver>         m_outputSaver;
+        ProgressiveLoader                    m_progressiveLoader;
+        std::shared_future<bool>             m_outputsSaved;
+        std::filesystem::path                m_streamDirectory;
         std::unordered_map<int, std::function<std::unique_ptr<ProcessingProcessor>()>> m_processorFactories;
         std::unordered_map<std::string, size_t>                                        m_inputMap;
     };
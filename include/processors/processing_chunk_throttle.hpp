@@ -0,0 +1,49 @@
+/**
+* Header file for the opt-in duty cycle applied between processed chunks. Production nodes run at
+* full speed, small devices can cap chunk rate or utilization to limit heat and power draw.
+*/
+#ifndef PROCESSING_CHUNK_THROTTLE_HPP
+#define PROCESSING_CHUNK_THROTTLE_HPP
+
+#include <chrono>
+#include <vector>
+#include <SGNSProcMain.hpp>
+
+namespace sgns::sgprocessing
+{
+    class ChunkThrottle
+    {
+    public:
+        /** Create a throttle
+        * @param maxChunksPerSecond - Upper bound on started chunks per second, 0 for no limit
+        * @param targetUtilization - Fraction of wall time spent processing in (0, 1], 1 for no limit
+        */
+        ChunkThrottle( float maxChunksPerSecond, float targetUtilization );
+
+        /** Read "maxChunksPerSecond" and "targetUtilization" from the processing parameters.
+        * Missing parameters leave the throttle disabled.
+        */
+        static ChunkThrottle FromParameters( const std::vector<sgns::Parameter> *parameters );
+
+        /** Check whether any limit is configured
+        */
+        bool IsEnabled() const;
+
+        /** Mark the start of a chunk
+        */
+        void BeginChunk();
+
+        /** Mark the end of a chunk and sleep as long as the configured limits require
+        */
+        void EndChunk();
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        float             maxChunksPerSecond_;
+        float             targetUtilization_;
+        Clock::time_point chunkStart_;
+    };
+}
+
+#endif
@@ -0,0 +1,133 @@
+/**
+* Header file for the process wide MNN interpreter cache. Processors share one parsed model
+* per (model bytes, backend config) instead of parsing the model for every patch.
+*/
+#ifndef PROCESSING_INTERPRETER_CACHE_HPP
+#define PROCESSING_INTERPRETER_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <MNN/Interpreter.hpp>
+#include <util/sgprocmgr-logger.hpp>
+#include "processing_session_pool.hpp"
+
+namespace sgns::sgprocessing
+{
+    /** Interpreter owned by the cache together with the schedule config it was created for
+    */
+    class CachedInterpreter
+    {
+    public:
+        /** Wrap a parsed interpreter
+        * @param key - Cache key (model hash and backend)
+        * @param interpreter - Interpreter created from the model bytes
+        * @param config - Schedule config used for every session of this interpreter
+        */
+        CachedInterpreter( std::string key, std::unique_ptr<MNN::Interpreter> interpreter, const MNN::ScheduleConfig &config );
+
+        CachedInterpreter( const CachedInterpreter & )            = delete;
+        CachedInterpreter &operator=( const CachedInterpreter & ) = delete;
+
+        /** Get the MNN interpreter
+        */
+        MNN::Interpreter *Get() const;
+
+        /** Get the cache key of this interpreter
+        */
+        const std::string &GetKey() const;
+
+        /** Lease a session from the pool of this interpreter, see SessionPool::Acquire
+        * @param shape - Key identifying the prepared input shape(s) of the session
+        * @param prepare - Resize callback applied only to newly created sessions
+        */
+        SessionLease AcquireSession( const std::vector<int>              &shape,
+                                     const SessionPool::PrepareFunction &prepare = nullptr );
+
+        /** MNN only allows runSession on distinct sessions concurrently. createSession, resizeTensor,
+        * resizeSession and releaseSession on a shared interpreter must hold this mutex.
+        */
+        std::mutex &GetMutex();
+
+    private:
+        std::string                       key_;
+        std::unique_ptr<MNN::Interpreter> interpreter_;
+        MNN::ScheduleConfig               config_;
+        MNN::BackendConfig                backendConfig_;
+        std::mutex                        mutex_;
+        SessionPool                       sessionPool_;
+    };
+
+    class InterpreterCache
+    {
+    public:
+        /** Number of interpreters kept when no capacity is set
+        */
+        static constexpr size_t DEFAULT_CAPACITY = 8;
+
+        static InterpreterCache &GetInstance();
+
+        /** Get the interpreter for a model, parsing it only if no processor has used it with this backend before.
+        * The model is parsed outside the cache lock; concurrent callers for the same model wait for that one parse.
+        * @param modelData - Model file bytes
+        * @param modelSize - Size of model in bytes
+        * @param config - Schedule config sessions will be created with
+        * @param modelDigest - SHA-256 of the model bytes if the caller already has it, empty to hash here
+        * @return Shared interpreter or nullptr if the model could not be parsed
+        */
+        std::shared_ptr<CachedInterpreter> GetInterpreter( const void                 *modelData,
+                                                           size_t                      modelSize,
+                                                           const MNN::ScheduleConfig  &config,
+                                                           const std::vector<uint8_t> &modelDigest = {} );
+
+        /** Set how many interpreters are kept, the least recently used ones are dropped beyond it
+        * @param capacity - Maximum number of cached interpreters, values below 1 mean 1
+        */
+        void SetCapacity( size_t capacity );
+
+        /** Drop all cached interpreters. Interpreters still in use stay alive until released.
+        */
+        void Clear();
+
+        /** Get number of cached interpreters
+        */
+        size_t GetSize() const;
+
+    private:
+        using InterpreterFuture = std::shared_future<std::shared_ptr<CachedInterpreter>>;
+
+        /** Interpreter of one key, possibly still being parsed, and its place in the LRU order
+        */
+        struct Entry
+        {
+            InterpreterFuture                interpreter;
+            std::list<std::string>::iterator recent;
+        };
+
+        InterpreterCache() = default;
+
+        /** Key covering every ScheduleConfig field that changes how sessions run: forward types, thread
+        * count / GPU mode, tensor path and saved tensors, and all BackendConfig fields
+        */
+        static std::string BackendKey( const MNN::ScheduleConfig &config );
+
+        /** Drop least recently used entries until the capacity is met, m_mutex must be held
+        */
+        void EvictLocked();
+
+        mutable std::mutex                     m_mutex;
+        std::unordered_map<std::string, Entry> m_interpreters;
+        std::list<std::string>                 m_recent; ///< Keys, most recently used first
+        size_t                                 m_capacity = DEFAULT_CAPACITY;
+        sgns::sgprocmanager::Logger m_logger = sgns::sgprocmanager::createLogger( "InterpreterCache" );
+    };
+}
+
+#endif
@@ -0,0 +1,135 @@
+/**
+* Header file for typed processor output. A buffer owns its bytes and can only be moved, so the
+* stitched result a processor writes into is the same allocation that is handed to the output
+* saving, without any copy in between. A streamed output is instead backed by the file it was
+* written to, which the output saving moves or reads back.
+*/
+#ifndef PROCESSING_OUTPUT_BUFFER_HPP
+#define PROCESSING_OUTPUT_BUFFER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
+#include <gsl/span>
+
+namespace sgns::sgprocessing
+{
+    class OutputBuffer
+    {
+    public:
+        /** Type of every element of the buffer
+        */
+        enum class ElementType
+        {
+            Float32,
+            UInt8,
+        };
+
+        /** Create an empty buffer
+        */
+        OutputBuffer() = default;
+
+        /** Allocate a zero filled buffer
+        * @param type - Element type
+        * @param shape - Extent of each dimension, slowest first
+        */
+        OutputBuffer( ElementType type, std::vector<size_t> shape );
+
+        /** Take over bytes that were already produced
+        * @param type - Element type
+        * @param shape - Extent of each dimension, slowest first
+        * @param data - Bytes of the elements, resized to match the shape if they do not
+        */
+        OutputBuffer( ElementType type, std::vector<size_t> shape, std::vector<char> data );
+
+        /** Refer to elements that were written to a local file instead of memory
+        * @param type - Element type
+        * @param shape - Extent of each dimension, slowest first
+        * @param file - File holding the bytes of the elements, owned by the buffer from now on
+        */
+        static OutputBuffer FromFile( ElementType type, std::vector<size_t> shape, std::filesystem::path file );
+
+        /** Remove the backing file of a streamed output that was not saved
+        */
+        ~OutputBuffer();
+
+        OutputBuffer( const OutputBuffer & )            = delete;
+        OutputBuffer &operator=( const OutputBuffer & ) = delete;
+        OutputBuffer( OutputBuffer &&other ) noexcept;
+        OutputBuffer &operator=( OutputBuffer &&other ) noexcept;
+
+        /** Get the size in bytes of one element of a type
+        */
+        static size_t GetElementSize( ElementType type );
+
+        ElementType GetElementType() const
+        {
+            return type_;
+        }
+
+        const std::vector<size_t> &GetShape() const
+        {
+            return shape_;
+        }
+
+        /** Get the number of elements, the product of the shape
+        */
+        size_t GetElementCount() const;
+
+        bool Empty() const
+        {
+            return data_.empty() && file_.empty();
+        }
+
+        /** Get the file backing a streamed output, empty when the bytes are in memory
+        */
+        const std::filesystem::path &GetFile() const
+        {
+            return file_;
+        }
+
+        /** Get the file name the output should be saved under, empty to derive it from the output
+        */
+        const std::string &GetName() const
+        {
+            return name_;
+        }
+
+        void SetName( std::string name )
+        {
+            name_ = std::move( name );
+        }
+
+        /** View the elements of a Float32 buffer
+        */
+        gsl::span<float>       AsFloats();
+        gsl::span<const float> AsFloats() const;
+
+        /** View the elements of a UInt8 buffer
+        */
+        gsl::span<uint8_t> AsUInt8();
+
+        /** View the raw bytes
+        */
+        gsl::span<const char> GetBytes() const
+        {
+            return gsl::span<const char>( data_.data(), data_.size() );
+        }
+
+        /** Hand the bytes out, leaving the buffer empty
+        */
+        std::vector<char> ReleaseBytes();
+
+    private:
+        ElementType           type_ = ElementType::Float32;
+        std::vector<size_t>   shape_;
+        std::vector<char>     data_;
+        std::filesystem::path file_;
+        std::string           name_;
+    };
+}
+
+#endif
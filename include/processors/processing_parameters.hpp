@@ -0,0 +1,44 @@
+/**
+* Header file for reading processor tuning values from the parameters of a processing json.
+*/
+#ifndef PROCESSING_PARAMETERS_HPP
+#define PROCESSING_PARAMETERS_HPP
+
+#include <string>
+#include <vector>
+#include <SGNSProcMain.hpp>
+
+namespace sgns::sgprocessing
+{
+    class ProcessingParameters
+    {
+    public:
+        /** Find a parameter by name
+        * @param parameters - Parameters of the processing json, may be null
+        * @param name - Parameter name
+        * @return Parameter or nullptr if not present
+        */
+        static const sgns::Parameter *Find( const std::vector<sgns::Parameter> *parameters, const std::string &name );
+
+        /** Get the default value of an integer parameter
+        * @return Value, or defaultValue if missing or not a number
+        */
+        static int GetInt( const std::vector<sgns::Parameter> *parameters, const std::string &name, int defaultValue );
+
+        /** Get the default value of a float parameter
+        * @return Value, or defaultValue if missing or not a number
+        */
+        static float GetFloat( const std::vector<sgns::Parameter> *parameters,
+                               const std::string                  &name,
+                               float                               defaultValue );
+
+        /** Get the default value of a string parameter
+        * @return Value, or defaultValue if missing or not a string
+        */
+        static std::string GetString( const std::vector<sgns::Parameter> *parameters,
+                                      const std::string                  &name,
+                                      const std::string                  &defaultValue );
+    };
+}
+
+#endif
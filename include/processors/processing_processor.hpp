@@ -6,20 +6,26 @@
 #ifndef PROCESSING_PROCESSOR_HPP
 #define PROCESSING_PROCESSOR_HPP
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <filesystem>
 #include <memory>
 #include <string>
 #include <utility>
 #include <vector>
+#include <gsl/span>
 #include <SGNSProcMain.hpp>
+#include <util/ProgressiveInput.hpp>
 #include <util/sgprocmgr-logger.hpp>
+#include "processing_output_buffer.hpp"
 
 namespace sgns::sgprocessing
 {
     struct ProcessingResult
     {
-        std::vector<uint8_t> hash;
-        std::shared_ptr<std::pair<std::vector<std::string>, std::vector<std::vector<char>>>> output_buffers;
+        std::vector<uint8_t>      hash;
+        std::vector<OutputBuffer> outputs; ///< Moved through to the output saving, never copied
     };
 
     class ProcessingProcessor
@@ -34,10 +40,21 @@ namespace sgns::sgprocessing
         */
         virtual ProcessingResult StartProcessing( std::vector<std::vector<uint8_t>> &chunkhashes,
                                const sgns::IoDeclaration         &proc,
-                               std::vector<char>                 &imageData,
-                               std::vector<char>                 &modelFile,
+                               gsl::span<const char>             imageData,
+                               gsl::span<const char>             modelFile,
                                const std::vector<sgns::Parameter> *parameters ) = 0;
 
+        /** Called as soon as the model is available, possibly while the input is still
+        * downloading. Processors can parse the model here so StartProcessing finds it ready.
+        * @param modelFile - Model file data, only valid for the duration of the call
+        */
+        virtual void PrepareModel( gsl::span<const char> modelFile ) {}
+
+        /** Whether StartProcessing reads its input front to back as it needs it, so it can be given
+        * an input that is still arriving
+        */
+        virtual bool ReadsInputProgressively() const { return false; }
+
         /** Set data for processor
         * @param buffers - Data containing file name and data pair lists.
         */
@@ -48,8 +65,36 @@ namespace sgns::sgprocessing
         */
         virtual float GetProgress() const { return m_progress; }
 
+        /** Set number of windows to run per inference, from the model's batch_size
+        * @param batchSize - Windows packed into one [N, ...] input, values below 1 mean 1
+        */
+        void SetBatchSize( int batchSize ) { m_batchSize = std::max( 1, batchSize ); }
+
+        /** Get number of windows to run per inference
+        */
+        size_t GetBatchSize() const { return static_cast<size_t>( m_batchSize ); }
+
+        /** Set the SHA-256 of the model of the current job, so the interpreter cache does not hash it again
+        * @param modelDigest - Digest of the model bytes, empty when not known
+        */
+        void SetModelDigest( std::vector<uint8_t> modelDigest ) { m_modelDigest = std::move( modelDigest ); }
+
+        /** Set the node's directory for streamed outputs
+        * @param directory - Where spool files of streamed outputs are created, empty to never stream
+        */
+        void SetStreamDirectory( std::filesystem::path directory ) { m_streamDirectory = std::move( directory ); }
+
+        /** Set the arrival of the input of the next StartProcessing while it is still loading
+        * @param input - Arrival of the input data, null when the input is complete
+        */
+        void SetProgressiveInput( std::shared_ptr<const ProgressiveInput> input ) { m_progressiveInput = std::move( input ); }
+
     protected:
-        std::atomic<float> m_progress{0.0f}; // Progress percentage
+        std::atomic<float>   m_progress{0.0f}; // Progress percentage
+        int                  m_batchSize = 1;
+        std::vector<uint8_t> m_modelDigest;
+        std::filesystem::path m_streamDirectory;
+        std::shared_ptr<const ProgressiveInput> m_progressiveInput;
         sgns::sgprocmanager::Logger m_logger = sgns::sgprocmanager::createLogger( "SGProcessor" );
     };
 }
@@ -38,8 +38,8 @@ namespace sgns::sgprocessing
         */
         ProcessingResult StartProcessing( std::vector<std::vector<uint8_t>> &chunkhashes,
                            const sgns::IoDeclaration         &proc,
-                           std::vector<char>                 &imageData,
-                           std::vector<char>                 &modelFile,
+                           gsl::span<const char>             imageData,
+                           gsl::span<const char>             modelFile,
                            const std::vector<sgns::Parameter> *parameters ) override;
 
         /** Set data for processor
@@ -7,6 +7,7 @@
 #include <vector>
 
 #include <MNN/Interpreter.hpp>
+#include "processing_interpreter_cache.hpp"
 #include "processing_processor.hpp"
 
 namespace sgns::sgprocessing
@@ -19,13 +20,26 @@ namespace sgns::sgprocessing
 
         ProcessingResult StartProcessing( std::vector<std::vector<uint8_t>> &chunkhashes,
                                            const sgns::IoDeclaration         &proc,
-                                           std::vector<char>                 &boolData,
-                                           std::vector<char>                 &modelFile,
+                                           gsl::span<const char>             boolData,
+                                           gsl::span<const char>             modelFile,
                                            const std::vector<sgns::Parameter> *parameters ) override;
 
+        /** Parse the model into the interpreter cache ahead of StartProcessing
+        * @param modelFile - MNN model file data
+        */
+        void PrepareModel( gsl::span<const char> modelFile ) override;
+
+        /** Windows read the input through a SignalSource, so processing can start while it arrives
+        */
+        bool ReadsInputProgressively() const override
+        {
+            return true;
+        }
+
     private:
-        std::unique_ptr<MNN::Tensor> Process( const std::vector<float> &signalData,
-                                               std::vector<uint8_t>    &modelFile,
-                                               int                      length );
+        std::vector<std::unique_ptr<MNN::Tensor>> Process( const std::vector<float> &signalData,
+                                                           CachedInterpreter       &cachedInterpreter,
+                                                           int                      length,
+                                                           int                      batch );
     };
 }
@@ -9,6 +9,8 @@
 
 #include <MNN/ImageProcess.hpp>
 #include <MNN/Interpreter.hpp>
+#include "datasplitter/ImageSplitter.hpp"
+#include "processing_interpreter_cache.hpp"
 #include "processing_processor.hpp"
 #define MNN_OPEN_TIME_TRACE
 #include <MNN/AutoTime.hpp>
@@ -56,10 +58,15 @@ namespace sgns::sgprocessing
         */
         ProcessingResult StartProcessing( std::vector<std::vector<uint8_t>> &chunkhashes,
                            const sgns::IoDeclaration         &proc,
-                           std::vector<char>                 &imageData,
-                           std::vector<char>                 &modelFile,
+                           gsl::span<const char>             imageData,
+                           gsl::span<const char>             modelFile,
                            const std::vector<sgns::Parameter> *parameters ) override;
 
+        /** Parse the model into the interpreter cache ahead of StartProcessing
+        * @param modelFile - MNN model file data
+        */
+        void PrepareModel( gsl::span<const char> modelFile ) override;
+
         /** Set data for processor
         * @param buffers - Data containing file name and data pair lists.
         */
@@ -67,17 +74,21 @@ namespace sgns::sgprocessing
         //    std::shared_ptr<std::pair<std::vector<std::string>, std::vector<std::vector<char>>>> buffers ) override;
 
     private:
-        /** Run MNN processing on image
-        * @param imgdata - RGBA image bytes
-        * @param origwidth - Width of image
-        * @param origheight - Height of image
+        /** Run MNN processing on a batch of equally sized images
+        * @param images - RGBA image parts read in place, at most batch images
+        * @param cachedInterpreter - Shared interpreter for the model
+        * @param origwidth - Width of each image
+        * @param origheight - Height of each image
+        * @param batch - Batch dimension of the session, missing images are zero filled
+        * @return One output tensor per batch entry, empty on failure
         */
-        std::unique_ptr<MNN::Tensor> Process( const std::vector<uint8_t> &imgdata, 
-                                                std::vector<uint8_t> &modelFile, 
-                                                const int channels, 
-                                                const int origwidth, 
-                                                const int origheight,
-                                                const std::string filename = "" );
+        std::vector<std::unique_ptr<MNN::Tensor>> Process( const std::vector<ImagePartView> &images, 
+                                                             CachedInterpreter &cachedInterpreter, 
+                                                             const int channels, 
+                                                             const int origwidth, 
+                                                             const int origheight,
+                                                             const int batch,
+                                                             const std::string filename = "" );
 
         //std::unique_ptr<std::vector<std::vector<char>>> imageData_;
         //std::unique_ptr<std::vector<uint8_t>>           modelFile_;
@@ -9,6 +9,7 @@
 #include <string>
 
 #include <MNN/Interpreter.hpp>
+#include "processing_interpreter_cache.hpp"
 #include "processing_processor.hpp"
 #define MNN_OPEN_TIME_TRACE
 #include <MNN/AutoTime.hpp>
@@ -38,18 +39,23 @@ namespace sgns::sgprocessing
         */
         ProcessingResult StartProcessing( std::vector<std::vector<uint8_t>> &chunkhashes,
                            const sgns::IoDeclaration         &proc,
-                           std::vector<char>                 &textData,
-                           std::vector<char>                 &modelFile,
+                           gsl::span<const char>             textData,
+                           gsl::span<const char>             modelFile,
                            const std::vector<sgns::Parameter> *parameters ) override;
 
+        /** Parse the model into the interpreter cache ahead of StartProcessing
+        * @param modelFile - MNN model file data
+        */
+        void PrepareModel( gsl::span<const char> modelFile ) override;
+
     private:
         /** Run MNN processing on text/string
         * @param tokenIds - Input token ids
-        * @param modelFile - MNN model file bytes
+        * @param cachedInterpreter - Shared interpreter for the model
         * @param maxLength - Maximum sequence length
         */
         std::unique_ptr<MNN::Tensor> Process( const std::vector<int32_t> &tokenIds, 
-                               std::vector<uint8_t> &modelFile,
+                               CachedInterpreter &cachedInterpreter,
                                const int maxLength );
     };
 
@@ -7,6 +7,7 @@
 #include <vector>
 
 #include <MNN/Interpreter.hpp>
+#include "processing_interpreter_cache.hpp"
 #include "processing_processor.hpp"
 
 namespace sgns::sgprocessing
@@ -19,13 +20,18 @@ namespace sgns::sgprocessing
 
         ProcessingResult StartProcessing( std::vector<std::vector<uint8_t>> &chunkhashes,
                                            const sgns::IoDeclaration         &proc,
-                                           std::vector<char>                 &cubeData,
-                                           std::vector<char>                 &modelFile,
+                                           gsl::span<const char>             cubeData,
+                                           gsl::span<const char>             modelFile,
                                            const std::vector<sgns::Parameter> *parameters ) override;
 
+        /** Parse the model into the interpreter cache ahead of StartProcessing
+        * @param modelFile - MNN model file data
+        */
+        void PrepareModel( gsl::span<const char> modelFile ) override;
+
     private:
         std::unique_ptr<MNN::Tensor> Process( const std::vector<float> &inputData,
-                               std::vector<uint8_t>    &modelFile,
+                               CachedInterpreter       &cachedInterpreter,
                                int                      width,
                                int                      height,
                                int                      channels,
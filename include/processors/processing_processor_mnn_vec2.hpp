@@ -4,6 +4,7 @@
 #include <MNN/Interpreter.hpp>
 #include <memory>
 #include <vector>
+#include "processing_interpreter_cache.hpp"
 #include "processing_processor.hpp"
 
 namespace sgns::sgprocessing
@@ -15,15 +16,28 @@ namespace sgns::sgprocessing
 
         ProcessingResult StartProcessing( std::vector<std::vector<uint8_t>>     &chunkhashes,
                                           const sgns::IoDeclaration              &proc,
-                                          std::vector<char>                      &vec2Data,
-                                          std::vector<char>                      &modelFile,
+                                          gsl::span<const char>                  vec2Data,
+                                          gsl::span<const char>                  modelFile,
                                           const std::vector<sgns::Parameter>     *parameters )
             override;
 
+        /** Parse the model into the interpreter cache ahead of StartProcessing
+        * @param modelFile - MNN model file data
+        */
+        void PrepareModel( gsl::span<const char> modelFile ) override;
+
+        /** Windows read the input through a SignalSource, so processing can start while it arrives
+        */
+        bool ReadsInputProgressively() const override
+        {
+            return true;
+        }
+
     private:
-        std::unique_ptr<MNN::Tensor> Process( const std::vector<float> &input, 
-                                              std::vector<uint8_t> &model,
-                                              int length );
+        std::vector<std::unique_ptr<MNN::Tensor>> Process( const std::vector<float> &input,
+                                                           CachedInterpreter    &cachedInterpreter,
+                                                           int length,
+                                                           int batch );
     };
 }
 
@@ -9,6 +9,7 @@
 #include <string>
 
 #include <MNN/Interpreter.hpp>
+#include "processing_interpreter_cache.hpp"
 #include "processing_processor.hpp"
 #define MNN_OPEN_TIME_TRACE
 #include <MNN/AutoTime.hpp>
@@ -38,23 +39,31 @@ namespace sgns::sgprocessing
         */
         ProcessingResult StartProcessing( std::vector<std::vector<uint8_t>> &chunkhashes,
                            const sgns::IoDeclaration         &proc,
-                           std::vector<char>                 &volumeData,
-                           std::vector<char>                 &modelFile,
+                           gsl::span<const char>             volumeData,
+                           gsl::span<const char>             modelFile,
                            const std::vector<sgns::Parameter> *parameters ) override;
 
+        /** Parse the model into the interpreter cache ahead of StartProcessing
+        * @param modelFile - MNN model file data
+        */
+        void PrepareModel( gsl::span<const char> modelFile ) override;
+
     private:
         /** Run MNN processing on volume data
         * @param volumeData - Input volume data as float32 array
-        * @param modelFile - MNN model file bytes
+        * @param cachedInterpreter - Shared interpreter for the model
         * @param width - Volume width
         * @param height - Volume height
         * @param depth - Volume depth
+        * @param batch - Number of patches packed back to back in volumeData
+        * @return One output tensor per patch, empty on failure
         */
-        std::unique_ptr<MNN::Tensor> Process( const std::vector<float> &volumeData,
-                                               std::vector<uint8_t> &modelFile,
-                                               const int width,
-                                               const int height,
-                                               const int depth );
+        std::vector<std::unique_ptr<MNN::Tensor>> Process( const std::vector<float> &volumeData,
+                                                            CachedInterpreter &cachedInterpreter,
+                                                            const int width,
+                                                            const int height,
+                                                            const int depth,
+                                                            const int batch );
     };
 
 }
@@ -0,0 +1,62 @@
+/**
+* Header file for the subtask result hash. The legacy chain folds chunk hashes in order, the
+* opt-in Merkle mode puts them under a tree so the root does not depend on a sequential fold.
+*/
+#ifndef PROCESSING_RESULT_HASH_HPP
+#define PROCESSING_RESULT_HASH_HPP
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+#include <SGNSProcMain.hpp>
+#include "util/sha256.hpp"
+
+namespace sgns::sgprocessing
+{
+    class ResultHash
+    {
+    public:
+        enum class Mode
+        {
+            Chain,    ///< sha256( previous || chunk hash ), starting from all zeros
+            MerkleV1, ///< RFC 6962 shaped tree over the chunk hashes
+        };
+
+        explicit ResultHash( Mode mode );
+
+        /** Read "resultHash" from the processing parameters, "chain" (default) or "merkle-v1".
+        * @return Mode, or std::nullopt for any other value, since guessing would make the result
+        *         hash differ from nodes using the intended mode
+        */
+        static std::optional<Mode> ModeFromParameters( const std::vector<sgns::Parameter> *parameters );
+
+        /** Get the hashing mode
+        */
+        Mode GetMode() const;
+
+        /** Hash a chunk output and add it to the result hash
+        * @param data - Chunk output bytes
+        * @param dataSize - Number of bytes
+        * @return Hash of the chunk alone, as pushed into chunkhashes
+        */
+        sgprocmanagersha::Sha256Digest Append( const void *data, size_t dataSize );
+
+        /** Add an already computed chunk hash to the result hash
+        * @param chunkHash - Hash of the chunk output
+        */
+        void AppendDigest( const sgprocmanagersha::Sha256Digest &chunkHash );
+
+        /** Get the result hash over all chunks appended so far
+        */
+        std::vector<uint8_t> GetHashBytes() const;
+
+    private:
+        Mode                               mode_;
+        sgprocmanagersha::Sha256Hasher     hasher_;
+        sgprocmanagersha::Sha256Chain      chain_;
+        sgprocmanagersha::Sha256MerkleTree tree_;
+    };
+}
+
+#endif
@@ -0,0 +1,123 @@
+/**
+* Header file for the pool of pre-resized MNN sessions of a cached interpreter. Patch shapes are
+* constant for a whole job, so sessions are resized once and then reused for every window.
+*/
+#ifndef PROCESSING_SESSION_POOL_HPP
+#define PROCESSING_SESSION_POOL_HPP
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <MNN/Interpreter.hpp>
+
+namespace sgns::sgprocessing
+{
+    class SessionPool;
+
+    /** Session leased from a SessionPool, handed back to the pool when going out of scope.
+    * The holder may run the session without holding the interpreter mutex.
+    */
+    class SessionLease
+    {
+    public:
+        SessionLease() = default;
+        SessionLease( SessionPool &pool, std::vector<int> shape, MNN::Session *session );
+        ~SessionLease();
+
+        SessionLease( SessionLease &&other ) noexcept;
+        SessionLease &operator=( SessionLease &&other ) noexcept;
+
+        SessionLease( const SessionLease & )            = delete;
+        SessionLease &operator=( const SessionLease & ) = delete;
+
+        MNN::Session *Get() const
+        {
+            return session_;
+        }
+
+        explicit operator bool() const
+        {
+            return session_ != nullptr;
+        }
+
+    private:
+        void Reset();
+
+        SessionPool     *pool_ = nullptr;
+        std::vector<int> shape_;
+        MNN::Session    *session_ = nullptr;
+    };
+
+    class SessionPool
+    {
+    public:
+        /** Number of idle sessions kept when no limit is set
+        */
+        static constexpr size_t DEFAULT_MAX_IDLE = 16;
+
+        /** Called once on every newly created session, usually to resizeTensor/resizeSession.
+        * Runs with the interpreter mutex held. Returning false discards the session.
+        */
+        using PrepareFunction = std::function<bool( MNN::Interpreter *, MNN::Session * )>;
+
+        /** Create an empty pool
+        * @param interpreter - Interpreter sessions are created on
+        * @param config - Schedule config for new sessions, must outlive the pool
+        * @param mutex - Mutex serializing create/resize/release on the interpreter
+        */
+        SessionPool( MNN::Interpreter *interpreter, const MNN::ScheduleConfig &config, std::mutex &mutex );
+        ~SessionPool();
+
+        SessionPool( const SessionPool & )            = delete;
+        SessionPool &operator=( const SessionPool & ) = delete;
+
+        /** Lease a session prepared for the given input shape. Sessions for a shape are only
+        * created and prepared when no idle one is left.
+        * @param shape - Key identifying the prepared input shape(s) of the session
+        * @param prepare - Resize callback applied to new sessions
+        * @return Lease, empty if the session could not be created
+        */
+        SessionLease Acquire( const std::vector<int> &shape, const PrepareFunction &prepare = nullptr );
+
+        /** Get number of sessions waiting in the pool
+        */
+        size_t GetIdleCount() const;
+
+        /** Set how many idle sessions are kept. Beyond it the sessions of the least recently
+        * used shapes are released first.
+        * @param maxIdle - Maximum number of idle sessions, 0 releases every session on return
+        */
+        void SetMaxIdle( size_t maxIdle );
+
+    private:
+        friend class SessionLease;
+
+        /** Idle sessions of one shape and the shape's place in the LRU order
+        */
+        struct IdleSessions
+        {
+            std::vector<MNN::Session *>           sessions;
+            std::list<std::vector<int>>::iterator recent;
+        };
+
+        void Release( const std::vector<int> &shape, MNN::Session *session );
+
+        /** Release idle sessions of the least recently used shapes until the limit is met, mutex_ must be held
+        */
+        void EvictLocked();
+
+        MNN::Interpreter                        *interpreter_;
+        const MNN::ScheduleConfig               &config_;
+        std::mutex                              &mutex_;
+        std::map<std::vector<int>, IdleSessions> idle_;
+        std::list<std::vector<int>>              recent_; ///< Shapes with idle sessions, most recently used first
+        size_t                                   idleCount_ = 0;
+        size_t                                   maxIdle_   = DEFAULT_MAX_IDLE;
+    };
+}
+
+#endif
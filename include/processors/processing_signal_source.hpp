@@ -0,0 +1,91 @@
+/**
+* Header file for reading the input of the sliding-window processors as floats. Windows convert
+* only their own range straight from the input bytes, so a streamed run never holds the whole
+* signal as floats; otherwise the signal can be converted once up front and shared by overlapping
+* windows. An input that is still arriving is waited for one window range at a time.
+*/
+#ifndef PROCESSING_SIGNAL_SOURCE_HPP
+#define PROCESSING_SIGNAL_SOURCE_HPP
+
+#include <cstddef>
+#include <vector>
+#include <gsl/span>
+#include <SGNSProcMain.hpp>
+#include "util/ProgressiveInput.hpp"
+
+namespace sgns::sgprocessing
+{
+    class SignalSource
+    {
+    public:
+        /** How integer elements turn into floats
+        */
+        enum class IntegerValues
+        {
+            Dequantized, ///< ( value - zeroPoint ) * scale
+            Boolean,     ///< 1 for any non zero INT8 value, 0 otherwise
+        };
+
+        /** Wrap an input without copying it, the data must outlive the source
+        * @param data - Raw input bytes, at least elements values of the format
+        * @param format - FLOAT32, FLOAT16, INT32, INT16 or INT8
+        * @param elements - Number of values in the signal
+        * @param scale - Dequantization scale of integer formats
+        * @param zeroPoint - Dequantization zero point of integer formats
+        * @param integerValues - How integer elements turn into floats
+        */
+        SignalSource( gsl::span<const char> data,
+                      sgns::InputFormat     format,
+                      size_t                elements,
+                      float                 scale         = 1.0f,
+                      float                 zeroPoint     = 0.0f,
+                      IntegerValues         integerValues = IntegerValues::Dequantized );
+
+        /** Read the input only as it arrives
+        * @param input - Arrival of the wrapped data, null once it is complete. Must outlive the source.
+        */
+        void SetProgressiveInput( const ProgressiveInput *input )
+        {
+            input_ = input;
+        }
+
+        /** Convert the whole signal once, so overlapping windows do not convert shared values again.
+        * Costs one float per value, FLOAT32 inputs are always read in place and stay unconverted.
+        * Waits for the whole of an arriving input, which stays unconverted if the load fails.
+        */
+        void Materialize();
+
+        /** Convert a range of the signal
+        * @param first - Index of the first value
+        * @param destination - Receives up to destination.size() values, floats past the signal end are left untouched
+        * @return Number of values written, 0 if an arriving input failed before the range arrived
+        */
+        size_t Read( size_t first, gsl::span<float> destination ) const;
+
+        /** Get the number of values in the signal
+        */
+        size_t GetSize() const
+        {
+            return elements_;
+        }
+
+    private:
+        void Convert( size_t first, gsl::span<float> destination ) const;
+
+        /** Wait until the bytes of a range of values have arrived
+        * @return false if the input failed first
+        */
+        bool WaitForValues( size_t first, size_t count ) const;
+
+        gsl::span<const char>   data_;
+        sgns::InputFormat       format_;
+        size_t                  elements_;
+        float                   scale_;
+        float                   zeroPoint_;
+        IntegerValues           integerValues_;
+        std::vector<float>      converted_;       ///< Whole signal after Materialize, empty otherwise
+        const ProgressiveInput *input_ = nullptr; ///< Arrival of data_ while it is still loading
+    };
+}
+
+#endif
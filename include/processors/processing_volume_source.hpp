@@ -0,0 +1,120 @@
+/**
+* Header file for reading texture3D inputs in any of their declared layouts and formats. The
+* copy kernels are instantiated once per layout, so no per voxel index switch is left, and walk
+* the volume in small cubic tiles so strided source reads stay in cache.
+*/
+#ifndef PROCESSING_VOLUME_SOURCE_HPP
+#define PROCESSING_VOLUME_SOURCE_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <gsl/span>
+#include <SGNSProcMain.hpp>
+
+namespace sgns::sgprocessing
+{
+    /** Order of the axes in memory, slowest first
+    */
+    enum class VolumeLayout
+    {
+        HWD,
+        HDW,
+        WHD,
+        WDH,
+        DHW,
+        DWH
+    };
+
+    class VolumeSource
+    {
+    public:
+        /** Region of the volume in voxels, must lie inside its bounds
+        */
+        struct Box
+        {
+            int x;
+            int y;
+            int z;
+            int width;
+            int height;
+            int depth;
+        };
+
+        /** Wrap a volume without copying it, the data must outlive the source
+        * @param data - Raw volume bytes
+        * @param format - FLOAT32 or FLOAT16
+        * @param layout - Axis order of data
+        * @param width - Volume width
+        * @param height - Volume height
+        * @param depth - Volume depth
+        */
+        VolumeSource( gsl::span<const char> data,
+                      sgns::InputFormat     format,
+                      VolumeLayout          layout,
+                      int                   width,
+                      int                   height,
+                      int                   depth );
+
+        /** Check whether a format can be read
+        */
+        static bool IsSupportedFormat( sgns::InputFormat format );
+
+        /** Read the layout from "<inputName>Layout", "<inputName>_layout", "volumeLayout" or "layout",
+        * defaulting to HWD
+        * @param parameters - Parameters of the processing json, may be null
+        * @param inputName - Name of the texture3D input
+        */
+        static VolumeLayout ParseLayout( const std::vector<sgns::Parameter> *parameters, const std::string &inputName );
+
+        /** Get the name of a layout as written in the processing json
+        */
+        static const char *LayoutToString( VolumeLayout layout );
+
+        /** Decode one patch straight from the source layout and format into an HWD ordered patch
+        * buffer. Voxels of the patch past the volume bounds are set to zero.
+        * @param x - Patch origin along width
+        * @param y - Patch origin along height
+        * @param z - Patch origin along depth
+        * @param patchWidth - Patch width
+        * @param patchHeight - Patch height
+        * @param patchDepth - Patch depth
+        * @param patch - Receives patchWidth * patchHeight * patchDepth floats
+        */
+        void GatherPatch( int x, int y, int z, int patchWidth, int patchHeight, int patchDepth, float *patch ) const;
+
+        /** Decode rows [rowBegin, rowEnd) of a patch, as GatherPatch does for all of them. Disjoint row
+        * ranges of one patch write disjoint parts of the buffer, so they can be gathered on several threads.
+        * @param rowBegin - First patch row (offset from y) to decode
+        * @param rowEnd - One past the last patch row to decode
+        * @param patch - Whole patch buffer, only the floats of the given rows are written
+        */
+        void GatherPatchRows( int    x,
+                              int    y,
+                              int    z,
+                              int    patchWidth,
+                              int    patchHeight,
+                              int    patchDepth,
+                              int    rowBegin,
+                              int    rowEnd,
+                              float *patch ) const;
+
+    private:
+        /** Decode a region into an HWD ordered float buffer
+        * @param box - Region to read
+        * @param destination - First float of the region's output
+        * @param rowStride - Distance in floats between consecutive w in the output
+        * @param planeStride - Distance in floats between consecutive h in the output
+        */
+        void CopyBox( const Box &box, float *destination, size_t rowStride, size_t planeStride ) const;
+
+        gsl::span<const char> data_;
+        sgns::InputFormat     format_;
+        VolumeLayout          layout_;
+        int                   width_;
+        int                   height_;
+        int                   depth_;
+    };
+}
+
+#endif
@@ -0,0 +1,97 @@
+/**
+* Header file for running the windows of a sliding-window processor on a pool of workers.
+* Inference runs in parallel, each worker leasing its own session, while results are merged
+* on the calling thread strictly in window order so stitched output and hashes are deterministic.
+*/
+#ifndef PROCESSING_WINDOW_EXECUTOR_HPP
+#define PROCESSING_WINDOW_EXECUTOR_HPP
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <MNN/Interpreter.hpp>
+#include <MNN/Tensor.hpp>
+#include <SGNSProcMain.hpp>
+
+namespace sgns::sgprocessing
+{
+    class WindowExecutor
+    {
+    public:
+        /** Runs inference for one window on a worker thread, returns nullptr on failure
+        */
+        using WindowTask = std::function<std::unique_ptr<MNN::Tensor>( size_t windowIndex )>;
+
+        /** Runs inference for windowCount consecutive windows starting at firstWindow as one batch of
+        * batchSize entries, the entries past windowCount being padding. Returns at least windowCount
+        * outputs in window order, fewer on failure.
+        */
+        using BatchTask = std::function<std::vector<std::unique_ptr<MNN::Tensor>>( size_t firstWindow,
+                                                                                    size_t windowCount,
+                                                                                    size_t batchSize )>;
+
+        /** Consumes the output of one window on the calling thread, returns false to abort
+        */
+        using MergeFunction = std::function<bool( size_t windowIndex, MNN::Tensor &output )>;
+
+        /** Create an executor
+        * @param workerCount - Number of windows inferred concurrently, 1 runs everything on the calling thread
+        * @param windowsInFlight - Max number of finished but not yet merged batches per worker
+        */
+        explicit WindowExecutor( size_t workerCount, size_t windowsInFlight = 2 );
+
+        /** Run all windows
+        * @param windowCount - Number of windows
+        * @param task - Inference for a window
+        * @param merge - Called once per window in increasing window index order
+        * @return true if every window was inferred and merged, false if a task or merge failed or threw
+        */
+        bool Run( size_t windowCount, const WindowTask &task, const MergeFunction &merge ) const;
+
+        /** Run all windows in batches. Workers pick up whole batches, merge still sees single windows.
+        * If the first batch fails, the model is taken not to support batching (fixed batch of 1 or
+        * outputs without a batch dimension) and every window is run with batch 1 instead.
+        * @param windowCount - Number of windows
+        * @param batchSize - Windows per batch, the last batch may hold fewer
+        * @param task - Inference for a batch
+        * @param merge - Called once per window in increasing window index order
+        * @return true if every window was inferred and merged, false if a task or merge failed or threw
+        */
+        bool RunBatched( size_t               windowCount,
+                         size_t               batchSize,
+                         const BatchTask     &task,
+                         const MergeFunction &merge ) const;
+
+        /** Split a host tensor along its outermost (batch) dimension
+        * @param output - Float host tensor of shape [batchSize, ...]
+        * @param batchSize - Number of entries in the batch
+        * @return One tensor of shape [1, ...] per batch entry, empty if the shape does not match
+        */
+        static std::vector<std::unique_ptr<MNN::Tensor>> SplitBatch( std::unique_ptr<MNN::Tensor> output,
+                                                                     size_t                       batchSize );
+
+        /** Resize the outermost (batch) dimension of a session input, keeping the rest of its shape.
+        * Caller still has to resizeSession afterwards.
+        * @param interpreter - Interpreter owning the session
+        * @param input - Session input tensor
+        * @param batchSize - New batch dimension
+        * @return false if the input has no dimension to batch along
+        */
+        static bool ResizeBatch( MNN::Interpreter *interpreter, MNN::Tensor *input, int batchSize );
+
+        /** Get number of workers from the "parallelWorkers" parameter. Defaults to, and is clamped to,
+        * one worker per sessionThreads hardware threads (at least one).
+        * @param parameters - Parameters of the processing json, may be null
+        * @param sessionThreads - Threads used by each MNN session
+        */
+        static size_t GetWorkerCount( const std::vector<sgns::Parameter> *parameters, int sessionThreads );
+
+    private:
+        size_t workerCount_;
+        size_t windowsInFlight_;
+    };
+}
+
+#endif
@@ -0,0 +1,197 @@
+/**
+* Header file for overlap-add stitching of sliding-window outputs back into one signal. Window
+* outputs are added with contiguous row loops wherever the tensor layout allows it, and the
+* division by coverage happens in a single pass per position. When streaming, positions behind
+* the start of the newest window are final and leave for a sink, so only one window length of
+* output is held in memory.
+*/
+#ifndef PROCESSING_WINDOW_STITCHER_HPP
+#define PROCESSING_WINDOW_STITCHER_HPP
+
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include <MNN/Tensor.hpp>
+#include <SGNSProcMain.hpp>
+#include "processing_output_buffer.hpp"
+#include "util/OutputSink.hpp"
+#include "util/sha256.hpp"
+
+namespace sgns::sgprocessing
+{
+    class WindowStitcher
+    {
+    public:
+        /** Order of the stitched output
+        */
+        enum class Layout
+        {
+            ChannelsFirst, ///< channel * length + position
+            ChannelsLast,  ///< position * channels + channel
+        };
+
+        /** How overlapping windows are weighted against each other
+        */
+        enum class Blend
+        {
+            Uniform,  ///< Plain average of all windows covering a position
+            Gaussian, ///< Gaussian taper centered on the window, sigma = 1/8 of the window
+            Hann,     ///< Raised cosine taper that falls towards both window edges
+        };
+
+        /** Create a stitcher for one signal
+        * @param starts - Window starts, as returned by ComputeWindowStarts
+        * @param length - Number of positions in the signal
+        * @param windowLength - Number of positions per window
+        * @param blend - Weighting of overlapping windows
+        * @param layout - Order of the stitched output
+        */
+        WindowStitcher( std::vector<int> starts,
+                        int              length,
+                        int              windowLength,
+                        Blend            blend  = Blend::Uniform,
+                        Layout           layout = Layout::ChannelsFirst );
+
+        /** Read "stitchBlend" from the processing parameters: "uniform" (default), "gaussian" or "hann".
+        * Unknown values fall back to uniform.
+        */
+        static Blend GetBlend( const std::vector<sgns::Parameter> *parameters );
+
+        /** Get the weight of every position of a window, all ones for uniform blending. Weights
+        * never reach zero, so positions only one window covers keep their value.
+        * @param blend - Weighting of overlapping windows
+        * @param windowLength - Number of positions per window
+        */
+        static std::vector<float> GetBlendKernel( Blend blend, int windowLength );
+
+        /** Get the start of every window so the last one ends at the signal end
+        * @param length - Number of positions in the signal
+        * @param roi - Number of positions per window
+        * @param stride - Distance between window starts
+        */
+        static std::vector<int> ComputeWindowStarts( int length, int roi, int stride );
+
+        /** Read "streamOutput" from the processing parameters, 1 to stream the stitched output to a
+        * spool file instead of keeping it in memory. Streaming stays off unless the node configured
+        * a directory for it, a job never chooses where the file goes.
+        * @param parameters - Parameters of the processing json, may be null
+        * @param directory - Directory for streamed outputs, empty if streaming is not available to the job
+        */
+        static bool IsStreamEnabled( const std::vector<sgns::Parameter> *parameters,
+                                     const std::filesystem::path        &directory );
+
+        /** Stream to a new spool file in directory if the parameters ask for it. TakeOutput then
+        * returns a buffer backed by that file, which is saved to the declared outputs like any other.
+        * @param parameters - Parameters of the processing json, may be null
+        * @param directory - Directory for streamed outputs, empty if streaming is not available to the job
+        * @return false if streaming was requested and the spool file cannot be created
+        */
+        bool StreamFromParameters( const std::vector<sgns::Parameter> *parameters,
+                                   const std::filesystem::path        &directory );
+
+        /** Write positions to a sink as soon as no later window can touch them instead of keeping
+        * the whole signal. Must be called before the first Add, and windows must then be added in
+        * order of their start.
+        * @param sink - Receives the stitched output at the byte offsets it would have in memory
+        */
+        void StreamTo( std::unique_ptr<OutputSink> sink );
+
+        /** Check whether stitched output goes to a sink instead of being kept in memory
+        */
+        bool IsStreaming() const
+        {
+            return sink_ != nullptr;
+        }
+
+        /** Add the output of one window. The first output fixes the channel count, outputs whose
+        * length along the signal is not the window length are hashed by the caller but not stitched.
+        * @param windowIndex - Index into the window starts
+        * @param output - Host tensor of the window
+        * @return false if writing finished positions to the sink failed
+        */
+        bool Add( size_t windowIndex, const MNN::Tensor &output );
+
+        /** Get the number of output channels, 0 before the first window
+        */
+        int GetChannels() const
+        {
+            return channels_;
+        }
+
+        /** Divide the remaining positions by their coverage and, when streaming, write them out,
+        * flush the sink and finish the output hash
+        * @return false if the sink failed
+        */
+        bool Finish();
+
+        /** Hash the stitched output after Finish and before TakeOutput. This is the digest of the
+        * output bytes in their final order, whether they were streamed or kept in memory. A streamed
+        * output is hashed as it is written, or read back from the sink by Finish when channels first
+        * rows of several channels were written interleaved.
+        */
+        sgprocmanagersha::Sha256Digest HashOutput();
+
+        /** Hand out the stitched signal after Finish
+        * @return Float32 buffer shaped { channels, length } or { length, channels } by layout, backed
+        * by the spool file when streamed from parameters, empty if no window was added or the output
+        * went to a sink given to StreamTo
+        */
+        OutputBuffer TakeOutput();
+
+    private:
+        /** Where a window output keeps channel c at position i: c * channelStride + i * positionStride
+        */
+        struct SourceLayout
+        {
+            int    channels       = 1;
+            int    length         = 1;
+            size_t channelStride  = 0;
+            size_t positionStride = 1;
+        };
+
+        static SourceLayout GetSourceLayout( const MNN::Tensor &tensor );
+
+        float *Values()
+        {
+            return output_.AsFloats().data();
+        }
+
+        /** Add positions [offset, offset + count) of a window to the buffers from slot on
+        */
+        void AddRun( const float *data, size_t offset, size_t slot, size_t count );
+
+        /** Normalize positions up to end, writing them to the sink and clearing their slots when streaming
+        */
+        bool FlushUntil( int end );
+
+        /** Write count normalized positions starting at position, which live from slot on
+        */
+        bool WriteRun( int position, size_t slot, size_t count );
+
+        /** Feed the whole output, read back from the sink in byte order, to the hasher
+        */
+        bool HashSink();
+
+        std::vector<int>   starts_;
+        int                length_;
+        int                windowLength_;
+        Layout             layout_;
+        int                channels_ = 0;
+        SourceLayout       source_;
+        std::vector<float> kernel_; ///< Empty for uniform blending, which then adds without multiplying
+        size_t             capacity_; ///< Positions held, the whole signal in memory or one window when streaming
+        int                flushed_ = 0; ///< Positions before this one are normalized
+        std::vector<float> coverage_; ///< Weight sum of position p in slot p % capacity_
+        OutputBuffer       output_;   ///< Stitched sums, laid out as the output with capacity_ positions
+
+        std::unique_ptr<OutputSink>                 sink_;
+        FileOutputSink                             *spool_ = nullptr; ///< sink_ when it is a spool file
+        sgprocmanagersha::Sha256Hasher              hasher_;
+        bool                                        hashWhileWriting_ = true; ///< Sink writes arrive in byte order
+        sgprocmanagersha::Sha256Digest              digest_{};                ///< Hash of a streamed output
+    };
+}
+
+#endif
@@ -0,0 +1,59 @@
+/**
+* Header file for bulk conversion of FLOAT16 and integer inputs to float. Uses F16C and AVX2 on x86
+* CPUs that have them, NEON on ARM64 and a branch-light scalar path everywhere else.
+*/
+#ifndef SGPROCMGR_FLOAT_CONVERSION_HPP
+#define SGPROCMGR_FLOAT_CONVERSION_HPP
+
+#include <cstdint>
+#include <gsl/span>
+
+namespace sgns::sgprocessing
+{
+    /** Convert one IEEE 754 half precision value, including subnormals, infinities and NaN
+    * @param value - Half precision bit pattern
+    */
+    float HalfToFloat( uint16_t value );
+
+    /** Convert a buffer of IEEE 754 half precision values
+    * @param input - Half precision bit patterns
+    * @param output - Receives input.size() floats, must be at least that large
+    */
+    void ConvertHalfToFloat( gsl::span<const uint16_t> input, gsl::span<float> output );
+
+    /** Convert a buffer of INT8 values, dequantized as ( value - zeroPoint ) * scale
+    * @param input - Integer values
+    * @param output - Receives input.size() floats, must be at least that large
+    * @param scale - Quantization scale, 1 keeps the plain value
+    * @param zeroPoint - Quantization zero point, 0 keeps the plain value
+    */
+    void ConvertInt8ToFloat( gsl::span<const int8_t> input,
+                             gsl::span<float>        output,
+                             float                   scale     = 1.0f,
+                             float                   zeroPoint = 0.0f );
+
+    /** Convert a buffer of INT16 values, dequantized as ( value - zeroPoint ) * scale
+    * @param input - Integer values
+    * @param output - Receives input.size() floats, must be at least that large
+    * @param scale - Quantization scale, 1 keeps the plain value
+    * @param zeroPoint - Quantization zero point, 0 keeps the plain value
+    */
+    void ConvertInt16ToFloat( gsl::span<const int16_t> input,
+                              gsl::span<float>         output,
+                              float                    scale     = 1.0f,
+                              float                    zeroPoint = 0.0f );
+
+    /** Convert a buffer of INT32 values, dequantized as ( value - zeroPoint ) * scale. Values beyond
+    * 2^24 round to the nearest float as static_cast does.
+    * @param input - Integer values
+    * @param output - Receives input.size() floats, must be at least that large
+    * @param scale - Quantization scale, 1 keeps the plain value
+    * @param zeroPoint - Quantization zero point, 0 keeps the plain value
+    */
+    void ConvertInt32ToFloat( gsl::span<const int32_t> input,
+                              gsl::span<float>         output,
+                              float                    scale     = 1.0f,
+                              float                    zeroPoint = 0.0f );
+}
+
+#endif
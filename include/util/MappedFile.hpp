@@ -0,0 +1,51 @@
+/**
+* Header file for read-only memory mapped files. Lets local models and inputs be handed to the
+* processors without reading them into the heap, and concurrent jobs on the same file share the
+* page cache.
+*
+* Files must not be truncated while mapped. Deleting or replacing a file (rename over it) is safe,
+* the mapping keeps the old contents, but reading pages cut off by truncation raises SIGBUS on
+* POSIX and an access violation on Windows. Files other processes may rewrite in place should go
+* through the loaders instead.
+*/
+#ifndef SGPROCMGR_MAPPED_FILE_HPP
+#define SGPROCMGR_MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <gsl/span>
+
+namespace sgns::sgprocessing
+{
+    class MappedFile
+    {
+    public:
+        /** Map a whole file read-only
+        * @param path - Local file path
+        * @return Mapping, or nullptr if the file cannot be opened, is empty, or cannot be mapped
+        */
+        static std::shared_ptr<MappedFile> Open( const std::string &path );
+
+        ~MappedFile();
+
+        MappedFile( const MappedFile & )            = delete;
+        MappedFile &operator=( const MappedFile & ) = delete;
+
+        /** Get the mapped bytes, valid for the lifetime of this object
+        */
+        gsl::span<const char> GetData() const;
+
+    private:
+        MappedFile() = default;
+
+        const char *data_ = nullptr;
+        size_t      size_ = 0;
+#if defined( _WIN32 )
+        void *file_    = nullptr;
+        void *mapping_ = nullptr;
+#endif
+    };
+}
+
+#endif
@@ -0,0 +1,93 @@
+/**
+* Header file for destinations of processor output that is produced piece by piece, so large
+* stitched results can leave memory as soon as they are final instead of being held until the
+* end of a task.
+*/
+#ifndef SGPROCMGR_OUTPUT_SINK_HPP
+#define SGPROCMGR_OUTPUT_SINK_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <gsl/span>
+
+namespace sgns::sgprocessing
+{
+    class OutputSink
+    {
+    public:
+        virtual ~OutputSink() = default;
+
+        /** Write a finished range of the output. Ranges may arrive in any order but never overlap.
+        * @param offset - Byte offset of data within the whole output
+        * @param data - Bytes to write
+        * @return true on success
+        */
+        virtual bool Write( uint64_t offset, gsl::span<const char> data ) = 0;
+
+        /** Make everything written so far durable
+        * @return true on success
+        */
+        virtual bool Flush() = 0;
+
+        /** Read back a range that was written and flushed
+        * @param offset - Byte offset within the whole output
+        * @param data - Receives exactly data.size() bytes
+        * @return true on success
+        */
+        virtual bool Read( uint64_t offset, gsl::span<char> data ) = 0;
+    };
+
+    class FileOutputSink : public OutputSink
+    {
+    public:
+        /** Create a spool file with a new unique name in a directory. An existing file is never opened,
+        * so a sink cannot overwrite anything.
+        * @param directory - Directory for streamed outputs, configured on the node
+        * @return Sink, or nullptr if no file can be created there
+        */
+        static std::unique_ptr<FileOutputSink> Create( const std::filesystem::path &directory );
+
+        /** Close the file and remove it unless Keep was called
+        */
+        ~FileOutputSink() override;
+
+        FileOutputSink( const FileOutputSink & )            = delete;
+        FileOutputSink &operator=( const FileOutputSink & ) = delete;
+
+        bool Write( uint64_t offset, gsl::span<const char> data ) override;
+
+        /** Write buffered bytes and sync the file to its device
+        */
+        bool Flush() override;
+
+        bool Read( uint64_t offset, gsl::span<char> data ) override;
+
+        /** Leave the file in place when the sink is destroyed, once its contents are handed on
+        */
+        void Keep()
+        {
+            keep_ = true;
+        }
+
+        /** Get the path the sink writes to
+        */
+        const std::string &GetPath() const
+        {
+            return path_;
+        }
+
+    private:
+        FileOutputSink( std::string path, std::FILE *file );
+
+        bool Seek( uint64_t offset );
+
+        std::string path_;
+        std::FILE  *file_;
+        bool        keep_ = false;
+    };
+}
+
+#endif
@@ -0,0 +1,68 @@
+/**
+* Header file for an input that is still arriving. A loader that can deliver partial data fills it
+* front to back from a thread of its own, while processing reads the ranges that have arrived and
+* waits for the rest.
+*/
+#ifndef SGPROCMGR_PROGRESSIVE_INPUT_HPP
+#define SGPROCMGR_PROGRESSIVE_INPUT_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <vector>
+#include <gsl/span>
+
+namespace sgns::sgprocessing
+{
+    class ProgressiveInput
+    {
+    public:
+        /** Set the total size once the loader knows it, before the first Append
+        * @param size - Size of the whole input in bytes
+        * @return false if the size was already set or the load already finished
+        */
+        bool SetSize( size_t size );
+
+        /** Append the next bytes of the input. Only the loader calls this, from one thread at a time.
+        * @param bytes - Bytes following everything appended so far
+        * @return false if they run past the size or the size is not set yet
+        */
+        bool Append( gsl::span<const char> bytes );
+
+        /** Mark the load as finished and wake every reader
+        * @param succeeded - false if the load failed, a load ending short of the size fails as well
+        */
+        void Finish( bool succeeded );
+
+        /** Block until the loader set the size
+        * @return Size of the whole input, nullopt if the load failed before
+        */
+        std::optional<size_t> WaitForSize() const;
+
+        /** Block until a prefix of the input has arrived
+        * @param bytes - Length of the prefix
+        * @return false if the load failed or ended before the prefix arrived
+        */
+        bool WaitFor( size_t bytes ) const;
+
+        /** Get the whole input once the size is set. Only bytes a WaitFor returned true for may be read.
+        */
+        gsl::span<const char> GetData() const;
+
+        /** Get the number of bytes that have arrived
+        */
+        size_t GetAvailable() const;
+
+    private:
+        mutable std::mutex              mutex_;
+        mutable std::condition_variable arrived_;
+        std::vector<char>               data_;
+        size_t                          available_ = 0;
+        bool                            sized_     = false;
+        bool                            finished_  = false;
+        bool                            failed_    = false;
+    };
+}
+
+#endif
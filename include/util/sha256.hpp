@@ -1,13 +1,169 @@
 #ifndef SGPROCMGR_SHA256_HPP
 #define SGPROCMGR_SHA256_HPP
 
+#include <array>
+#include <cstdint>
 #include <string_view>
 #include <vector>
 #include <gsl/span>
 
 namespace sgns::sgprocmanagersha
 {
+  constexpr size_t SHA256_SIZE = 32;
+
+  using Sha256Digest = std::array<uint8_t, SHA256_SIZE>;
+
   std::vector<uint8_t> sha256(const void* data, size_t dataSize);
+
+  /** One message of a batch hash
+  */
+  struct Sha256Input
+  {
+      const void *data;
+      size_t      size;
+  };
+
+  enum class Sha256Backend
+  {
+      OpenSsl,         ///< One message at a time, OpenSSL uses SHA-NI itself where available
+      Avx2MultiBuffer, ///< Eight equally sized messages per pass in AVX2 lanes
+  };
+
+  /** Get the backend sha256Batch uses on this CPU, detected once
+  */
+  Sha256Backend GetSha256Backend();
+
+  /** Hash many independent messages. Without SHA-NI but with AVX2, equally sized messages are
+  * hashed eight at a time, everything else goes through OpenSSL.
+  * @param inputs - Messages to hash
+  * @return One digest per message, in input order
+  */
+  std::vector<Sha256Digest> sha256Batch( gsl::span<const Sha256Input> inputs );
+
+  /** Hash many independent messages with a given backend instead of the detected one, so both can
+  * be checked on any CPU. Avx2MultiBuffer falls back to OpenSSL where AVX2 is not available.
+  * @param inputs - Messages to hash
+  * @param backend - Backend to use
+  * @return One digest per message, in input order
+  */
+  std::vector<Sha256Digest> sha256Batch( gsl::span<const Sha256Input> inputs, Sha256Backend backend );
+
+  /**
+  * Incremental SHA-256 that keeps one digest context alive across messages, so hashing many
+  * small chunks does not allocate per chunk.
+  */
+  class Sha256Hasher
+  {
+  public:
+      Sha256Hasher();
+      ~Sha256Hasher();
+
+      Sha256Hasher( const Sha256Hasher & )            = delete;
+      Sha256Hasher &operator=( const Sha256Hasher & ) = delete;
+
+      /** Feed more bytes into the current message
+      * @param data - Bytes to hash
+      * @param dataSize - Number of bytes
+      */
+      Sha256Hasher &Update( const void *data, size_t dataSize );
+
+      /** Finish the current message and start a new one
+      * @return Digest of everything passed to Update since the last Finalize
+      */
+      Sha256Digest Finalize();
+
+      /** Hash one whole message
+      * @param data - Bytes to hash
+      * @param dataSize - Number of bytes
+      */
+      Sha256Digest Digest( const void *data, size_t dataSize );
+
+  private:
+      void Reset();
+
+      void *ctx_ = nullptr;
+  };
+
+  /**
+  * Running subtask hash, chained as sha256( previous || sha256( chunk ) ) starting from an all
+  * zero digest.
+  */
+  class Sha256Chain
+  {
+  public:
+      /** Hash a chunk and fold it into the running hash
+      * @param data - Chunk bytes
+      * @param dataSize - Number of bytes
+      * @return Digest of the chunk alone
+      */
+      Sha256Digest Append( const void *data, size_t dataSize );
+
+      /** Fold an already computed chunk digest into the running hash
+      * @param chunkDigest - Digest of the chunk
+      */
+      void AppendDigest( const Sha256Digest &chunkDigest );
+
+      /** Get the running hash
+      */
+      const Sha256Digest &GetHash() const
+      {
+          return hash_;
+      }
+
+      /** Get the running hash as a byte vector
+      */
+      std::vector<uint8_t> GetHashBytes() const
+      {
+          return std::vector<uint8_t>( hash_.begin(), hash_.end() );
+      }
+
+  private:
+      Sha256Hasher hasher_;
+      Sha256Digest hash_{};
+  };
+
+  /**
+  * Merkle tree over chunk digests, shaped as in RFC 6962: leaves are sha256( 0x00 || chunk digest ),
+  * inner nodes sha256( 0x01 || left || right ), and the left subtree of every node holds the largest
+  * power of two leaves. Leaves can be added one at a time while only keeping one root per
+  * completed power of two subtree.
+  */
+  class Sha256MerkleTree
+  {
+  public:
+      /** Add the next leaf
+      * @param chunkDigest - Digest of the chunk
+      */
+      void AppendDigest( const Sha256Digest &chunkDigest );
+
+      /** Get the root over all leaves added so far, sha256 of nothing if there are none
+      */
+      Sha256Digest GetRoot() const;
+
+      /** Get the number of leaves added so far
+      */
+      size_t GetLeafCount() const
+      {
+          return leafCount_;
+      }
+
+      /** Compute the same root over a complete set of leaves, hashing each tree level on several threads
+      * @param chunkDigests - Leaf chunk digests in order
+      * @param workerCount - Maximum number of threads to use
+      */
+      static Sha256Digest ComputeRoot( gsl::span<const Sha256Digest> chunkDigests, size_t workerCount );
+
+  private:
+      struct Subtree
+      {
+          Sha256Digest root;
+          size_t       leaves;
+      };
+
+      mutable Sha256Hasher hasher_;
+      std::vector<Subtree> subtrees_;
+      size_t               leafCount_ = 0;
+  };
 }
 
 #endif
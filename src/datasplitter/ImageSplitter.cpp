@@ -1,121 +1,369 @@
 #include <datasplitter/ImageSplitter.hpp>
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION
-#include <openssl/sha.h> // For SHA256_DIGEST_LENGTH
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
 #include <gsl/span>
+#include "util/sha256.hpp"
 
 namespace sgns::sgprocessing
 {
+    namespace
+    {
+        // Fewer parts per thread than this are not worth starting a thread for
+        constexpr uint64_t MIN_PARTS_PER_WORKER = 64;
+
+        /** Slot to start probing at. CIDs are SHA-256 digests, so any 8 of their bytes are
+        * already uniformly distributed.
+        */
+        size_t CidSlot( const std::vector<uint8_t> &cid, size_t mask )
+        {
+            uint64_t key = 0;
+            std::memcpy( &key, cid.data(), std::min<size_t>( sizeof( key ), cid.size() ) );
+            return static_cast<size_t>( key ) & mask;
+        }
+    }
+
     ImageSplitter::ImageSplitter( const std::vector<uint8_t> &buffer,
                                   uint64_t                    blockstride,
                                   uint64_t                    blocklinestride,
                                   uint64_t                    blocklen,
                                   int                         channels ) :
-        blockstride_( blockstride ), blocklinestride_( blocklinestride ), blocklen_( blocklen ), channels_( channels )
+        ImageSplitter( gsl::span<const uint8_t>( buffer.data(), buffer.size() ),
+                       blockstride,
+                       blocklinestride,
+                       blocklen,
+                       channels )
     {
-        // Set inputImage and imageSize from the provided buffer
-        inputImage = reinterpret_cast<const unsigned char *>( buffer.data() );
-        imageSize  = buffer.size();
+    }
+
+    ImageSplitter::ImageSplitter( std::vector<uint8_t> &&buffer,
+                                  uint64_t               blockstride,
+                                  uint64_t               blocklinestride,
+                                  uint64_t               blocklen,
+                                  int                    channels ) :
+        blockstride_( blockstride ),
+        blocklinestride_( blocklinestride ),
+        blocklen_( blocklen ),
+        channels_( channels ),
+        ownedImage_( std::move( buffer ) )
+    {
+        source_ = ImagePartView{ ownedImage_.data(), ownedImage_.size(), ownedImage_.size(), 1 };
         SplitImageData();
     }
 
-    std::vector<uint8_t> ImageSplitter::GetPart( int part )
+    ImageSplitter::ImageSplitter( gsl::span<const uint8_t> buffer,
+                                  uint64_t                 blockstride,
+                                  uint64_t                 blocklinestride,
+                                  uint64_t                 blocklen,
+                                  int                      channels ) :
+        ImageSplitter( ImagePartView{ buffer.data(), buffer.size(), buffer.size(), 1 },
+                       blockstride,
+                       blocklinestride,
+                       blocklen,
+                       channels )
     {
-        return splitparts_.at( part );
     }
 
-    size_t ImageSplitter::GetPartByCid( const std::vector<uint8_t> &cid ) const
+    ImageSplitter::ImageSplitter( const ImagePartView &source,
+                                  uint64_t             blockstride,
+                                  uint64_t             blocklinestride,
+                                  uint64_t             blocklen,
+                                  int                  channels ) :
+        blockstride_( blockstride ),
+        blocklinestride_( blocklinestride ),
+        blocklen_( blocklen ),
+        channels_( channels ),
+        source_( source )
+    {
+        SplitImageData();
+    }
+
+    std::vector<uint8_t> ImageSplitter::GetPart( int part ) const
+    {
+        std::vector<uint8_t> data( blocklen_ );
+        GetPartView( part ).CopyTo( data.data() );
+        return data;
+    }
+
+    ImagePartView ImageSplitter::GetPartView( int part ) const
     {
-        //Find the index of cid in cids_
-        auto it = std::find( cids_.begin(), cids_.end(), cid );
-        if ( it == cids_.end() )
+        if ( part < 0 || static_cast<uint64_t>( part ) >= partCount_ )
         {
-            //CID not found
-            return -1;
+            throw std::out_of_range( "Image part index out of range" );
         }
 
-        //Find index in splitparts_ corresponding to cid
-        size_t index = std::distance( cids_.begin(), it );
+        const uint64_t offset = GetPartOffset( static_cast<uint64_t>( part ) );
+        const uint64_t rows   = blocklen_ / blockstride_;
+        const uint64_t pitch  = blockstride_ + blocklinestride_;
+        if ( source_.IsContiguous() )
+        {
+            return ImagePartView{ source_.data + offset, blockstride_, pitch, rows };
+        }
+        // SplitImageData made sure every row of the part lies inside one row of the source
+        const uint64_t sourceRow = offset / source_.rowBytes;
+        const uint64_t column    = offset % source_.rowBytes;
+        return ImagePartView{ source_.data + sourceRow * source_.rowPitch + column,
+                              blockstride_,
+                              pitch / source_.rowBytes * source_.rowPitch,
+                              rows };
+    }
 
-        //Return the data
-        if ( index < splitparts_.size() )
+    void ImageSplitter::CopyPart( int part, gsl::span<uint8_t> destination ) const
+    {
+        if ( destination.size() < blocklen_ )
         {
-            return index;
+            throw std::invalid_argument( "Destination is smaller than the image part" );
         }
-        //Index out of range
-        return -1;
+        GetPartView( part ).CopyTo( destination.data() );
+    }
+
+    size_t ImageSplitter::GetPartByCid( const std::vector<uint8_t> &cid ) const
+    {
+        ComputeCids();
+        return FindCid( cid );
+    }
+
+    std::vector<size_t> ImageSplitter::GetPartsByCid( const std::vector<std::vector<uint8_t>> &cids ) const
+    {
+        ComputeCids();
+
+        std::vector<size_t> parts;
+        parts.reserve( cids.size() );
+        for ( const auto &cid : cids )
+        {
+            parts.push_back( FindCid( cid ) );
+        }
+        return parts;
     }
 
     void ImageSplitter::SplitImageData()
     {
+        if ( blockstride_ == 0 || blocklen_ % blockstride_ != 0 )
+        {
+            throw std::invalid_argument( "Block length is not a multiple of the block stride" );
+        }
+
+        const uint64_t imageSize = source_.GetSize();
         // Check if imageSize is evenly divisible by blocklen_
         if ( imageSize % blocklen_ != 0 )
         {
             throw std::invalid_argument( "Image size is not evenly divisible by block length" );
         }
+        partCount_ = imageSize / blocklen_;
+
+        const uint64_t rows  = blocklen_ / blockstride_;
+        const uint64_t pitch = blockstride_ + blocklinestride_;
+
+        // A strided source can only be read in place if each row of a part stays inside one
+        // row of the source, otherwise the source is copied once to make it contiguous
+        bool inPlace = source_.IsContiguous() || rows <= 1 || pitch % source_.rowBytes == 0;
+        for ( uint64_t part = 0; part < partCount_; ++part )
+        {
+            const uint64_t offset = GetPartOffset( part );
+            if ( offset + ( rows - 1 ) * pitch + blockstride_ > imageSize )
+            {
+                throw std::invalid_argument( "Image part reaches past the end of the image" );
+            }
+            if ( !source_.IsContiguous() && offset % source_.rowBytes + blockstride_ > source_.rowBytes )
+            {
+                inPlace = false;
+            }
+        }
+
+        if ( !inPlace )
+        {
+            ownedImage_.resize( imageSize );
+            source_.CopyTo( ownedImage_.data() );
+            source_ = ImagePartView{ ownedImage_.data(), imageSize, imageSize, 1 };
+        }
+    }
+
+    uint64_t ImageSplitter::GetPartOffset( uint64_t part ) const
+    {
+        const uint64_t i             = part * blocklen_;
+        const uint64_t rowsdone      = ( i / ( blocklen_ * ( ( blockstride_ + blocklinestride_ ) / blockstride_ ) ) );
+        uint64_t       bufferoffset  = 0 + ( i / blocklen_ * blockstride_ );
+        bufferoffset                -= ( blockstride_ + blocklinestride_ ) * rowsdone;
+        bufferoffset                += rowsdone * ( blocklen_ * ( ( blockstride_ + blocklinestride_ ) / blockstride_ ) );
+        return bufferoffset;
+    }
+
+    size_t ImageSplitter::FindCid( const std::vector<uint8_t> &cid ) const
+    {
+        if ( cidIndex_.empty() || cid.size() != sgprocmanagersha::SHA256_SIZE )
+        {
+            //CID not found
+            return -1;
+        }
+        const size_t mask = cidIndex_.size() - 1;
+        for ( size_t slot = CidSlot( cid, mask ); cidIndex_[slot] != 0; slot = ( slot + 1 ) & mask )
+        {
+            const size_t part = cidIndex_[slot] - 1;
+            if ( cids_[part] == cid )
+            {
+                return part;
+            }
+        }
+        //CID not found
+        return -1;
+    }
+
+    void ImageSplitter::ComputeCids() const
+    {
+        std::call_once( *cidsOnce_, [this] { BuildCids(); } );
+    }
+
+    void ImageSplitter::BuildCids() const
+    {
+        if ( partCount_ == 0 )
+        {
+            return;
+        }
 
-        for ( uint64_t i = 0; i < imageSize; i += blocklen_ )
+        // Each worker hashes a contiguous range of parts into its own slots, so the CIDs come
+        // out in part order no matter how many threads run
+        cids_.assign( partCount_, {} );
+        auto hashParts = [this]( uint64_t begin, uint64_t end )
         {
-            std::vector<uint8_t> chunkBuffer( blocklen_ );
-            int      rowsdone      = ( i / ( blocklen_ * ( ( blockstride_ + blocklinestride_ ) / blockstride_ ) ) );
-            uint32_t bufferoffset  = 0 + ( i / blocklen_ * blockstride_ );
-            bufferoffset          -= ( blockstride_ + blocklinestride_ ) * rowsdone;
-            bufferoffset          += rowsdone * ( blocklen_ * ( ( blockstride_ + blocklinestride_ ) / blockstride_ ) );
-            for ( uint64_t size = 0; size < blocklen_; size += blockstride_ )
+            std::vector<ImagePartView> views;
+            views.reserve( end - begin );
+            for ( uint64_t part = begin; part < end; ++part )
             {
-                auto chunkData = inputImage + bufferoffset;
-                std::memcpy( chunkBuffer.data() + ( size ), chunkData, blockstride_ );
-                bufferoffset += blockstride_ + blocklinestride_;
+                views.push_back( GetPartView( static_cast<int>( part ) ) );
             }
-            splitparts_.push_back( chunkBuffer );
-            chunkWidthActual_.push_back( blockstride_ / channels_ );
-            chunkHeightActual_.push_back( blocklen_ / blockstride_ );
-            gsl::span<const uint8_t> byte_span( chunkBuffer );
-            std::vector<uint8_t>     shahash( SHA256_DIGEST_LENGTH );
-            unsigned int             digest_len = 0;
 
-            EVP_MD_CTX *ctx = EVP_MD_CTX_new();
-            EVP_DigestInit_ex( ctx, EVP_sha256(), NULL );
-            EVP_DigestUpdate( ctx, chunkBuffer.data(), chunkBuffer.size() );
-            EVP_DigestFinal_ex( ctx, shahash.data(), &digest_len );
-            EVP_MD_CTX_free( ctx );
+            if ( views.front().IsContiguous() )
+            {
+                std::vector<sgprocmanagersha::Sha256Input> parts;
+                parts.reserve( views.size() );
+                for ( const auto &view : views )
+                {
+                    parts.push_back( { view.data, view.GetSize() } );
+                }
+                const auto hashes = sgprocmanagersha::sha256Batch( parts );
+                for ( uint64_t part = begin; part < end; ++part )
+                {
+                    cids_[part].assign( hashes[part - begin].begin(), hashes[part - begin].end() );
+                }
+                return;
+            }
+
+            // Strided parts hash row by row, the digest is the same as over the copied part
+            sgprocmanagersha::Sha256Hasher hasher;
+            for ( uint64_t part = begin; part < end; ++part )
+            {
+                const auto &view = views[part - begin];
+                for ( uint64_t row = 0; row < view.rows; ++row )
+                {
+                    hasher.Update( view.data + row * view.rowPitch, view.rowBytes );
+                }
+                const auto shahash = hasher.Finalize();
+                cids_[part].assign( shahash.begin(), shahash.end() );
+            }
+        };
+
+        const uint64_t workers = std::max<uint64_t>(
+            1,
+            std::min<uint64_t>( GetWorkerCount(), partCount_ / MIN_PARTS_PER_WORKER ) );
+        if ( workers == 1 )
+        {
+            hashParts( 0, partCount_ );
+        }
+        else
+        {
+            const uint64_t           perWorker = ( partCount_ + workers - 1 ) / workers;
+            std::vector<std::thread> threads;
+            threads.reserve( workers );
+            for ( uint64_t begin = 0; begin < partCount_; begin += perWorker )
+            {
+                threads.emplace_back( hashParts, begin, std::min( partCount_, begin + perWorker ) );
+            }
+            for ( auto &thread : threads )
+            {
+                thread.join();
+            }
+        }
 
-            cids_.emplace_back( shahash );
+        // At most half full keeps linear probe sequences short
+        size_t capacity = 16;
+        while ( capacity < 2 * cids_.size() )
+        {
+            capacity *= 2;
+        }
+        cidIndex_.assign( capacity, 0 );
+        const size_t mask = capacity - 1;
+        for ( size_t part = 0; part < cids_.size(); ++part )
+        {
+            size_t slot = CidSlot( cids_[part], mask );
+            while ( cidIndex_[slot] != 0 && cids_[cidIndex_[slot] - 1] != cids_[part] )
+            {
+                slot = ( slot + 1 ) & mask;
+            }
+            // Identical blocks share a CID, lookups keep resolving to the first of them
+            if ( cidIndex_[slot] == 0 )
+            {
+                cidIndex_[slot] = static_cast<uint32_t>( part + 1 );
+            }
         }
     }
 
     uint32_t ImageSplitter::GetPartSize( int part ) const
     {
-        return splitparts_.at( part ).size();
+        return static_cast<uint32_t>( GetPartView( part ).GetSize() );
     }
 
     uint32_t ImageSplitter::GetPartStride( int part ) const
     {
-        return chunkWidthActual_.at( part );
+        return GetPartWidthActual( part );
     }
 
     int ImageSplitter::GetPartWidthActual( int part ) const
     {
-        return chunkWidthActual_.at( part );
+        if ( part < 0 || static_cast<uint64_t>( part ) >= partCount_ )
+        {
+            throw std::out_of_range( "Image part index out of range" );
+        }
+        return static_cast<int>( blockstride_ / channels_ );
     }
 
     int ImageSplitter::GetPartHeightActual( int part ) const
     {
-        return chunkHeightActual_.at( part );
+        if ( part < 0 || static_cast<uint64_t>( part ) >= partCount_ )
+        {
+            throw std::out_of_range( "Image part index out of range" );
+        }
+        return static_cast<int>( blocklen_ / blockstride_ );
+    }
+
+    void ImageSplitter::SetWorkerCount( size_t workerCount )
+    {
+        workerCount_ = workerCount;
+    }
+
+    size_t ImageSplitter::GetWorkerCount() const
+    {
+        if ( workerCount_ > 0 )
+        {
+            return workerCount_;
+        }
+        return std::max<size_t>( 1, std::thread::hardware_concurrency() );
     }
 
     size_t ImageSplitter::GetPartCount() const
     {
-        return splitparts_.size();
+        return partCount_;
     }
 
     size_t ImageSplitter::GetImageSize() const
     {
-        return imageSize;
+        return source_.GetSize();
     }
 
     std::vector<uint8_t> ImageSplitter::GetPartCID( int part ) const
     {
+        ComputeCids();
         return cids_.at( part );
     }
 }
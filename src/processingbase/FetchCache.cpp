@@ -0,0 +1,353 @@
+#include <processingbase/FetchCache.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <system_error>
+#include <utility>
+#include <vector>
+#include "util/sha256.hpp"
+
+namespace sgns::sgprocessing
+{
+    namespace
+    {
+        const char *INDEX_FILE_NAME = "index";
+
+        std::string ToHex( const std::vector<uint8_t> &bytes )
+        {
+            static const char digits[] = "0123456789abcdef";
+            std::string       hex;
+            hex.reserve( bytes.size() * 2 );
+            for ( auto byte : bytes )
+            {
+                hex.push_back( digits[byte >> 4] );
+                hex.push_back( digits[byte & 0x0F] );
+            }
+            return hex;
+        }
+
+        /** Whether a string is a content hash as written by ToHex, so it is safe to use as a file name
+        */
+        bool IsContentHash( const std::string &hash )
+        {
+            return hash.size() == 64 && hash.find_first_not_of( "0123456789abcdef" ) == std::string::npos;
+        }
+
+        /** Get a temporary name next to a file, distinct per writer so processes sharing the cache
+        * directory never write into each other's temporary file
+        */
+        std::filesystem::path TemporaryPathFor( const std::filesystem::path &path )
+        {
+            thread_local std::mt19937_64 random( std::random_device{}() );
+            std::ostringstream           name;
+            name << path.filename().string() << "." << std::hex << random() << ".tmp";
+            return path.parent_path() / name.str();
+        }
+    }
+
+    FetchCache::FetchCache( std::filesystem::path directory, uint64_t maxBytes ) :
+        directory_( std::move( directory ) ), maxBytes_( maxBytes )
+    {
+        std::error_code error;
+        std::filesystem::create_directories( directory_, error );
+        if ( error )
+        {
+            m_logger->error( "Cannot create fetch cache directory {}: {}", directory_.string(), error.message() );
+            return;
+        }
+        LoadIndex();
+    }
+
+    FetchCache::~FetchCache()
+    {
+        Flush();
+    }
+
+    std::shared_ptr<MappedFile> FetchCache::Find( const std::string &uri )
+    {
+        std::string          hash;
+        uint64_t             size = 0;
+        std::optional<Stamp> verified;
+        {
+            std::lock_guard<std::mutex> lock( mutex_ );
+            auto                        it = entries_.find( uri );
+            if ( it == entries_.end() )
+            {
+                return nullptr;
+            }
+            hash     = it->second.hash;
+            size     = it->second.size;
+            verified = files_.at( hash ).verified;
+        }
+
+        // Stamp before hashing, so a write during the check shows up as a change on the next hit
+        const auto path    = PathFor( hash );
+        const auto stamp   = StampOf( path );
+        auto       mapping = MappedFile::Open( path.string() );
+        bool       intact  = stamp && mapping && mapping->GetData().size() == size;
+        if ( intact && verified != stamp )
+        {
+            // Hash outside the lock, other jobs keep using the cache meanwhile
+            intact = ToHex( sgprocmanagersha::sha256( mapping->GetData().data(), size ) ) == hash;
+        }
+
+        std::lock_guard<std::mutex> lock( mutex_ );
+        if ( !intact )
+        {
+            // Removed, truncated or corrupted behind our back, drop every URI sharing the file
+            m_logger->warn( "Dropping stale fetch cache entry for {}", uri );
+            std::vector<std::string> stale;
+            for ( const auto &[otherUri, entry] : entries_ )
+            {
+                if ( entry.hash == hash )
+                {
+                    stale.push_back( otherUri );
+                }
+            }
+            for ( const auto &staleUri : stale )
+            {
+                Remove( staleUri );
+            }
+            std::error_code error;
+            std::filesystem::remove( PathFor( hash ), error );
+            return nullptr;
+        }
+
+        auto file = files_.find( hash );
+        if ( file != files_.end() )
+        {
+            file->second.verified = stamp;
+        }
+        auto it = entries_.find( uri );
+        if ( it != entries_.end() && it->second.hash == hash )
+        {
+            Touch( it->second );
+        }
+        return mapping;
+    }
+
+    bool FetchCache::Store( const std::string &uri, gsl::span<const char> data )
+    {
+        if ( data.empty() || data.size() > maxBytes_ )
+        {
+            return false;
+        }
+
+        const std::string hash = ToHex( sgprocmanagersha::sha256( data.data(), data.size() ) );
+        const auto        path = PathFor( hash );
+        std::error_code   error;
+
+        // Write outside the lock, models are large and other jobs keep using the cache meanwhile.
+        // A temporary name keeps a crash from leaving a partial file behind a valid hash.
+        std::filesystem::path temporary;
+        if ( !std::filesystem::exists( path, error ) )
+        {
+            temporary = TemporaryPathFor( path );
+            std::ofstream out( temporary, std::ios::binary | std::ios::trunc );
+            out.write( data.data(), static_cast<std::streamsize>( data.size() ) );
+            out.close();
+            if ( !out )
+            {
+                m_logger->error( "Failed to write fetch cache file {}", temporary.string() );
+                std::filesystem::remove( temporary, error );
+                return false;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock( mutex_ );
+        if ( !temporary.empty() )
+        {
+            // Another writer may have stored the same content meanwhile, replacing it is harmless
+            std::filesystem::rename( temporary, path, error );
+            if ( error )
+            {
+                m_logger->error( "Failed to add {} to fetch cache: {}", uri, error.message() );
+                std::filesystem::remove( temporary, error );
+                return false;
+            }
+        }
+        else if ( !std::filesystem::exists( path, error ) )
+        {
+            // Evicted between the check and the lock, the next fetch stores it again
+            return false;
+        }
+
+        auto previous = entries_.find( uri );
+        if ( previous != entries_.end() && previous->second.hash == hash )
+        {
+            Touch( previous->second );
+        }
+        else
+        {
+            Remove( uri );
+            Add( uri, hash, static_cast<uint64_t>( data.size() ), ++useClock_ );
+        }
+        Evict();
+        m_logger->info( "Cached {} as {} ({} bytes)", uri, hash, data.size() );
+        return true;
+    }
+
+    void FetchCache::Flush()
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        if ( dirty_ )
+        {
+            SaveIndex();
+        }
+    }
+
+    uint64_t FetchCache::GetSize() const
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        return totalSize_;
+    }
+
+    void FetchCache::LoadIndex()
+    {
+        std::unordered_map<std::string, Entry> indexed;
+        std::ifstream                          in( directory_ / INDEX_FILE_NAME );
+        std::string                            line;
+        while ( std::getline( in, line ) )
+        {
+            // <hash> <size> <lastUse> <uri>
+            std::istringstream fields( line );
+            Entry              entry;
+            std::string        uri;
+            if ( !( fields >> entry.hash >> entry.size >> entry.lastUse ) )
+            {
+                continue;
+            }
+            if ( !IsContentHash( entry.hash ) )
+            {
+                // The hash becomes a path inside the cache directory, never trust anything else
+                m_logger->warn( "Ignoring fetch cache index entry with invalid hash {}", entry.hash );
+                continue;
+            }
+            fields >> std::ws;
+            std::getline( fields, uri );
+            if ( uri.empty() )
+            {
+                continue;
+            }
+            indexed[uri] = entry;
+        }
+
+        // Oldest first, so the most recently used entry ends up at the front of the LRU list
+        std::vector<std::pair<std::string, Entry>> loaded( indexed.begin(), indexed.end() );
+        std::sort( loaded.begin(),
+                   loaded.end(),
+                   []( const auto &lhs, const auto &rhs ) { return lhs.second.lastUse < rhs.second.lastUse; } );
+        for ( const auto &[uri, entry] : loaded )
+        {
+            Add( uri, entry.hash, entry.size, entry.lastUse );
+            useClock_ = std::max( useClock_, entry.lastUse );
+        }
+        dirty_ = false;
+        m_logger->info( "Fetch cache {} holds {} entries ({} bytes)", directory_.string(), entries_.size(), totalSize_ );
+    }
+
+    void FetchCache::SaveIndex()
+    {
+        const auto      path      = directory_ / INDEX_FILE_NAME;
+        const auto      temporary = TemporaryPathFor( path );
+        std::error_code error;
+        {
+            std::ofstream out( temporary, std::ios::trunc );
+            for ( auto it = recent_.rbegin(); it != recent_.rend(); ++it )
+            {
+                const auto &entry = entries_.at( *it );
+                out << entry.hash << " " << entry.size << " " << entry.lastUse << " " << *it << "\n";
+            }
+            out.close();
+            if ( !out )
+            {
+                m_logger->error( "Failed to write fetch cache index {}", temporary.string() );
+                std::filesystem::remove( temporary, error );
+                return;
+            }
+        }
+        std::filesystem::rename( temporary, path, error );
+        if ( error )
+        {
+            m_logger->error( "Failed to replace fetch cache index: {}", error.message() );
+            std::filesystem::remove( temporary, error );
+            return;
+        }
+        dirty_ = false;
+    }
+
+    void FetchCache::Add( const std::string &uri, const std::string &hash, uint64_t size, uint64_t lastUse )
+    {
+        recent_.push_front( uri );
+        entries_[uri] = Entry{ hash, size, lastUse, recent_.begin() };
+
+        // Shared content is only stored, and counted, once
+        auto &file = files_.try_emplace( hash, File{ size, 0, std::nullopt } ).first->second;
+        if ( file.references++ == 0 )
+        {
+            totalSize_ += size;
+        }
+        dirty_ = true;
+    }
+
+    void FetchCache::Touch( Entry &entry )
+    {
+        entry.lastUse = ++useClock_;
+        recent_.splice( recent_.begin(), recent_, entry.recent );
+        dirty_ = true;
+    }
+
+    void FetchCache::Evict()
+    {
+        while ( !recent_.empty() && totalSize_ > maxBytes_ )
+        {
+            const std::string oldest = recent_.back();
+            m_logger->info( "Evicting {} from fetch cache", oldest );
+            Remove( oldest );
+        }
+    }
+
+    void FetchCache::Remove( const std::string &uri )
+    {
+        auto it = entries_.find( uri );
+        if ( it == entries_.end() )
+        {
+            return;
+        }
+        const std::string hash = it->second.hash;
+        recent_.erase( it->second.recent );
+        entries_.erase( it );
+        dirty_ = true;
+
+        // Several URIs can point at the same content, only delete the file with its last reference
+        auto file = files_.find( hash );
+        if ( file == files_.end() || --file->second.references > 0 )
+        {
+            return;
+        }
+        totalSize_ -= file->second.size;
+        files_.erase( file );
+        std::error_code error;
+        std::filesystem::remove( PathFor( hash ), error );
+    }
+
+    std::filesystem::path FetchCache::PathFor( const std::string &hash ) const
+    {
+        return directory_ / hash;
+    }
+
+    std::optional<FetchCache::Stamp> FetchCache::StampOf( const std::filesystem::path &path )
+    {
+        std::error_code error;
+        const auto      size     = std::filesystem::file_size( path, error );
+        const auto      modified = error ? std::filesystem::file_time_type() :
+                                           std::filesystem::last_write_time( path, error );
+        if ( error )
+        {
+            return std::nullopt;
+        }
+        return Stamp{ static_cast<uint64_t>( size ), modified };
+    }
+}
@@ -0,0 +1,143 @@
+#include <processingbase/OutputSaver.hpp>
+#include <boost/asio/post.hpp>
+#include "FileManager.hpp"
+
+namespace sgns::sgprocessing
+{
+    namespace
+    {
+        const sgns::sgprocmanager::Logger &GetLogger()
+        {
+            static const auto logger = sgns::sgprocmanager::createLogger( "OutputSaver" );
+            return logger;
+        }
+    }
+
+    OutputSaver::OutputSaver( std::chrono::milliseconds shutdownTimeout, SaveFunction save ) :
+        shutdownTimeout_( shutdownTimeout ),
+        save_( save ? std::move( save ) : SaveFunction( &OutputSaver::SaveWithFileManager ) ),
+        state_( std::make_shared<State>() ),
+        ioc_( std::make_shared<boost::asio::io_context>() ),
+        workGuard_( boost::asio::make_work_guard( *ioc_ ) ),
+        thread_( [ioc = ioc_] { ioc->run(); } )
+    {
+    }
+
+    OutputSaver::~OutputSaver()
+    {
+        // A save whose completion never arrives must not hang the node on shutdown
+        if ( !WaitIdle( shutdownTimeout_ ) )
+        {
+            m_logger->error( "{} output saves did not finish within {} ms, cancelling them",
+                             GetPendingCount(),
+                             shutdownTimeout_.count() );
+            ioc_->stop();
+        }
+        workGuard_.reset();
+        if ( thread_.joinable() )
+        {
+            thread_.join();
+        }
+
+        // Late completions find their job gone from the set and leave its future alone
+        std::lock_guard<std::mutex> lock( state_->mutex );
+        for ( const auto &job : state_->jobs )
+        {
+            job->saved.set_value( false );
+        }
+        state_->jobs.clear();
+    }
+
+    std::mutex &OutputSaver::GetFileManagerMutex()
+    {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    std::shared_future<bool> OutputSaver::SaveAll( std::vector<std::pair<std::string, SaveBuffers>> saves,
+                                                   bool                                             succeeded )
+    {
+        auto job       = std::make_shared<Job>();
+        job->remaining = saves.size();
+        job->succeeded = succeeded;
+        auto saved     = job->saved.get_future().share();
+        if ( saves.empty() )
+        {
+            job->saved.set_value( succeeded );
+            return saved;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock( state_->mutex );
+            state_->pending += saves.size();
+            state_->jobs.insert( job );
+        }
+        for ( auto &save : saves )
+        {
+            // The save is started from the io thread, so its whole save runs there
+            boost::asio::post( *ioc_,
+                               [save = save_,
+                                state = state_,
+                                ioc = ioc_,
+                                job,
+                                url     = std::move( save.first ),
+                                buffers = std::move( save.second )]
+                               { save( url, buffers, ioc, [state, job]( bool saved ) { OnSaved( state, job, saved ); } ); } );
+        }
+        return saved;
+    }
+
+    void OutputSaver::WaitIdle()
+    {
+        std::unique_lock<std::mutex> lock( state_->mutex );
+        state_->idle.wait( lock, [this] { return state_->pending == 0; } );
+    }
+
+    bool OutputSaver::WaitIdle( std::chrono::milliseconds timeout )
+    {
+        std::unique_lock<std::mutex> lock( state_->mutex );
+        return state_->idle.wait_for( lock, timeout, [this] { return state_->pending == 0; } );
+    }
+
+    size_t OutputSaver::GetPendingCount() const
+    {
+        std::lock_guard<std::mutex> lock( state_->mutex );
+        return state_->pending;
+    }
+
+    void OutputSaver::OnSaved( const std::shared_ptr<State> &state, const std::shared_ptr<Job> &job, bool succeeded )
+    {
+        // Everything happens under the lock, so a waiter never sees the count drop before the job's
+        // future is ready, and the notify cannot race the waiter's destruction
+        std::lock_guard<std::mutex> lock( state->mutex );
+        job->succeeded = job->succeeded && succeeded;
+        // A job failed by the destructor is no longer tracked and must not be completed twice
+        if ( --job->remaining == 0 && state->jobs.erase( job ) == 1 )
+        {
+            job->saved.set_value( job->succeeded );
+        }
+        --state->pending;
+        state->idle.notify_all();
+    }
+
+    void OutputSaver::SaveWithFileManager( const std::string                              &url,
+                                           SaveBuffers                                     buffers,
+                                           const std::shared_ptr<boost::asio::io_context> &ioc,
+                                           std::function<void( bool )>                     done )
+    {
+        std::lock_guard<std::mutex> lock( GetFileManagerMutex() );
+        FileManager::GetInstance().SaveASync( url,
+                                              outcome::success( buffers ),
+                                              ioc,
+                                              [url, done = std::move( done )]( const FileManager::ResultType &result )
+                                              {
+                                                  if ( !result )
+                                                  {
+                                                      GetLogger()->error( "Failed to save output to {}: {}",
+                                                                          url,
+                                                                          result.error().message() );
+                                                  }
+                                                  done( static_cast<bool>( result ) );
+                                              } );
+    }
+}
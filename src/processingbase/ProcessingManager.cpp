@@ -3,6 +3,9 @@
 #include <datasplitter/ImageSplitter.hpp>
 #include "FileManager.hpp"
 #include "URLStringUtil.h"
+#include "processors/processing_parameters.hpp"
+#include "util/sha256.hpp"
+#include <future>
 
 
 OUTCOME_CPP_DEFINE_CATEGORY_3( sgns::sgprocessing, ProcessingManager::Error, e )
@@ -29,6 +32,13 @@ namespace sgns::sgprocessing
 {
     namespace
     {
+        std::shared_future<bool> MakeReadyFuture( bool value )
+        {
+            std::promise<bool> promise;
+            promise.set_value( value );
+            return promise.get_future().share();
+        }
+
         bool IsUrl( const std::string &value )
         {
             return value.find( "://" ) != std::string::npos;
@@ -55,6 +65,116 @@ namespace sgns::sgprocessing
             }
             return !extension.empty();
         }
+
+        /** Decode the %XX escapes of a URL path
+        * @return false on a truncated or non hex escape, or one that decodes to a NUL byte
+        */
+        bool PercentDecode( const std::string &encoded, std::string &decoded )
+        {
+            auto hexValue = []( char c ) -> int
+            {
+                if ( c >= '0' && c <= '9' )
+                {
+                    return c - '0';
+                }
+                if ( c >= 'a' && c <= 'f' )
+                {
+                    return c - 'a' + 10;
+                }
+                if ( c >= 'A' && c <= 'F' )
+                {
+                    return c - 'A' + 10;
+                }
+                return -1;
+            };
+
+            decoded.clear();
+            decoded.reserve( encoded.size() );
+            for ( size_t i = 0; i < encoded.size(); ++i )
+            {
+                if ( encoded[i] != '%' )
+                {
+                    decoded.push_back( encoded[i] );
+                    continue;
+                }
+                if ( i + 2 >= encoded.size() )
+                {
+                    return false;
+                }
+                const int high = hexValue( encoded[i + 1] );
+                const int low  = hexValue( encoded[i + 2] );
+                if ( high < 0 || low < 0 || ( high == 0 && low == 0 ) )
+                {
+                    return false;
+                }
+                decoded.push_back( static_cast<char>( high * 16 + low ) );
+                i += 2;
+            }
+            return true;
+        }
+
+        bool IsFileUrl( const std::string &url )
+        {
+            const std::string scheme = "file://";
+            return url.compare( 0, scheme.size(), scheme ) == 0;
+        }
+
+        /** Get the local path of a file:// URL, with its escapes decoded
+        * @return Path, empty for any other scheme or a malformed file URL
+        */
+        std::string LocalFilePath( const std::string &url )
+        {
+            if ( !IsFileUrl( url ) )
+            {
+                return {};
+            }
+            std::string encoded = url.substr( std::string( "file://" ).size() );
+            // file://localhost/dir/file names the same file as file:///dir/file
+            const std::string localhost = "localhost/";
+            if ( encoded.compare( 0, localhost.size(), localhost ) == 0 )
+            {
+                encoded.erase( 0, localhost.size() - 1 );
+            }
+            std::string path;
+            if ( !PercentDecode( encoded, path ) )
+            {
+                return {};
+            }
+#if defined( _WIN32 )
+            // file:///C:/dir/file
+            if ( path.size() > 2 && path[0] == '/' && path[2] == ':' )
+            {
+                path.erase( 0, 1 );
+            }
+#endif
+            return path;
+        }
+
+        /** Put the spool file of a streamed output at a local destination
+        * @param spool - File the output was streamed to
+        * @param destination - Local path of the output, empty if the URL was malformed
+        * @param move - Rename the spool file instead of copying it, for the last save of the output
+        */
+        bool SaveStreamedFile( const std::filesystem::path &spool, const std::string &destination, bool move )
+        {
+            if ( destination.empty() )
+            {
+                return false;
+            }
+            std::error_code error;
+            if ( move )
+            {
+                std::filesystem::rename( spool, destination, error );
+                if ( !error )
+                {
+                    return true;
+                }
+                // Renaming fails across file systems, copying does not
+                error.clear();
+            }
+            std::filesystem::copy_file( spool, destination, std::filesystem::copy_options::overwrite_existing, error );
+            return !error;
+        }
     }
 
     ProcessingManager::~ProcessingManager() {}
@@ -649,6 +769,8 @@ namespace sgns::sgprocessing
                                                                       std::vector<std::vector<uint8_t>> &chunkhashes,
                                                                       sgns::ModelNode                    &model )
     {
+        m_outputsSaved = MakeReadyFuture( true );
+
         //Get input index
         auto modelname = model.get_source().value();
         auto index     = GetInputIndex( modelname );
@@ -656,110 +778,213 @@ namespace sgns::sgprocessing
         {
             return outcome::failure( Error::MISSING_INPUT );
         }
+        // Processor is needed before loading so it can parse the model while the input downloads
+        if (!SetProcessorByName(static_cast<int>(processing_.get_inputs()[index.value()].get_type())))
+        {
+            return outcome::failure( Error::NO_PROCESSOR );
+        }
         auto maybe_buffers = GetCidForProc( ioc, model );
         if (!maybe_buffers)
         {
             return maybe_buffers.error();
         }
         auto buffers = maybe_buffers.value();
-        if (!SetProcessorByName(static_cast<int>(processing_.get_inputs()[index.value()].get_type())))
-        {
-            return outcome::failure( Error::NO_PROCESSOR );
-        }
         const auto maybeParameters = processing_.get_parameters();
         const auto *parameters = maybeParameters ? &maybeParameters.value() : nullptr;
 
+        const auto modelConfig = processing_.get_passes()[index.value()].get_model();
+        m_processor->SetBatchSize( modelConfig && modelConfig->get_batch_size()
+                                       ? static_cast<int>( modelConfig->get_batch_size().value() )
+                                       : 1 );
+        m_processor->SetStreamDirectory( CanStreamOutputs( parameters ) ? m_streamDirectory : std::filesystem::path() );
+        const auto &input = buffers->second.progressive;
+        m_processor->SetProgressiveInput( input );
+
         auto processResult = m_processor->StartProcessing( chunkhashes,
                                    processing_.get_inputs()[index.value()],
-                                   *buffers->second,
-                                   *buffers->first,
+                                   buffers->second.GetData(),
+                                   buffers->first.GetData(),
                                    parameters );
+        m_processor->SetProgressiveInput( nullptr );
+
+        if ( input )
+        {
+            // Windows past a failure read nothing, so the result of an input that did not fully arrive is discarded
+            const auto inputUrl = processing_.get_inputs()[index.value()].get_source_uri_param();
+            if ( !input->WaitFor( input->GetData().size() ) )
+            {
+                m_logger->error( "Progressive load of {} failed during processing", inputUrl );
+                return outcome::failure( Error::INPUT_UNAVAIL );
+            }
+            if ( m_fetchCache )
+            {
+                m_fetchCache->Store( inputUrl, input->GetData() );
+                m_fetchCache->Flush();
+            }
+        }
+
+        SaveOutputs( ioc, processResult.outputs );
+
+        return processResult.hash;
+    }
+
+    bool ProcessingManager::CanStreamOutputs( const std::vector<sgns::Parameter> *parameters )
+    {
+        if ( m_streamDirectory.empty() || ProcessingParameters::GetInt( parameters, "streamOutput", 0 ) != 1 )
+        {
+            return !m_streamDirectory.empty();
+        }
+        // A spool file can only be moved into place, uploading it would need the whole output in memory again
+        for ( const auto &output : processing_.get_outputs() )
+        {
+            const auto &outputUrl = output.get_source_uri_param();
+            if ( !outputUrl.empty() && IsUrl( outputUrl ) && !IsFileUrl( outputUrl ) )
+            {
+                m_logger->warn( "streamOutput needs file:// outputs but {} is not one, keeping output in memory",
+                                outputUrl );
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void ProcessingManager::SaveOutputs( std::shared_ptr<boost::asio::io_context> ioc,
+                                         std::vector<OutputBuffer>               &resultBuffers )
+    {
+        m_outputsSaved = MakeReadyFuture( true );
 
         const auto &outputs = processing_.get_outputs();
-        if ( processResult.output_buffers && !outputs.empty() )
+        if ( !resultBuffers.empty() && !outputs.empty() )
         {
-            const auto &bufferNames = processResult.output_buffers->first;
-            const auto &bufferData = processResult.output_buffers->second;
+            struct PendingSave
+            {
+                std::string url;
+                std::string fileName;
+                size_t      dataIndex;
+            };
+            std::vector<PendingSave> pendingSaves;
+            std::vector<size_t>      savesPerBuffer( resultBuffers.size(), 0 );
 
-            if ( !bufferData.empty() )
+            for ( size_t outputIndex = 0; outputIndex < outputs.size(); ++outputIndex )
             {
-                FileManager::GetInstance().InitializeSingletons();
-                bool hasSaves = false;
+                const auto &output = outputs[outputIndex];
+                const auto &outputUrl = output.get_source_uri_param();
+                if ( outputUrl.empty() )
+                {
+                    continue;
+                }
+                if ( !IsUrl( outputUrl ) )
+                {
+                    m_logger->warn( "Output source_uri_param '{}' is not a URL; skipping save", outputUrl );
+                    continue;
+                }
+
+                const size_t dataIndex = ( resultBuffers.size() == outputs.size() ) ? outputIndex : 0;
+                if ( dataIndex >= resultBuffers.size() || resultBuffers[dataIndex].Empty() )
+                {
+                    continue;
+                }
 
-                for ( size_t outputIndex = 0; outputIndex < outputs.size(); ++outputIndex )
+                std::string outputFileName;
+                if ( !UrlHasExtension( outputUrl ) )
                 {
-                    const auto &output = outputs[outputIndex];
-                    const auto &outputUrl = output.get_source_uri_param();
-                    if ( outputUrl.empty() )
+                    std::string baseName = resultBuffers[dataIndex].GetName();
+                    if ( baseName.empty() )
                     {
-                        continue;
+                        baseName = output.get_name() + ".raw";
                     }
-                    if ( !IsUrl( outputUrl ) )
+
+                    if ( EndsWithSlash( outputUrl ) )
                     {
-                        m_logger->warn( "Output source_uri_param '{}' is not a URL; skipping save", outputUrl );
-                        continue;
+                        outputFileName = baseName;
                     }
-
-                    const size_t dataIndex = ( bufferData.size() == outputs.size() ) ? outputIndex : 0;
-                    if ( dataIndex >= bufferData.size() )
+                    else
                     {
-                        continue;
+                        outputFileName = "/" + baseName;
                     }
+                }
 
-                    const size_t nameIndex = ( bufferNames.size() == outputs.size() ) ? outputIndex : 0;
-                    std::string outputFileName;
-                    if ( !UrlHasExtension( outputUrl ) )
-                    {
-                        std::string baseName;
-                        if ( nameIndex < bufferNames.size() && !bufferNames[nameIndex].empty() )
-                        {
-                            baseName = bufferNames[nameIndex];
-                        }
-                        else
-                        {
-                            baseName = output.get_name() + ".raw";
-                        }
+                pendingSaves.push_back( { outputUrl, std::move( outputFileName ), dataIndex } );
+                ++savesPerBuffer[dataIndex];
+            }
 
-                        if ( EndsWithSlash( outputUrl ) )
-                        {
-                            outputFileName = baseName;
-                        }
-                        else
-                        {
-                            outputFileName = "/" + baseName;
-                        }
+            if ( !pendingSaves.empty() )
+            {
+                std::lock_guard<std::mutex> fileManagerLock( OutputSaver::GetFileManagerMutex() );
+                FileManager::GetInstance().InitializeSingletons();
+            }
+
+            std::vector<std::pair<std::string, OutputSaver::SaveBuffers>> saves;
+            saves.reserve( pendingSaves.size() );
+            bool localSaved = true;
+            for ( auto &save : pendingSaves )
+            {
+                // The last save of a buffer takes its bytes over, only outputs sharing one buffer copy it
+                auto      &buffer   = resultBuffers[save.dataIndex];
+                const bool lastSave = --savesPerBuffer[save.dataIndex] == 0;
+                if ( !buffer.GetFile().empty() )
+                {
+                    // A streamed output is moved or copied into place, it is never loaded back into memory
+                    if ( !IsFileUrl( save.url ) )
+                    {
+                        m_logger->error( "Streamed output cannot be saved to {}, only file:// outputs can be streamed",
+                                         save.url );
+                        localSaved = false;
+                    }
+                    else if ( !SaveStreamedFile( buffer.GetFile(), LocalFilePath( save.url + save.fileName ), lastSave ) )
+                    {
+                        m_logger->error( "Failed to save output to {}", save.url + save.fileName );
+                        localSaved = false;
                     }
+                    continue;
+                }
 
-                    auto saveBuffers = std::make_shared<std::pair<std::vector<std::string>, std::vector<std::vector<char>>>>();
-                    saveBuffers->first.push_back( outputFileName );
-                    saveBuffers->second.push_back( bufferData[dataIndex] );
+                auto saveBuffers =
+                    std::make_shared<std::pair<std::vector<std::string>, std::vector<std::vector<char>>>>();
+                saveBuffers->first.push_back( std::move( save.fileName ) );
+                if ( lastSave )
+                {
+                    saveBuffers->second.push_back( buffer.ReleaseBytes() );
+                }
+                else
+                {
+                    const auto bytes = buffer.GetBytes();
+                    saveBuffers->second.emplace_back( bytes.begin(), bytes.end() );
+                }
+                saves.emplace_back( std::move( save.url ), std::move( saveBuffers ) );
+            }
 
+            if ( m_outputSaver )
+            {
+                // Local moves already finished, their outcome joins the result of the queued saves
+                m_outputsSaved = m_outputSaver->SaveAll( std::move( saves ), localSaved );
+            }
+            else if ( !saves.empty() || !localSaved )
+            {
+                auto allSaved = std::make_shared<bool>( localSaved );
+                for ( auto &save : saves )
+                {
+                    std::lock_guard<std::mutex> fileManagerLock( OutputSaver::GetFileManagerMutex() );
                     FileManager::GetInstance().SaveASync(
-                        outputUrl,
-                        outcome::success( saveBuffers ),
+                        save.first,
+                        outcome::success( save.second ),
                         ioc,
-                        [this, outputUrl]( const FileManager::ResultType &result ) {
+                        [this, allSaved, outputUrl = save.first]( const FileManager::ResultType &result ) {
                             if ( !result )
                             {
                                 m_logger->error( "Failed to save output to {}: {}", outputUrl, result.error().message() );
+                                *allSaved = false;
                             }
                         } );
-                    hasSaves = true;
-                }
-
-                if ( hasSaves )
-                {
-                    ioc->reset();
-                    ioc->run();
                 }
+                ioc->reset();
+                ioc->run();
+                m_outputsSaved = MakeReadyFuture( *allSaved );
             }
         }
-
-        return processResult.hash;
     }
 
-    outcome::result <
-        std::shared_ptr<std::pair<std::shared_ptr<std::vector<char>>, std::shared_ptr<std::vector<char>>>>>
+    outcome::result<std::shared_ptr<std::pair<SourceBuffer, SourceBuffer>>>
     ProcessingManager::GetCidForProc( std::shared_ptr<boost::asio::io_context> ioc, sgns::ModelNode &model )
     {
         auto modelname = model.get_source().value();
@@ -771,34 +996,110 @@ namespace sgns::sgprocessing
         boost::asio::io_context::executor_type                                   executor = ioc->get_executor();
         boost::asio::executor_work_guard<boost::asio::io_context::executor_type> workGuard( executor );
 
-        auto mainbuffers =
-            std::make_shared<std::pair<std::shared_ptr<std::vector<char>>, std::shared_ptr<std::vector<char>>>>(
-                std::make_shared<std::vector<char>>(),
-                std::make_shared<std::vector<char>>() );
+        auto mainbuffers = std::make_shared<std::pair<SourceBuffer, SourceBuffer>>();
 
         std::string modelFile = processing_.get_passes()[index.value()].get_model().value().get_source_uri_param();
 
         std::string image = processing_.get_inputs()[index.value()].get_source_uri_param();
         m_logger->info( "Model Input URL: {}", modelFile );
         m_logger->info( "Data Input URL: {}", image );
-        //Init Loaders
-        FileManager::GetInstance().InitializeSingletons();
-        //Get Model
-        string modelURL = modelFile;
-        GetSubCidForProc( ioc, modelURL, mainbuffers->first );
+        for ( const auto &url : { modelFile, image } )
+        {
+            if ( IsFileUrl( url ) && LocalFilePath( url ).empty() )
+            {
+                m_logger->error( "Malformed file URL {}", url );
+                return outcome::failure( Error::INPUT_UNAVAIL );
+            }
+        }
+        // Let the processor parse the model on its own thread while the input is still loading.
+        // The model is hashed once here, PrepareModel and StartProcessing both reuse the digest.
+        if ( m_processor )
+        {
+            m_processor->SetModelDigest( {} );
+        }
+        std::future<void> modelPrepared;
+        auto              prepareModel = [this, &modelPrepared]( gsl::span<const char> modelData )
+        {
+            if ( m_processor && !modelData.empty() )
+            {
+                modelPrepared = std::async( std::launch::async,
+                                            [processor = m_processor.get(), modelData]
+                                            {
+                                                processor->SetModelDigest(
+                                                    sgprocmanagersha::sha256( modelData.data(), modelData.size() ) );
+                                                processor->PrepareModel( modelData );
+                                            } );
+            }
+        };
+
+        //Local and cached files are mapped in place, only the rest goes through the loaders
+        const bool modelMapped = MapSource( modelFile, mainbuffers->first );
+        if ( modelMapped )
+        {
+            prepareModel( mainbuffers->first.GetData() );
+        }
+        const bool imageMapped = MapSource( image, mainbuffers->second );
+        // A progressively loaded input is still arriving when this returns, processing starts on its first windows
+        const bool imageProgressive = !imageMapped && StartProgressiveLoad( image, mainbuffers->second );
+        const bool imageLoaded      = imageMapped || imageProgressive;
+        if ( !modelMapped || !imageLoaded )
+        {
+            //Init Loaders
+            {
+                // The output saver may be calling into FileManager from its own thread
+                std::lock_guard<std::mutex> fileManagerLock( OutputSaver::GetFileManagerMutex() );
+                FileManager::GetInstance().InitializeSingletons();
+            }
+            //Get Model
+            if ( !modelMapped )
+            {
+                mainbuffers->first.buffer = std::make_shared<std::vector<char>>();
+                GetSubCidForProc( ioc,
+                                  modelFile,
+                                  mainbuffers->first.buffer,
+                                  [&prepareModel, mainbuffers]() { prepareModel( mainbuffers->first.GetData() ); } );
+            }
+
+            if ( !imageLoaded )
+            {
+                mainbuffers->second.buffer = std::make_shared<std::vector<char>>();
+                GetSubCidForProc( ioc, image, mainbuffers->second.buffer );
+            }
+
+            //Run IO
+            ioc->reset();
+            ioc->run();
 
-        string imageUrl = image;
-        GetSubCidForProc( ioc, imageUrl, mainbuffers->second );
+            if ( m_fetchCache )
+            {
+                if ( !modelMapped )
+                {
+                    m_fetchCache->Store( modelFile, mainbuffers->first.GetData() );
+                }
+                if ( !imageLoaded )
+                {
+                    m_fetchCache->Store( image, mainbuffers->second.GetData() );
+                }
+            }
+        }
+        if ( m_fetchCache )
+        {
+            m_fetchCache->Flush();
+        }
 
-        //Run IO
-        ioc->reset();
-        ioc->run();
+        if ( modelPrepared.valid() )
+        {
+            modelPrepared.wait();
+        }
 
-        if ( mainbuffers == nullptr )
+        // Processing needs the input size up front, the progressive loader reports it before the first bytes
+        if ( imageProgressive && !mainbuffers->second.progressive->WaitForSize() )
         {
+            m_logger->error( "Progressive load of {} failed", image );
             return outcome::failure( Error::INPUT_UNAVAIL );
         }
-        if ( mainbuffers->first->size() <= 0 || mainbuffers->second->size() <= 0 )
+
+        if ( mainbuffers->first.GetData().empty() || mainbuffers->second.GetData().empty() )
         {
             return outcome::failure( Error::INPUT_UNAVAIL );
         }
@@ -821,24 +1122,81 @@ namespace sgns::sgprocessing
         return outcome::failure( Error::MISSING_INPUT );
     }
 
+    bool ProcessingManager::MapSource( const std::string &url, SourceBuffer &source )
+    {
+        const std::string path = LocalFilePath( url );
+        if ( !path.empty() )
+        {
+            auto mapping = MappedFile::Open( path );
+            if ( mapping )
+            {
+                m_logger->info( "Mapped {} ({} bytes)", path, mapping->GetData().size() );
+                source.mapping = std::move( mapping );
+                return true;
+            }
+            m_logger->warn( "Could not map {}, falling back to loader", path );
+        }
+
+        if ( m_fetchCache )
+        {
+            auto mapping = m_fetchCache->Find( url );
+            if ( mapping )
+            {
+                m_logger->info( "Using cached {} ({} bytes)", url, mapping->GetData().size() );
+                source.mapping = std::move( mapping );
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool ProcessingManager::StartProgressiveLoad( const std::string &url, SourceBuffer &source )
+    {
+        if ( !m_progressiveLoader || !m_processor || !m_processor->ReadsInputProgressively() )
+        {
+            return false;
+        }
+        auto input = std::make_shared<ProgressiveInput>();
+        if ( !m_progressiveLoader( url, input ) )
+        {
+            return false;
+        }
+        m_logger->info( "Loading {} progressively", url );
+        source.progressive = std::move( input );
+        return true;
+    }
+
     void ProcessingManager::GetSubCidForProc( std::shared_ptr<boost::asio::io_context> ioc,
                                                std::string                              url,
-                                               std::shared_ptr<std::vector<char>>       results )
+                                               std::shared_ptr<std::vector<char>>       results,
+                                               std::function<void()>                    onLoaded )
     {
-        auto modeldata = FileManager::GetInstance().LoadASync(
+        std::lock_guard<std::mutex> fileManagerLock( OutputSaver::GetFileManagerMutex() );
+        auto                        modeldata = FileManager::GetInstance().LoadASync(
             url,
             false,
             false,
             ioc,
-            [this, results]( outcome::result<std::shared_ptr<std::pair<std::vector<std::string>, std::vector<std::vector<char>>>>> buffers )
+            [this, results, onLoaded]( outcome::result<std::shared_ptr<std::pair<std::vector<std::string>, std::vector<std::vector<char>>>>> buffers )
             {
                 if (buffers)
                 {
-                    if ( results )
+                    if ( results && !buffers.value()->second.empty() )
+                    {
+                        // Take over the loader's buffer instead of copying it, models can be hundreds of MB
+                        auto &loaded = buffers.value()->second[0];
+                        if ( results->empty() )
+                        {
+                            *results = std::move( loaded );
+                        }
+                        else
+                        {
+                            results->insert( results->end(), loaded.begin(), loaded.end() );
+                        }
+                    }
+                    if ( onLoaded )
                     {
-                        results->insert( results->end(),
-                                         buffers.value()->second[0].begin(),
-                                         buffers.value()->second[0].end() );
+                        onLoaded();
                     }
                 }
                 else
@@ -0,0 +1,55 @@
+#include "processors/processing_chunk_throttle.hpp"
+
+#include <algorithm>
+#include <thread>
+#include "processors/processing_parameters.hpp"
+
+namespace sgns::sgprocessing
+{
+    ChunkThrottle::ChunkThrottle( float maxChunksPerSecond, float targetUtilization ) :
+        maxChunksPerSecond_( std::max( 0.0f, maxChunksPerSecond ) ),
+        targetUtilization_( ( targetUtilization > 0.0f && targetUtilization < 1.0f ) ? targetUtilization : 1.0f ),
+        chunkStart_( Clock::now() )
+    {
+    }
+
+    ChunkThrottle ChunkThrottle::FromParameters( const std::vector<sgns::Parameter> *parameters )
+    {
+        return ChunkThrottle( ProcessingParameters::GetFloat( parameters, "maxChunksPerSecond", 0.0f ),
+                              ProcessingParameters::GetFloat( parameters, "targetUtilization", 1.0f ) );
+    }
+
+    bool ChunkThrottle::IsEnabled() const
+    {
+        return maxChunksPerSecond_ > 0.0f || targetUtilization_ < 1.0f;
+    }
+
+    void ChunkThrottle::BeginChunk()
+    {
+        chunkStart_ = Clock::now();
+    }
+
+    void ChunkThrottle::EndChunk()
+    {
+        if ( !IsEnabled() )
+        {
+            return;
+        }
+
+        const double busySeconds = std::chrono::duration<double>( Clock::now() - chunkStart_ ).count();
+
+        // Idle long enough that busy time is targetUtilization of the chunk period,
+        // and the period is at least 1 / maxChunksPerSecond
+        double periodSeconds = busySeconds / static_cast<double>( targetUtilization_ );
+        if ( maxChunksPerSecond_ > 0.0f )
+        {
+            periodSeconds = std::max( periodSeconds, 1.0 / static_cast<double>( maxChunksPerSecond_ ) );
+        }
+
+        const double idleSeconds = periodSeconds - busySeconds;
+        if ( idleSeconds > 0.0 )
+        {
+            std::this_thread::sleep_for( std::chrono::duration<double>( idleSeconds ) );
+        }
+    }
+}
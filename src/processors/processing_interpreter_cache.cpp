@@ -0,0 +1,183 @@
+#include "processors/processing_interpreter_cache.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include "util/sha256.hpp"
+
+namespace sgns::sgprocessing
+{
+    namespace
+    {
+        std::string ToHex( const std::vector<uint8_t> &bytes )
+        {
+            static const char digits[] = "0123456789abcdef";
+            std::string       hex;
+            hex.reserve( bytes.size() * 2 );
+            for ( auto byte : bytes )
+            {
+                hex.push_back( digits[byte >> 4] );
+                hex.push_back( digits[byte & 0x0F] );
+            }
+            return hex;
+        }
+    }
+
+    CachedInterpreter::CachedInterpreter( std::string                       key,
+                                          std::unique_ptr<MNN::Interpreter> interpreter,
+                                          const MNN::ScheduleConfig        &config ) :
+        key_( std::move( key ) ),
+        interpreter_( std::move( interpreter ) ),
+        config_( config ),
+        sessionPool_( interpreter_.get(), config_, mutex_ )
+    {
+        // Keep our own copy of the backend config, the caller's one is usually a stack object
+        if ( config.backendConfig )
+        {
+            backendConfig_         = *config.backendConfig;
+            config_.backendConfig = &backendConfig_;
+        }
+    }
+
+    MNN::Interpreter *CachedInterpreter::Get() const
+    {
+        return interpreter_.get();
+    }
+
+    const std::string &CachedInterpreter::GetKey() const
+    {
+        return key_;
+    }
+
+    SessionLease CachedInterpreter::AcquireSession( const std::vector<int>              &shape,
+                                                    const SessionPool::PrepareFunction &prepare )
+    {
+        return sessionPool_.Acquire( shape, prepare );
+    }
+
+    std::mutex &CachedInterpreter::GetMutex()
+    {
+        return mutex_;
+    }
+
+    InterpreterCache &InterpreterCache::GetInstance()
+    {
+        static InterpreterCache instance;
+        return instance;
+    }
+
+    std::shared_ptr<CachedInterpreter> InterpreterCache::GetInterpreter( const void                 *modelData,
+                                                                         size_t                      modelSize,
+                                                                         const MNN::ScheduleConfig  &config,
+                                                                         const std::vector<uint8_t> &modelDigest )
+    {
+        if ( !modelData || modelSize == 0 )
+        {
+            m_logger->error( "Cannot create interpreter from empty model" );
+            return nullptr;
+        }
+
+        const std::string key =
+            ToHex( modelDigest.empty() ? sgprocmanagersha::sha256( modelData, modelSize ) : modelDigest ) + ":" +
+            BackendKey( config );
+
+        std::promise<std::shared_ptr<CachedInterpreter>> parsed;
+        InterpreterFuture                                known;
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            auto                        it = m_interpreters.find( key );
+            if ( it != m_interpreters.end() )
+            {
+                m_recent.splice( m_recent.begin(), m_recent, it->second.recent );
+                known = it->second.interpreter;
+            }
+            else
+            {
+                m_recent.push_front( key );
+                m_interpreters.emplace( key, Entry{ parsed.get_future().share(), m_recent.begin() } );
+                EvictLocked();
+            }
+        }
+        if ( known.valid() )
+        {
+            // Another caller is parsing or has parsed this model, wait without holding the cache lock
+            return known.get();
+        }
+
+        auto interpreter = std::unique_ptr<MNN::Interpreter>( MNN::Interpreter::createFromBuffer( modelData, modelSize ) );
+        if ( !interpreter )
+        {
+            m_logger->error( "Failed to create MNN interpreter from buffer" );
+            parsed.set_value( nullptr );
+            // Forget the failed parse so a later job can try again
+            std::lock_guard<std::mutex> lock( m_mutex );
+            auto                        it = m_interpreters.find( key );
+            if ( it != m_interpreters.end() &&
+                 it->second.interpreter.wait_for( std::chrono::seconds( 0 ) ) == std::future_status::ready &&
+                 it->second.interpreter.get() == nullptr )
+            {
+                m_recent.erase( it->second.recent );
+                m_interpreters.erase( it );
+            }
+            return nullptr;
+        }
+
+        m_logger->info( "Cached MNN interpreter {} ({} bytes)", key, modelSize );
+        auto cached = std::make_shared<CachedInterpreter>( key, std::move( interpreter ), config );
+        parsed.set_value( cached );
+        return cached;
+    }
+
+    void InterpreterCache::SetCapacity( size_t capacity )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_capacity = std::max<size_t>( 1, capacity );
+        EvictLocked();
+    }
+
+    void InterpreterCache::Clear()
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_interpreters.clear();
+        m_recent.clear();
+    }
+
+    size_t InterpreterCache::GetSize() const
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        return m_interpreters.size();
+    }
+
+    void InterpreterCache::EvictLocked()
+    {
+        while ( m_interpreters.size() > m_capacity )
+        {
+            m_interpreters.erase( m_recent.back() );
+            m_recent.pop_back();
+        }
+    }
+
+    std::string InterpreterCache::BackendKey( const MNN::ScheduleConfig &config )
+    {
+        std::ostringstream key;
+        // numThread and mode share storage in some MNN versions, both are written so neither is lost
+        key << static_cast<int>( config.type ) << "/" << config.numThread << "/" << config.mode << "/"
+            << static_cast<int>( config.backupType ) << "/" << static_cast<int>( config.path.mode );
+        for ( const auto *names : { &config.path.inputs, &config.path.outputs, &config.saveTensors } )
+        {
+            key << "/";
+            for ( const auto &name : *names )
+            {
+                key << name.size() << ":" << name;
+            }
+        }
+        if ( config.backendConfig )
+        {
+            // flags shares storage with sharedContext, so distinct GPU contexts get distinct keys
+            key << "/" << static_cast<int>( config.backendConfig->memory ) << "/"
+                << static_cast<int>( config.backendConfig->power ) << "/"
+                << static_cast<int>( config.backendConfig->precision ) << "/" << config.backendConfig->flags;
+        }
+        return key.str();
+    }
+}
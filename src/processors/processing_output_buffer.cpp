@@ -0,0 +1,103 @@
+#include "processors/processing_output_buffer.hpp"
+
+#include <functional>
+#include <numeric>
+#include <system_error>
+
+namespace sgns::sgprocessing
+{
+    OutputBuffer::OutputBuffer( ElementType type, std::vector<size_t> shape ) :
+        type_( type ), shape_( std::move( shape ) )
+    {
+        data_.resize( GetElementCount() * GetElementSize( type_ ) );
+    }
+
+    OutputBuffer::OutputBuffer( ElementType type, std::vector<size_t> shape, std::vector<char> data ) :
+        type_( type ), shape_( std::move( shape ) ), data_( std::move( data ) )
+    {
+        data_.resize( GetElementCount() * GetElementSize( type_ ) );
+    }
+
+    OutputBuffer::~OutputBuffer()
+    {
+        if ( !file_.empty() )
+        {
+            std::error_code error;
+            std::filesystem::remove( file_, error );
+        }
+    }
+
+    OutputBuffer::OutputBuffer( OutputBuffer &&other ) noexcept :
+        type_( other.type_ ),
+        shape_( std::move( other.shape_ ) ),
+        data_( std::move( other.data_ ) ),
+        file_( std::exchange( other.file_, {} ) ),
+        name_( std::move( other.name_ ) )
+    {
+    }
+
+    OutputBuffer &OutputBuffer::operator=( OutputBuffer &&other ) noexcept
+    {
+        if ( this != &other )
+        {
+            if ( !file_.empty() )
+            {
+                std::error_code error;
+                std::filesystem::remove( file_, error );
+            }
+            type_  = other.type_;
+            shape_ = std::move( other.shape_ );
+            data_  = std::move( other.data_ );
+            file_  = std::exchange( other.file_, {} );
+            name_  = std::move( other.name_ );
+        }
+        return *this;
+    }
+
+    OutputBuffer OutputBuffer::FromFile( ElementType type, std::vector<size_t> shape, std::filesystem::path file )
+    {
+        OutputBuffer buffer;
+        buffer.type_  = type;
+        buffer.shape_ = std::move( shape );
+        buffer.file_  = std::move( file );
+        return buffer;
+    }
+
+    size_t OutputBuffer::GetElementSize( ElementType type )
+    {
+        return type == ElementType::Float32 ? sizeof( float ) : sizeof( uint8_t );
+    }
+
+    size_t OutputBuffer::GetElementCount() const
+    {
+        if ( shape_.empty() )
+        {
+            return 0;
+        }
+        return std::accumulate( shape_.begin(), shape_.end(), size_t( 1 ), std::multiplies<size_t>() );
+    }
+
+    gsl::span<float> OutputBuffer::AsFloats()
+    {
+        // The vector's allocation is aligned for any fundamental type, floats included
+        return gsl::span<float>( reinterpret_cast<float *>( data_.data() ), data_.size() / sizeof( float ) );
+    }
+
+    gsl::span<const float> OutputBuffer::AsFloats() const
+    {
+        return gsl::span<const float>( reinterpret_cast<const float *>( data_.data() ), data_.size() / sizeof( float ) );
+    }
+
+    gsl::span<uint8_t> OutputBuffer::AsUInt8()
+    {
+        return gsl::span<uint8_t>( reinterpret_cast<uint8_t *>( data_.data() ), data_.size() );
+    }
+
+    std::vector<char> OutputBuffer::ReleaseBytes()
+    {
+        std::vector<char> bytes = std::move( data_ );
+        data_.clear();
+        shape_.clear();
+        return bytes;
+    }
+}
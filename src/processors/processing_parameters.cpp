@@ -0,0 +1,56 @@
+#include "processors/processing_parameters.hpp"
+
+#include <algorithm>
+
+namespace sgns::sgprocessing
+{
+    const sgns::Parameter *ProcessingParameters::Find( const std::vector<sgns::Parameter> *parameters,
+                                                       const std::string                  &name )
+    {
+        if ( !parameters )
+        {
+            return nullptr;
+        }
+
+        auto it = std::find_if( parameters->begin(),
+                                parameters->end(),
+                                [&name]( const sgns::Parameter &param ) { return param.get_name() == name; } );
+        return it != parameters->end() ? &( *it ) : nullptr;
+    }
+
+    int ProcessingParameters::GetInt( const std::vector<sgns::Parameter> *parameters,
+                                      const std::string                  &name,
+                                      int                                 defaultValue )
+    {
+        const auto *param = Find( parameters, name );
+        if ( !param || !param->get_parameter_default().is_number() )
+        {
+            return defaultValue;
+        }
+        return param->get_parameter_default().get<int>();
+    }
+
+    float ProcessingParameters::GetFloat( const std::vector<sgns::Parameter> *parameters,
+                                          const std::string                  &name,
+                                          float                               defaultValue )
+    {
+        const auto *param = Find( parameters, name );
+        if ( !param || !param->get_parameter_default().is_number() )
+        {
+            return defaultValue;
+        }
+        return param->get_parameter_default().get<float>();
+    }
+
+    std::string ProcessingParameters::GetString( const std::vector<sgns::Parameter> *parameters,
+                                                 const std::string                  &name,
+                                                 const std::string                  &defaultValue )
+    {
+        const auto *param = Find( parameters, name );
+        if ( !param || !param->get_parameter_default().is_string() )
+        {
+            return defaultValue;
+        }
+        return param->get_parameter_default().get<std::string>();
+    }
+}
@@ -13,13 +13,11 @@ namespace sgns::sgprocessing
 
     ProcessingResult MNN_Audio::StartProcessing( std::vector<std::vector<uint8_t>> &chunkhashes,
                                                   const sgns::IoDeclaration         &proc,
-                                                  std::vector<char>                 &imageData,
-                                                  std::vector<char>                 &modelFile,
+                                                  gsl::span<const char>             imageData,
+                                                  gsl::span<const char>             modelFile,
                                                   const std::vector<sgns::Parameter> *parameters )
     {
         (void)parameters;
-        std::vector<uint8_t> modelFile_bytes;
-        modelFile_bytes.assign(modelFile.begin(), modelFile.end());
 
             //Get stride data
         std::vector<uint8_t> subTaskResultHash(SHA256_DIGEST_LENGTH);
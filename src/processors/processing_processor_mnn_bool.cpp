@@ -5,6 +5,10 @@
 #include <cstring>
 #include <limits>
 #include <openssl/sha.h>
+#include "processors/processing_signal_source.hpp"
+#include "processors/processing_window_executor.hpp"
+#include "processors/processing_window_stitcher.hpp"
+#include "processors/processing_result_hash.hpp"
 #include "util/sha256.hpp"
 
 namespace sgns::sgprocessing
@@ -13,181 +17,38 @@ namespace sgns::sgprocessing
 
     namespace
     {
-        std::vector<int> ComputeWindowStarts( int length, int roi, int stride )
+        MNN::ScheduleConfig CreateScheduleConfig()
         {
-            std::vector<int> starts;
-            if ( length <= roi )
-            {
-                starts.push_back( 0 );
-                return starts;
-            }
-
-            const int step = std::max( 1, stride );
-            for ( int pos = 0; pos <= length - roi; pos += step )
-            {
-                starts.push_back( pos );
-            }
-
-            const int last = length - roi;
-            if ( starts.empty() || starts.back() != last )
-            {
-                starts.push_back( last );
-            }
-
-            return starts;
-        }
-
-        float HalfToFloat( uint16_t value )
-        {
-            const uint16_t sign = static_cast<uint16_t>( value >> 15 );
-            const uint16_t exponent = static_cast<uint16_t>( ( value >> 10 ) & 0x1F );
-            const uint16_t mantissa = static_cast<uint16_t>( value & 0x03FF );
-
-            uint32_t sign32 = static_cast<uint32_t>( sign ) << 31;
-            uint32_t exponent32 = 0;
-            uint32_t mantissa32 = 0;
-
-            if ( exponent == 0 )
-            {
-                if ( mantissa == 0 )
-                {
-                    exponent32 = 0;
-                    mantissa32 = 0;
-                }
-                else
-                {
-                    int shift = 0;
-                    uint16_t mant = mantissa;
-                    while ( ( mant & 0x0400 ) == 0 )
-                    {
-                        mant <<= 1;
-                        ++shift;
-                    }
-                    mant &= 0x03FF;
-                    exponent32 = static_cast<uint32_t>( 127 - 15 - shift ) << 23;
-                    mantissa32 = static_cast<uint32_t>( mant ) << 13;
-                }
-            }
-            else if ( exponent == 31 )
-            {
-                exponent32 = 0xFFu << 23;
-                mantissa32 = static_cast<uint32_t>( mantissa ) << 13;
-            }
-            else
-            {
-                exponent32 = static_cast<uint32_t>( exponent + ( 127 - 15 ) ) << 23;
-                mantissa32 = static_cast<uint32_t>( mantissa ) << 13;
-            }
-
-            uint32_t bits = sign32 | exponent32 | mantissa32;
-            float result = 0.0f;
-            std::memcpy( &result, &bits, sizeof( result ) );
-            return result;
+            MNN::ScheduleConfig config;
+            config.type = MNN_FORWARD_CPU;
+            config.numThread = 4;
+            return config;
         }
+    }
 
-        struct OutputLayout
-        {
-            int channels = 1;
-            int length = 1;
-            bool length_is_first_spatial = false;
-        };
-
-        OutputLayout GetOutputLayout( const MNN::Tensor &tensor )
-        {
-            OutputLayout layout;
-            const int dims = tensor.dimensions();
-            const auto dimType = tensor.getDimensionType();
-
-            if ( dims == 4 )
-            {
-                if ( dimType == MNN::Tensor::CAFFE )
-                {
-                    layout.channels = tensor.length( 1 );
-                    const int h = tensor.length( 2 );
-                    const int w = tensor.length( 3 );
-                    layout.length = std::max( h, w );
-                    layout.length_is_first_spatial = ( h >= w );
-                }
-                else
-                {
-                    layout.channels = tensor.length( 3 );
-                    const int h = tensor.length( 1 );
-                    const int w = tensor.length( 2 );
-                    layout.length = std::max( h, w );
-                    layout.length_is_first_spatial = ( h >= w );
-                }
-            }
-            else if ( dims == 3 )
-            {
-                if ( dimType == MNN::Tensor::CAFFE )
-                {
-                    layout.channels = tensor.length( 1 );
-                    layout.length = tensor.length( 2 );
-                }
-                else
-                {
-                    layout.channels = tensor.length( 2 );
-                    layout.length = tensor.length( 1 );
-                }
-            }
-            else if ( dims == 2 )
-            {
-                layout.channels = 1;
-                layout.length = tensor.length( 1 );
-            }
-            else
-            {
-                layout.channels = 1;
-                layout.length = static_cast<int>( tensor.elementSize() );
-            }
-
-            return layout;
-        }
-
-        size_t OutputIndex1D( const MNN::Tensor &tensor, const OutputLayout &layout, int c, int i )
-        {
-            const int dims = tensor.dimensions();
-            const auto dimType = tensor.getDimensionType();
-
-            if ( dims == 4 )
-            {
-                if ( dimType == MNN::Tensor::CAFFE )
-                {
-                    const int h = tensor.length( 2 );
-                    const int w = tensor.length( 3 );
-                    const int hIndex = layout.length_is_first_spatial ? i : 0;
-                    const int wIndex = layout.length_is_first_spatial ? 0 : i;
-                    return ( static_cast<size_t>( c ) * h + static_cast<size_t>( hIndex ) ) * w + static_cast<size_t>( wIndex );
-                }
-                const int h = tensor.length( 1 );
-                const int w = tensor.length( 2 );
-                const int hIndex = layout.length_is_first_spatial ? i : 0;
-                const int wIndex = layout.length_is_first_spatial ? 0 : i;
-                return ( static_cast<size_t>( hIndex ) * w + static_cast<size_t>( wIndex ) ) * layout.channels + static_cast<size_t>( c );
-            }
-
-            if ( dims == 3 )
-            {
-                if ( dimType == MNN::Tensor::CAFFE )
-                {
-                    return static_cast<size_t>( c ) * layout.length + static_cast<size_t>( i );
-                }
-                return static_cast<size_t>( i ) * layout.channels + static_cast<size_t>( c );
-            }
-
-            return static_cast<size_t>( i );
-        }
+    void MNN_Bool::PrepareModel( gsl::span<const char> modelFile )
+    {
+        InterpreterCache::GetInstance().GetInterpreter( modelFile.data(),
+                                                        modelFile.size(),
+                                                        CreateScheduleConfig(),
+                                                        m_modelDigest );
     }
 
     ProcessingResult MNN_Bool::StartProcessing( std::vector<std::vector<uint8_t>> &chunkhashes,
                                                 const sgns::IoDeclaration         &proc,
-                                                std::vector<char>                 &boolData,
-                                                std::vector<char>                 &modelFile,
+                                                gsl::span<const char>             boolData,
+                                                gsl::span<const char>             modelFile,
                                                 const std::vector<sgns::Parameter> *parameters )
     {
-        (void)parameters;
-        std::vector<uint8_t> modelFileBytes;
-        modelFileBytes.assign( modelFile.begin(), modelFile.end() );
+        const MNN::ScheduleConfig config = CreateScheduleConfig();
+
+        auto interpreter =
+            InterpreterCache::GetInstance().GetInterpreter( modelFile.data(), modelFile.size(), config, m_modelDigest );
+        if ( !interpreter )
+        {
+            m_logger->error( "Failed to create MNN interpreter from buffer" );
+            return ProcessingResult{};
+        }
 
         if ( !proc.get_dimensions() || !proc.get_dimensions()->get_width() )
         {
@@ -226,130 +87,93 @@ namespace sgns::sgprocessing
             return ProcessingResult{};
         }
 
-        std::vector<float> signalValues;
-        signalValues.resize( expectedElements );
-        if ( format == sgns::InputFormat::FLOAT32 )
+        SignalSource signal( boolData, format, expectedElements, 1.0f, 0.0f, SignalSource::IntegerValues::Boolean );
+        signal.SetProgressiveInput( m_progressiveInput.get() );
+
+        m_logger->info( "Processing bool input length: {} | patch: {} | stride: {}", length, patchLength, stride );
+
+        const auto hashMode = ResultHash::ModeFromParameters( parameters );
+        if ( !hashMode )
         {
-            const auto *src = reinterpret_cast<const float *>( boolData.data() );
-            std::memcpy( signalValues.data(), src, expectedBytes );
+            m_logger->error( "Unknown resultHash mode, expected \"chain\" or \"merkle-v1\"" );
+            return ProcessingResult{};
         }
-        else if ( format == sgns::InputFormat::FLOAT16 )
+        ResultHash resultHash( *hashMode );
+        const auto starts = WindowStitcher::ComputeWindowStarts( length, patchLength, stride );
+
+        WindowStitcher stitcher( starts, length, patchLength, WindowStitcher::GetBlend( parameters ) );
+
+        // Streaming keeps one window of stitched output in memory instead of the whole signal
+        if ( !stitcher.StreamFromParameters( parameters, m_streamDirectory ) )
         {
-            const auto *src = reinterpret_cast<const uint16_t *>( boolData.data() );
-            for ( size_t i = 0; i < expectedElements; ++i )
-            {
-                signalValues[i] = HalfToFloat( src[i] );
-            }
+            m_logger->error( "Cannot create stream output file in {}", m_streamDirectory.string() );
+            return ProcessingResult{};
         }
-        else
+
+        // Streamed runs are meant for signals too large to also hold as floats, their windows then convert
+        // only their own range. Otherwise the signal is converted once and shared by overlapping windows.
+        if ( !stitcher.IsStreaming() )
         {
-            const auto *src = reinterpret_cast<const int8_t *>( boolData.data() );
-            for ( size_t i = 0; i < expectedElements; ++i )
-            {
-                signalValues[i] = ( src[i] != 0 ) ? 1.0f : 0.0f;
-            }
+            signal.Materialize();
         }
 
-        m_logger->info( "Processing bool input length: {} | patch: {} | stride: {}", length, patchLength, stride );
-
-        std::vector<uint8_t> subTaskResultHash( SHA256_DIGEST_LENGTH );
-        const auto starts = ComputeWindowStarts( length, patchLength, stride );
-
-        int outputChannels = 0;
-        int outputLength = patchLength;
-        OutputLayout outputLayout;
-        std::vector<float> stitchedOutput;
-        std::vector<float> stitchedWeights;
-
-        for ( int start : starts )
-        {
-            std::vector<float> patch;
-            patch.resize( static_cast<size_t>( patchLength ), 0.0f );
-            for ( int i = 0; i < patchLength; ++i )
+        const size_t batchSize = GetBatchSize();
+        WindowExecutor executor( WindowExecutor::GetWorkerCount( parameters, config.numThread ) );
+        const bool completed = executor.RunBatched(
+            starts.size(),
+            batchSize,
+            [&]( size_t firstWindow, size_t windowCount, size_t batch )
             {
-                const int srcIndex = start + i;
-                if ( srcIndex >= length )
+                const size_t patchElements = static_cast<size_t>( patchLength );
+                std::vector<float> patches( batch * patchElements, 0.0f );
+                for ( size_t b = 0; b < windowCount; ++b )
                 {
-                    break;
+                    // Positions past the signal end keep their zero padding
+                    signal.Read( static_cast<size_t>( starts[firstWindow + b] ),
+                                 gsl::span<float>( patches.data() + b * patchElements, patchElements ) );
                 }
-                patch[static_cast<size_t>( i )] = signalValues[static_cast<size_t>( srcIndex )];
-            }
 
-            auto procresults = Process( patch, modelFileBytes, patchLength );
-            const float *data = procresults->host<float>();
-            size_t dataSize = procresults->elementSize() * sizeof( float );
-
-            if ( outputChannels == 0 )
+                return Process( patches, *interpreter, patchLength, static_cast<int>( batch ) );
+            },
+            [&]( size_t windowIndex, MNN::Tensor &procresults )
             {
-                outputLayout = GetOutputLayout( *procresults );
-                outputChannels = outputLayout.channels;
-                outputLength = outputLayout.length;
+                const float *data = procresults.host<float>();
+                size_t dataSize = procresults.elementSize() * sizeof( float );
 
-                stitchedOutput.assign( static_cast<size_t>( outputChannels ) * length, 0.0f );
-                stitchedWeights.assign( static_cast<size_t>( length ), 0.0f );
-            }
-
-            if ( outputLength == patchLength )
-            {
-                for ( int i = 0; i < patchLength; ++i )
+                if ( !stitcher.Add( windowIndex, procresults ) )
                 {
-                    const int outIndex = start + i;
-                    if ( outIndex >= length )
-                    {
-                        break;
-                    }
-
-                    const size_t weightIndex = static_cast<size_t>( outIndex );
-                    stitchedWeights[weightIndex] += 1.0f;
-
-                    for ( int c = 0; c < outputChannels; ++c )
-                    {
-                        const size_t srcIndex = OutputIndex1D( *procresults, outputLayout, c, i );
-                        const size_t dstIndex = static_cast<size_t>( c ) * length + static_cast<size_t>( outIndex );
-                        stitchedOutput[dstIndex] += data[srcIndex];
-                    }
+                    m_logger->error( "Failed to write stitched output" );
+                    return false;
                 }
-            }
 
-            std::vector<uint8_t> shahash = sgprocmanagersha::sha256( data, dataSize );
-            std::string hashString( shahash.begin(), shahash.end() );
-            chunkhashes.push_back( shahash );
+                const auto chunkHash = resultHash.Append( data, dataSize );
+                chunkhashes.emplace_back( chunkHash.begin(), chunkHash.end() );
 
-            std::string combinedHash = std::string( subTaskResultHash.begin(), subTaskResultHash.end() ) + hashString;
-            subTaskResultHash = sgprocmanagersha::sha256( combinedHash.c_str(), combinedHash.length() );
+                m_progress = static_cast<float>( windowIndex + 1 ) * 100.0f / static_cast<float>( starts.size() );
+                return true;
+            } );
+        if ( !completed )
+        {
+            m_logger->error( "Bool window inference failed" );
+            return ProcessingResult{};
         }
 
-        if ( !stitchedOutput.empty() )
+        if ( !stitcher.Finish() )
         {
-            for ( int c = 0; c < outputChannels; ++c )
-            {
-                for ( int i = 0; i < length; ++i )
-                {
-                    const size_t weightIndex = static_cast<size_t>( i );
-                    if ( stitchedWeights[weightIndex] <= 0.0f )
-                    {
-                        continue;
-                    }
-                    const size_t dstIndex = static_cast<size_t>( c ) * length + static_cast<size_t>( i );
-                    stitchedOutput[dstIndex] /= stitchedWeights[weightIndex];
-                }
-            }
+            m_logger->error( "Failed to write stitched output" );
+            return ProcessingResult{};
         }
 
+        OutputBuffer stitchedOutput = stitcher.TakeOutput();
+
         m_progress = 100.0f;
 
         ProcessingResult result;
-        result.hash = subTaskResultHash;
+        result.hash = resultHash.GetHashBytes();
 
-        if ( !stitchedOutput.empty() )
+        if ( !stitchedOutput.Empty() )
         {
-            const size_t byteCount = stitchedOutput.size() * sizeof( float );
-            std::vector<char> outputBytes( byteCount );
-            std::memcpy( outputBytes.data(), stitchedOutput.data(), byteCount );
-
-            result.output_buffers = std::make_shared<std::pair<std::vector<std::string>, std::vector<std::vector<char>>>>();
-            result.output_buffers->first.push_back( "" );
-            result.output_buffers->second.push_back( std::move( outputBytes ) );
+            result.outputs.push_back( std::move( stitchedOutput ) );
         }
 
         m_logger->info( "Bool processing complete" );
@@ -357,93 +181,101 @@ namespace sgns::sgprocessing
         return result;
     }
 
-    std::unique_ptr<MNN::Tensor> MNN_Bool::Process( const std::vector<float> &signalData,
-                                                    std::vector<uint8_t>    &modelFile,
-                                                    int                      length )
+    std::vector<std::unique_ptr<MNN::Tensor>> MNN_Bool::Process( const std::vector<float> &signalData,
+                                                                 CachedInterpreter       &cachedInterpreter,
+                                                                 int                      length,
+                                                                 int                      batch )
     {
-        auto interpreter = std::shared_ptr<MNN::Interpreter>(
-            MNN::Interpreter::createFromBuffer( modelFile.data(), modelFile.size() ) );
-
-        if ( !interpreter )
-        {
-            m_logger->error( "Failed to create MNN interpreter" );
-            return std::make_unique<MNN::Tensor>();
-        }
-
-        MNN::ScheduleConfig config;
-        config.type = MNN_FORWARD_CPU;
-        config.numThread = 4;
+        auto *interpreter = cachedInterpreter.Get();
+        auto  lease       = cachedInterpreter.AcquireSession(
+            { length, batch },
+            [length, batch]( MNN::Interpreter *net, MNN::Session *session )
+            {
+                for ( const auto &inputPair : net->getSessionInputAll( session ) )
+                {
+                    auto tensor = inputPair.second;
+                    const int dims = tensor->dimensions();
+                    const auto dimType = tensor->getDimensionType();
+                    if ( tensor->elementSize() <= 4 )
+                    {
+                        if ( dims == 4 )
+                        {
+                            if ( dimType == MNN::Tensor::TENSORFLOW )
+                            {
+                                net->resizeTensor( tensor, { batch, length, 1, 1 } );
+                            }
+                            else
+                            {
+                                net->resizeTensor( tensor, { batch, 1, 1, length } );
+                            }
+                        }
+                        else if ( dims == 3 )
+                        {
+                            if ( dimType == MNN::Tensor::TENSORFLOW )
+                            {
+                                net->resizeTensor( tensor, { batch, length, 1 } );
+                            }
+                            else
+                            {
+                                net->resizeTensor( tensor, { batch, 1, length } );
+                            }
+                        }
+                        else if ( dims == 2 )
+                        {
+                            net->resizeTensor( tensor, { batch, length } );
+                        }
+                        else
+                        {
+                            net->resizeTensor( tensor, { batch, 1, 1, length } );
+                        }
+                    }
+                    else if ( batch > 1 )
+                    {
+                        if ( !WindowExecutor::ResizeBatch( net, tensor, batch ) )
+                        {
+                            return false;
+                        }
+                    }
+                }
+                net->resizeSession( session );
+                return true;
+            } );
 
-        auto session = interpreter->createSession( config );
+        auto session = lease.Get();
         if ( !session )
         {
             m_logger->error( "Failed to create MNN session" );
-            return std::make_unique<MNN::Tensor>();
+            return {};
         }
 
         auto inputTensors = interpreter->getSessionInputAll( session );
         if ( inputTensors.empty() )
         {
             m_logger->error( "Model has no inputs" );
-            return std::make_unique<MNN::Tensor>();
+            return {};
         }
 
         for ( const auto &inputPair : inputTensors )
         {
             auto tensor = inputPair.second;
-            const int dims = tensor->dimensions();
-            const auto dimType = tensor->getDimensionType();
-            if ( tensor->elementSize() <= 4 )
+            MNN::Tensor inputTensorUser( tensor, tensor->getDimensionType() );
+
+            // Every batch entry gets one window, zero padded to the entry size
+            auto inputData = inputTensorUser.host<float>();
+            const size_t sliceElements = static_cast<size_t>( inputTensorUser.elementSize() ) / static_cast<size_t>( batch );
+            const size_t copyCount = std::min( sliceElements, static_cast<size_t>( length ) );
+            for ( int b = 0; b < batch; ++b )
             {
-                if ( dims == 4 )
+                float       *dst = inputData + static_cast<size_t>( b ) * sliceElements;
+                const float *src = signalData.data() + static_cast<size_t>( b ) * length;
+                for ( size_t i = 0; i < copyCount; ++i )
                 {
-                    if ( dimType == MNN::Tensor::TENSORFLOW )
-                    {
-                        interpreter->resizeTensor( tensor, { 1, length, 1, 1 } );
-                    }
-                    else
-                    {
-                        interpreter->resizeTensor( tensor, { 1, 1, 1, length } );
-                    }
+                    dst[i] = src[i];
                 }
-                else if ( dims == 3 )
+                for ( size_t i = copyCount; i < sliceElements; ++i )
                 {
-                    if ( dimType == MNN::Tensor::TENSORFLOW )
-                    {
-                        interpreter->resizeTensor( tensor, { 1, length, 1 } );
-                    }
-                    else
-                    {
-                        interpreter->resizeTensor( tensor, { 1, 1, length } );
-                    }
+                    dst[i] = 0.0f;
                 }
-                else if ( dims == 2 )
-                {
-                    interpreter->resizeTensor( tensor, { 1, length } );
-                }
-                else
-                {
-                    interpreter->resizeTensor( tensor, { 1, 1, 1, length } );
-                }
-            }
-        }
-        interpreter->resizeSession( session );
-
-        for ( const auto &inputPair : inputTensors )
-        {
-            auto tensor = inputPair.second;
-            MNN::Tensor inputTensorUser( tensor, tensor->getDimensionType() );
-
-            auto inputData = inputTensorUser.host<float>();
-            const size_t elementCount = inputTensorUser.elementSize();
-            const size_t copyCount = std::min( elementCount, signalData.size() );
-            for ( size_t i = 0; i < copyCount; ++i )
-            {
-                inputData[i] = signalData[i];
-            }
-            for ( size_t i = copyCount; i < elementCount; ++i )
-            {
-                inputData[i] = 0.0f;
             }
 
             tensor->copyFromHostTensor( &inputTensorUser );
@@ -455,12 +287,12 @@ namespace sgns::sgprocessing
         if ( !outputTensor )
         {
             m_logger->error( "Failed to get output tensor" );
-            return std::make_unique<MNN::Tensor>();
+            return {};
         }
 
         auto outputHost = std::make_unique<MNN::Tensor>( outputTensor, MNN::Tensor::CAFFE );
         outputTensor->copyToHostTensor( outputHost.get() );
 
-        return outputHost;
+        return WindowExecutor::SplitBatch( std::move( outputHost ), static_cast<size_t>( batch ) );
     }
 }
@@ -5,6 +5,9 @@
 #include <cstring>
 #include <limits>
 #include <openssl/sha.h>
+#include "processors/processing_signal_source.hpp"
+#include "processors/processing_window_executor.hpp"
+#include "processors/processing_window_stitcher.hpp"
 #include "util/sha256.hpp"
 
 namespace sgns::sgprocessing
@@ -13,164 +16,39 @@ namespace sgns::sgprocessing
 
     namespace
     {
-        std::vector<int> ComputeWindowStarts( int length, int roi, int stride )
+        MNN::ScheduleConfig CreateScheduleConfig()
         {
-            std::vector<int> starts;
-            if ( length <= roi )
-            {
-                starts.push_back( 0 );
-                return starts;
-            }
-
-            const int step = std::max( 1, stride );
-            for ( int pos = 0; pos <= length - roi; pos += step )
-            {
-                starts.push_back( pos );
-            }
-
-            const int last = length - roi;
-            if ( starts.empty() || starts.back() != last )
-            {
-                starts.push_back( last );
-            }
-
-            return starts;
-        }
-
-        float HalfToFloat( uint16_t value )
-        {
-            const uint16_t sign = static_cast<uint16_t>( value >> 15 );
-            const uint16_t exponent = static_cast<uint16_t>( ( value >> 10 ) & 0x1F );
-            const uint16_t mantissa = static_cast<uint16_t>( value & 0x03FF );
-
-            uint32_t sign32 = static_cast<uint32_t>( sign ) << 31;
-            uint32_t exponent32 = 0;
-            uint32_t mantissa32 = 0;
-
-            if ( exponent == 0 )
-            {
-                if ( mantissa == 0 )
-                {
-                    exponent32 = 0;
-                    mantissa32 = 0;
-                }
-                else
-                {
-                    int shift = 0;
-                    uint16_t mant = mantissa;
-                    while ( ( mant & 0x0400 ) == 0 )
-                    {
-                        mant <<= 1;
-                        ++shift;
-                    }
-                    mant &= 0x03FF;
-                    exponent32 = static_cast<uint32_t>( 127 - 15 - shift ) << 23;
-                    mantissa32 = static_cast<uint32_t>( mant ) << 13;
-                }
-            }
-            else if ( exponent == 31 )
-            {
-                exponent32 = 0xFFu << 23;
-                mantissa32 = static_cast<uint32_t>( mantissa ) << 13;
-            }
-            else
-            {
-                exponent32 = static_cast<uint32_t>( exponent + ( 127 - 15 ) ) << 23;
-                mantissa32 = static_cast<uint32_t>( mantissa ) << 13;
-            }
-
-            uint32_t bits = sign32 | exponent32 | mantissa32;
-            float result = 0.0f;
-            std::memcpy( &result, &bits, sizeof( result ) );
-            return result;
-        }
-
-        struct OutputLayout
-        {
-            int channels = 1;
-            int length = 1;
-            bool length_is_first_spatial = false;
-        };
-
-        OutputLayout GetOutputLayout( const MNN::Tensor &tensor )
-        {
-            OutputLayout layout;
-            const int dims = tensor.dimensions();
-            const auto dimType = tensor.getDimensionType();
-
-            if ( dims == 4 )
-            {
-                if ( dimType == MNN::Tensor::CAFFE )
-                {
-                    layout.channels = tensor.length( 1 );
-                    const int h = tensor.length( 2 );
-                    const int w = tensor.length( 3 );
-                    layout.length = std::max( h, w );
-                    layout.length_is_first_spatial = ( h >= w );
-                }
-                else
-                {
-                    layout.channels = tensor.length( 3 );
-                    const int h = tensor.length( 1 );
-                    const int w = tensor.length( 2 );
-                    layout.length = std::max( h, w );
-                    layout.length_is_first_spatial = ( h >= w );
-                }
-            }
-            else if ( dims == 3 )
-            {
-                if ( dimType == MNN::Tensor::CAFFE )
-                {
-                    layout.channels = tensor.length( 1 );
-                    layout.length = tensor.length( 2 );
-                }
-                else
-                {
-                    layout.channels = tensor.length( 2 );
-                    layout.length = tensor.length( 1 );
-                }
-            }
-            else if ( dims == 2 )
-            {
-                layout.channels = 1;
-                layout.length = tensor.length( 1 );
-            }
-            else
-            {
-                layout.channels = 1;
-                layout.length = static_cast<int>( tensor.elementSize() );
-            }
-
-            return layout;
+            MNN::ScheduleConfig config;
+            config.type = MNN_FORWARD_CPU;
+            config.numThread = 4;
+            config.backendConfig = nullptr;
+            return config;
         }
+    }
 
-        size_t OutputIndex1D( const MNN::Tensor &tensor, const OutputLayout &layout, int c, int i )
-        {
-            const int dims = tensor.dimensions();
-            const auto dimType = tensor.getDimensionType();
-
-            if ( dims == 3 )
-            {
-                if ( dimType == MNN::Tensor::CAFFE )
-                {
-                    return static_cast<size_t>( c ) * layout.length + static_cast<size_t>( i );
-                }
-                return static_cast<size_t>( i ) * layout.channels + static_cast<size_t>( c );
-            }
-
-            return static_cast<size_t>( i );
-        }
+    void MNN_Float::PrepareModel( gsl::span<const char> modelFile )
+    {
+        InterpreterCache::GetInstance().GetInterpreter( modelFile.data(),
+                                                        modelFile.size(),
+                                                        CreateScheduleConfig(),
+                                                        m_modelDigest );
     }
 
     ProcessingResult MNN_Float::StartProcessing( std::vector<std::vector<uint8_t>> &chunkhashes,
                                                 const sgns::IoDeclaration         &proc,
-                                                std::vector<char>                 &floatData,
-                                                std::vector<char>                 &modelFile,
+                                                gsl::span<const char>             floatData,
+                                                gsl::span<const char>             modelFile,
                                                 const std::vector<sgns::Parameter> *parameters )
     {
-        (void)parameters;
-        std::vector<uint8_t> modelFileBytes;
-        modelFileBytes.assign( modelFile.begin(), modelFile.end() );
+        const MNN::ScheduleConfig config = CreateScheduleConfig();
+
+        auto interpreter =
+            InterpreterCache::GetInstance().GetInterpreter( modelFile.data(), modelFile.size(), config, m_modelDigest );
+        if ( !interpreter )
+        {
+            m_logger->error( "Failed to create MNN interpreter from buffer" );
+            return ProcessingResult{};
+        }
 
         if ( !proc.get_dimensions() || !proc.get_dimensions()->get_width() )
         {
@@ -206,155 +84,139 @@ namespace sgns::sgprocessing
             return ProcessingResult{};
         }
 
-        std::vector<float> signalValues;
-        signalValues.resize( expectedElements );
-        if ( format == sgns::InputFormat::FLOAT32 )
-        {
-            const auto *src = reinterpret_cast<const float *>( floatData.data() );
-            std::memcpy( signalValues.data(), src, expectedBytes );
-        }
-        else
-        {
-            const auto *src = reinterpret_cast<const uint16_t *>( floatData.data() );
-            for ( size_t i = 0; i < expectedElements; ++i )
-            {
-                signalValues[i] = HalfToFloat( src[i] );
-            }
-        }
+        SignalSource signal( floatData, format, expectedElements );
+        signal.SetProgressiveInput( m_progressiveInput.get() );
 
         m_logger->info( "Processing float input length: {} | patch: {} | stride: {}", length, patchLength, stride );
 
-        std::vector<uint8_t> subTaskResultHash( SHA256_DIGEST_LENGTH );
-        const auto starts = ComputeWindowStarts( length, patchLength, stride );
+        sgprocmanagersha::Sha256Hasher hasher;
+        const auto starts = WindowStitcher::ComputeWindowStarts( length, patchLength, stride );
+
+        WindowStitcher stitcher( starts, length, patchLength, WindowStitcher::GetBlend( parameters ) );
 
-        int outputChannels = 0;
-        int outputLength = patchLength;
-        OutputLayout outputLayout;
-        std::vector<float> stitchedOutput;
-        std::vector<float> stitchedWeights;
+        // Streaming keeps one window of stitched output in memory instead of the whole signal
+        if ( !stitcher.StreamFromParameters( parameters, m_streamDirectory ) )
+        {
+            m_logger->error( "Cannot create stream output file in {}", m_streamDirectory.string() );
+            return ProcessingResult{};
+        }
 
-        for ( int start : starts )
+        // Streamed runs are meant for signals too large to also hold as floats, their windows then convert
+        // only their own range. Otherwise the signal is converted once and shared by overlapping windows.
+        if ( !stitcher.IsStreaming() )
         {
-            std::vector<float> patch;
-            patch.resize( static_cast<size_t>( patchLength ), 0.0f );
-            for ( int i = 0; i < patchLength; ++i )
+            signal.Materialize();
+        }
+
+        const size_t batchSize = GetBatchSize();
+        WindowExecutor executor( WindowExecutor::GetWorkerCount( parameters, config.numThread ) );
+        const bool completed = executor.RunBatched(
+            starts.size(),
+            batchSize,
+            [&]( size_t firstWindow, size_t windowCount, size_t batch )
             {
-                const int srcIndex = start + i;
-                if ( srcIndex >= length )
+                const size_t patchElements = static_cast<size_t>( patchLength );
+                std::vector<float> patches( batch * patchElements, 0.0f );
+                for ( size_t b = 0; b < windowCount; ++b )
                 {
-                    break;
+                    // Positions past the signal end keep their zero padding
+                    signal.Read( static_cast<size_t>( starts[firstWindow + b] ),
+                                 gsl::span<float>( patches.data() + b * patchElements, patchElements ) );
                 }
-                patch[static_cast<size_t>( i )] = signalValues[static_cast<size_t>( srcIndex )];
-            }
-
-            auto procresults = Process( patch, modelFileBytes, patchLength );
-            const float *data = procresults->host<float>();
-            size_t dataSize = procresults->elementSize() * sizeof( float );
 
-            if ( outputChannels == 0 )
+                return Process( patches, *interpreter, patchLength, static_cast<int>( batch ) );
+            },
+            [&]( size_t windowIndex, MNN::Tensor &procresults )
             {
-                outputLayout = GetOutputLayout( *procresults );
-                outputChannels = outputLayout.channels;
-                outputLength = outputLayout.length;
-
-                stitchedOutput.assign( static_cast<size_t>( outputChannels ) * length, 0.0f );
-                stitchedWeights.assign( static_cast<size_t>( length ), 0.0f );
-            }
+                const float *data = procresults.host<float>();
+                size_t dataSize = procresults.elementSize() * sizeof( float );
 
-            if ( outputLength == patchLength )
-            {
-                for ( int i = 0; i < patchLength; ++i )
+                if ( !stitcher.Add( windowIndex, procresults ) )
                 {
-                    const int outIndex = start + i;
-                    if ( outIndex >= length )
-                    {
-                        break;
-                    }
-                    
-                    for ( int c = 0; c < outputChannels; ++c )
-                    {
-                        const size_t srcIdx = OutputIndex1D( *procresults, outputLayout, c, i );
-                        const size_t dstIdx = static_cast<size_t>( c * length + outIndex );
-
-                        stitchedOutput[dstIdx] += data[srcIdx];
-                    }
-
-                    stitchedWeights[static_cast<size_t>( outIndex )] += 1.0f;
+                    m_logger->error( "Failed to write stitched output" );
+                    return false;
                 }
-            }
 
-            auto hash = sgprocmanagersha::sha256( data, dataSize );
-            chunkhashes.emplace_back( hash.begin(), hash.end() );
+                const auto chunkHash = hasher.Digest( data, dataSize );
+                chunkhashes.emplace_back( chunkHash.begin(), chunkHash.end() );
+
+                m_progress = static_cast<float>( windowIndex + 1 ) * 100.0f / static_cast<float>( starts.size() );
+                return true;
+            } );
+        if ( !completed )
+        {
+            m_logger->error( "Float window inference failed" );
+            return ProcessingResult{};
         }
 
-        for ( size_t idx = 0; idx < stitchedOutput.size(); ++idx )
+        if ( !stitcher.Finish() )
         {
-            const int spatialIdx = static_cast<int>( idx % length );
-            const float weight = stitchedWeights[static_cast<size_t>( spatialIdx )];
-            if ( weight > 0.0f )
-            {
-                stitchedOutput[idx] /= weight;
-            }
+            m_logger->error( "Failed to write stitched output" );
+            return ProcessingResult{};
         }
 
-        std::string stitchedStr( reinterpret_cast<const char *>( stitchedOutput.data() ),
-                                  stitchedOutput.size() * sizeof( float ) );
-        subTaskResultHash = sgprocmanagersha::sha256( stitchedStr.c_str(), stitchedStr.size() );
+        const auto         stitchedHash   = stitcher.HashOutput();
+        OutputBuffer       stitchedOutput = stitcher.TakeOutput();
 
         m_progress = 100.0f;
 
         ProcessingResult result;
-        result.hash = subTaskResultHash;
+        result.hash.assign( stitchedHash.begin(), stitchedHash.end() );
 
-        if ( !stitchedOutput.empty() )
+        if ( !stitchedOutput.Empty() )
         {
-            const size_t byteCount = stitchedOutput.size() * sizeof( float );
-            std::vector<char> outputBytes( byteCount );
-            std::memcpy( outputBytes.data(), stitchedOutput.data(), byteCount );
-
-            result.output_buffers =
-                std::make_shared<std::pair<std::vector<std::string>, std::vector<std::vector<char>>>>();
-            result.output_buffers->first.push_back( "" );
-            result.output_buffers->second.push_back( std::move( outputBytes ) );
+            result.outputs.push_back( std::move( stitchedOutput ) );
         }
 
         m_logger->info( "Float processing complete" );
         return result;
     }
 
-    std::unique_ptr<MNN::Tensor> MNN_Float::Process( const std::vector<float> &signalData,
-                                                       std::vector<uint8_t>    &modelFile,
-                                                       int                      length )
+    std::vector<std::unique_ptr<MNN::Tensor>> MNN_Float::Process( const std::vector<float> &signalData,
+                                                                  CachedInterpreter       &cachedInterpreter,
+                                                                  int                      length,
+                                                                  int                      batch )
     {
-        auto interpreter = std::unique_ptr<MNN::Interpreter>( MNN::Interpreter::createFromBuffer( modelFile.data(), modelFile.size() ) );
-        if ( !interpreter )
-        {
-            m_logger->error( "Failed to create MNN interpreter from buffer" );
-            return nullptr;
-        }
-
-        MNN::ScheduleConfig config;
-        config.type = MNN_FORWARD_CPU;
-        config.numThread = 4;
-        config.backendConfig = nullptr;
+        auto *interpreter = cachedInterpreter.Get();
+        auto  lease       = cachedInterpreter.AcquireSession(
+            { batch },
+            [batch]( MNN::Interpreter *net, MNN::Session *session )
+            {
+                if ( batch > 1 )
+                {
+                    if ( !WindowExecutor::ResizeBatch( net, net->getSessionInput( session, nullptr ), batch ) )
+                    {
+                        return false;
+                    }
+                    net->resizeSession( session );
+                }
+                return true;
+            } );
 
-        auto session = interpreter->createSession( config );
+        auto session = lease.Get();
         if ( !session )
         {
             m_logger->error( "Failed to create MNN session" );
-            return nullptr;
+            return {};
         }
 
         auto inputTensor = interpreter->getSessionInput( session, nullptr );
         if ( !inputTensor )
         {
             m_logger->error( "Failed to get input tensor" );
-            return nullptr;
+            return {};
         }
 
         MNN::Tensor inputTensorUser( inputTensor, inputTensor->getDimensionType() );
         auto inputPtr = inputTensorUser.host<float>();
-        std::memcpy( inputPtr, signalData.data(), length * sizeof( float ) );
+        const size_t sliceElements = static_cast<size_t>( inputTensorUser.elementSize() ) / static_cast<size_t>( batch );
+        const size_t copyCount = std::min( static_cast<size_t>( length ), sliceElements );
+        for ( int b = 0; b < batch; ++b )
+        {
+            std::memcpy( inputPtr + static_cast<size_t>( b ) * sliceElements,
+                         signalData.data() + static_cast<size_t>( b ) * length,
+                         copyCount * sizeof( float ) );
+        }
         inputTensor->copyFromHostTensor( &inputTensorUser );
 
         interpreter->runSession( session );
@@ -363,13 +225,13 @@ namespace sgns::sgprocessing
         if ( !outputTensor )
         {
             m_logger->error( "Failed to get output tensor" );
-            return nullptr;
+            return {};
         }
 
         MNN::Tensor::DimensionType outputDimType = outputTensor->getDimensionType();
         auto outputUserTensor = std::make_unique<MNN::Tensor>( outputTensor, outputDimType );
         outputTensor->copyToHostTensor( outputUserTensor.get() );
 
-        return outputUserTensor;
+        return WindowExecutor::SplitBatch( std::move( outputUserTensor ), static_cast<size_t>( batch ) );
     }
 }
@@ -1,8 +1,12 @@
 #include "processors/processing_processor_mnn_image.hpp"
 #include "datasplitter/ImageSplitter.hpp"
+#include "processors/processing_chunk_throttle.hpp"
+#include "processors/processing_window_executor.hpp"
+#include <algorithm>
+#include <cstring>
 #include <functional>
-#include <thread>
 #include <openssl/sha.h> // For SHA256_DIGEST_LENGTH
+#include "processors/processing_result_hash.hpp"
 #include "util/sha256.hpp"
 #include "util/InputTypes.hpp"
 
@@ -15,18 +19,55 @@ namespace sgns::sgprocessing
 {
     using namespace MNN;
 
+    namespace
+    {
+        MNN::ScheduleConfig CreateScheduleConfig()
+        {
+            MNN::ScheduleConfig config;
+            config.type = MNN_FORWARD_VULKAN;
+            config.numThread = 4;
+            config.mode = 0;
+            return config;
+        }
+    }
+
+    void MNN_Image::PrepareModel( gsl::span<const char> modelFile )
+    {
+        InterpreterCache::GetInstance().GetInterpreter( modelFile.data(),
+                                                        modelFile.size(),
+                                                        CreateScheduleConfig(),
+                                                        m_modelDigest );
+    }
+
     ProcessingResult MNN_Image::StartProcessing( std::vector<std::vector<uint8_t>> &chunkhashes,
                                                  const sgns::IoDeclaration         &proc,
-                                                 std::vector<char>                 &imageData,
-                                                 std::vector<char>                 &modelFile,
+                                                 gsl::span<const char>             imageData,
+                                                 gsl::span<const char>             modelFile,
                                                  const std::vector<sgns::Parameter> *parameters )
     {
-        (void)parameters;
-        std::vector<uint8_t> modelFile_bytes;
-        modelFile_bytes.assign(modelFile.begin(), modelFile.end());
+        //auto backendConfig           = new MNN::BackendConfig();
+        //backendConfig->power         = MNN::BackendConfig::Power_Low;
+        //backendConfig->queuePriority = 0.1f;
+
+        const MNN::ScheduleConfig netConfig = CreateScheduleConfig();
+        //netConfig.backendConfig = backendConfig;
+        auto mnnNet =
+            InterpreterCache::GetInstance().GetInterpreter( modelFile.data(), modelFile.size(), netConfig, m_modelDigest );
+        if ( !mnnNet )
+        {
+            m_logger->error( "Failed to create MNN interpreter from buffer" );
+            return ProcessingResult{};
+        }
+
+        const auto hashMode = ResultHash::ModeFromParameters( parameters );
+        if ( !hashMode )
+        {
+            m_logger->error( "Unknown resultHash mode, expected \"chain\" or \"merkle-v1\"" );
+            return ProcessingResult{};
+        }
+        ResultHash resultHash( *hashMode );
 
             //Get stride data
-        std::vector<uint8_t> subTaskResultHash(SHA256_DIGEST_LENGTH);
         auto                 block_len             = proc.get_dimensions().value().get_block_len().value();
         auto                 block_line_stride     = proc.get_dimensions().value().get_block_line_stride().value();
         auto                 block_stride          = proc.get_dimensions().value().get_block_stride().value();
@@ -48,63 +89,98 @@ namespace sgns::sgprocessing
 
         //for ( auto image : *imageData_ )
         //{
-            std::vector<uint8_t> output(imageData.size());
-            std::transform(imageData.begin(), imageData.end(), output.begin(),
-                            []( char c ) { return static_cast<uint8_t>( c ); } );
+            // Split straight from the loaded (possibly memory mapped) bytes, which the caller keeps
+            // alive until StartProcessing returns and so outlive both splitters
+            gsl::span<const uint8_t> output( reinterpret_cast<const uint8_t *>( imageData.data() ), imageData.size() );
             //ImageSplitter animageSplit( output, task.block_line_stride(), task.block_stride(), task.block_len() );
             ImageSplitter animageSplit(output, block_line_stride, block_stride, block_len, channels);
             auto          dataindex           = 0;
-            ImageSplitter ChunkSplit( animageSplit.GetPart( dataindex ), chunk_line_stride, chunk_stride,
+            ImageSplitter ChunkSplit( animageSplit.GetPartView( dataindex ), chunk_line_stride, chunk_stride,
                                       animageSplit.GetPartHeightActual( dataindex ) / chunk_subchunk_height *
                                             chunk_line_stride, channels);
             
             auto totalChunks = proc.get_dimensions().value().get_chunk_count().value();
             m_progress = 0.0f; // Reset progress at start
+
+            // Full speed unless the job asks for a duty cycle
+            auto throttle = ChunkThrottle::FromParameters( parameters );
             
-            for ( int chunkIdx = 0; chunkIdx < totalChunks; ++chunkIdx )
+            // Consecutive chunks of equal size share one batched inference. Throttled jobs keep
+            // running one chunk at a time so the duty cycle still applies per chunk.
+            int batchSize = throttle.IsEnabled() ? 1 : static_cast<int>( GetBatchSize() );
+
+            for ( int chunkIdx = 0; chunkIdx < totalChunks; )
             {
-                m_logger->info( "Chunk IDX {} Total {}",
-                                chunkIdx,
-                                totalChunks );
-                std::vector<uint8_t> shahash( SHA256_DIGEST_LENGTH );
-
-                // Chunk result hash should be calculated
-                size_t chunkHash = 0;
-
-                auto procresults =
-                    Process( ChunkSplit.GetPart( chunkIdx ), modelFile_bytes, channels, ChunkSplit.GetPartWidthActual( chunkIdx ),
-                                ChunkSplit.GetPartHeightActual( chunkIdx ) );
-
-                const float *data     = procresults->host<float>();
-                size_t       dataSize = procresults->elementSize() * sizeof( float );
-                shahash               = sgprocmanagersha::sha256( data, dataSize );
-                std::string hashString( shahash.begin(), shahash.end() );
-                chunkhashes.push_back( shahash );
-
-                std::string combinedHash = std::string(subTaskResultHash.begin(), subTaskResultHash.end()) + hashString;
-                subTaskResultHash = sgprocmanagersha::sha256( combinedHash.c_str(), combinedHash.length() );
-                
-                // Update progress: round to 2 decimal places
-                m_progress = std::round(((chunkIdx + 1) * 100.0f / totalChunks) * 100.0f) / 100.0f;
-                
-                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                throttle.BeginChunk();
+                const int chunkWidth  = ChunkSplit.GetPartWidthActual( chunkIdx );
+                const int chunkHeight = ChunkSplit.GetPartHeightActual( chunkIdx );
+
+                std::vector<ImagePartView> chunkImages;
+                chunkImages.push_back( ChunkSplit.GetPartView( chunkIdx ) );
+                while ( static_cast<int>( chunkImages.size() ) < batchSize &&
+                        chunkIdx + static_cast<int>( chunkImages.size() ) < totalChunks )
+                {
+                    const int nextIdx = chunkIdx + static_cast<int>( chunkImages.size() );
+                    if ( ChunkSplit.GetPartWidthActual( nextIdx ) != chunkWidth ||
+                         ChunkSplit.GetPartHeightActual( nextIdx ) != chunkHeight )
+                    {
+                        break;
+                    }
+                    chunkImages.push_back( ChunkSplit.GetPartView( nextIdx ) );
+                }
+
+                auto procresults = Process( chunkImages, *mnnNet, channels, chunkWidth, chunkHeight, batchSize );
+                if ( procresults.size() < chunkImages.size() && batchSize > 1 )
+                {
+                    // Models with a fixed batch of 1 or outputs without a batch dimension cannot batch chunks
+                    m_logger->warn( "Batch of {} chunks failed, running the model with batch 1", batchSize );
+                    batchSize = 1;
+                    continue;
+                }
+                if ( procresults.size() < chunkImages.size() )
+                {
+                    m_logger->error( "MNN inference failed for chunk {}", chunkIdx );
+                    return ProcessingResult{};
+                }
+
+                std::vector<sgprocmanagersha::Sha256Input> outputs;
+                outputs.reserve( chunkImages.size() );
+                for ( size_t i = 0; i < chunkImages.size(); ++i )
+                {
+                    outputs.push_back( { procresults[i]->host<float>(),
+                                         procresults[i]->elementSize() * sizeof( float ) } );
+                }
+                const auto outputHashes = sgprocmanagersha::sha256Batch( outputs );
+
+                for ( size_t i = 0; i < chunkImages.size(); ++i, ++chunkIdx )
+                {
+                    m_logger->info( "Chunk IDX {} Total {}",
+                                    chunkIdx,
+                                    totalChunks );
+
+                    resultHash.AppendDigest( outputHashes[i] );
+                    chunkhashes.emplace_back( outputHashes[i].begin(), outputHashes[i].end() );
+
+                    // Update progress: round to 2 decimal places
+                    m_progress = std::round(((chunkIdx + 1) * 100.0f / totalChunks) * 100.0f) / 100.0f;
+                }
+
+                throttle.EndChunk();
             }
             ProcessingResult result;
-            result.hash = subTaskResultHash;
+            result.hash = resultHash.GetHashBytes();
             return result;
         //}
-        //return subTaskResultHash;
     }
 
-    std::unique_ptr<MNN::Tensor> MNN_Image::Process(const std::vector<uint8_t>& imgdata, 
-                                                         std::vector<uint8_t>& modelFile, 
-                                                         const int channels, 
-                                                         const int origwidth,
-                                                         const int origheight, 
-                                                         const std::string filename) 
+    std::vector<std::unique_ptr<MNN::Tensor>> MNN_Image::Process(const std::vector<ImagePartView>& images, 
+                                                                      CachedInterpreter& cachedInterpreter, 
+                                                                      const int channels, 
+                                                                      const int origwidth,
+                                                                      const int origheight, 
+                                                                      const int batch,
+                                                                      const std::string filename) 
     {
-        std::vector<uint8_t> ret_vect(imgdata);
-
         // Get Target Width
         const int targetWidth = static_cast<int>((float)origwidth / (float)OUTPUT_STRIDE) * OUTPUT_STRIDE + 1;
         const int targetHeight = static_cast<int>((float)origheight / (float)OUTPUT_STRIDE) * OUTPUT_STRIDE + 1;
@@ -114,29 +190,37 @@ namespace sgns::sgprocessing
         scale.fX = (float)origwidth / (float)targetWidth;
         scale.fY = (float)origheight / (float)targetHeight;
 
-        // Create net and session
-        const void* buffer = static_cast<const void*>( modelFile.data() );
-        auto mnnNet = std::shared_ptr<MNN::Interpreter>( MNN::Interpreter::createFromBuffer( buffer, modelFile.size() ) );
-
-        //auto backendConfig           = new MNN::BackendConfig();
-        //backendConfig->power         = MNN::BackendConfig::Power_Low;
-        //backendConfig->queuePriority = 0.1f;
-
-        MNN::ScheduleConfig netConfig;
-        netConfig.type      = MNN_FORWARD_VULKAN;
-        netConfig.numThread = 4;
-        netConfig.mode = 0;
-        //netConfig.backendConfig = backendConfig;
-        auto session        = mnnNet->createSession( netConfig );
-
-        auto input = mnnNet->getSessionInput( session, nullptr );
-
-        if ( input->elementSize() <= 4 )
+        // Lease a session resized for this chunk size from the shared net
+        auto *mnnNet = cachedInterpreter.Get();
+        auto  lease  = cachedInterpreter.AcquireSession(
+            { targetHeight, targetWidth, batch },
+            [targetWidth, targetHeight, batch]( MNN::Interpreter *net, MNN::Session *session )
+            {
+                auto input = net->getSessionInput( session, nullptr );
+                if ( input->elementSize() <= 4 )
+                {
+                    net->resizeTensor( input, { batch, 3, targetHeight, targetWidth } );
+                    net->resizeSession( session );
+                }
+                else if ( batch > 1 )
+                {
+                    if ( !WindowExecutor::ResizeBatch( net, input, batch ) )
+                    {
+                        return false;
+                    }
+                    net->resizeSession( session );
+                }
+                return true;
+            } );
+        auto session = lease.Get();
+        if ( !session )
         {
-            mnnNet->resizeTensor( input, { 1, 3, targetHeight, targetWidth } );
-            mnnNet->resizeSession( session );
+            m_logger->error( "Failed to create MNN session" );
+            return {};
         }
 
+        auto input = mnnNet->getSessionInput( session, nullptr );
+
         // Preprocess input image
         {
             const float              means[3] = { 127.5f, 127.5f, 127.5f };
@@ -162,7 +246,40 @@ namespace sgns::sgprocessing
             trans.postScale( origwidth, origheight );
 
             pretreat->setMatrix( trans );
-            pretreat->convert( ret_vect.data(), origwidth, origheight, 0, input );
+            if ( batch <= 1 )
+            {
+                pretreat->convert( images[0].data, origwidth, origheight, static_cast<int>( images[0].rowPitch ), input );
+            }
+            else
+            {
+                // Convert each chunk into its own slice of a host batch, unused slices stay zero.
+                // Slices take the per-item shape of the input, which a fixed size model may set.
+                MNN::Tensor batchInput( input, MNN::Tensor::CAFFE );
+                auto        sliceShape = batchInput.shape();
+                if ( sliceShape.empty() || sliceShape[0] != batch )
+                {
+                    m_logger->error( "Model input does not take a batch of {}", batch );
+                    return {};
+                }
+                sliceShape[0] = 1;
+                std::fill( batchInput.host<float>(), batchInput.host<float>() + batchInput.elementSize(), 0.0f );
+
+                std::unique_ptr<MNN::Tensor> slice(
+                    MNN::Tensor::create<float>( sliceShape, nullptr, MNN::Tensor::CAFFE ) );
+                const size_t sliceElements = static_cast<size_t>( slice->elementSize() );
+                for ( size_t i = 0; i < images.size() && i < static_cast<size_t>( batch ); ++i )
+                {
+                    pretreat->convert( images[i].data,
+                                       origwidth,
+                                       origheight,
+                                       static_cast<int>( images[i].rowPitch ),
+                                       slice.get() );
+                    std::memcpy( batchInput.host<float>() + i * sliceElements,
+                                 slice->host<float>(),
+                                 sliceElements * sizeof( float ) );
+                }
+                input->copyFromHostTensor( &batchInput );
+            }
         }
 
         // Log preprocessed input tensor data hash
@@ -180,7 +297,7 @@ namespace sgns::sgprocessing
         auto outputHost   = std::make_unique<MNN::Tensor>( outputTensor, MNN::Tensor::CAFFE );
         outputTensor->copyToHostTensor( outputHost.get() );
 
-        return outputHost;
+        return WindowExecutor::SplitBatch( std::move( outputHost ), static_cast<size_t>( batch ) );
     }
 
 }
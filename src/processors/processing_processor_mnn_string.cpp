@@ -5,6 +5,7 @@
 #include <algorithm>
 #include <cstring>
 #include <openssl/sha.h> // For SHA256_DIGEST_LENGTH
+#include "processors/processing_result_hash.hpp"
 #include "util/sha256.hpp"
 
 namespace sgns::sgprocessing
@@ -13,6 +14,14 @@ namespace sgns::sgprocessing
 
     namespace
     {
+        MNN::ScheduleConfig CreateScheduleConfig()
+        {
+            MNN::ScheduleConfig config;
+            config.type = MNN_FORWARD_VULKAN;  // Use Vulkan backend as requested
+            config.numThread = 4;
+            return config;
+        }
+
         bool TryParseTokenIds( const std::string &text, std::vector<int32_t> &tokenIds )
         {
             std::istringstream stream( text );
@@ -40,17 +49,40 @@ namespace sgns::sgprocessing
         }
     }
 
+    void MNN_String::PrepareModel( gsl::span<const char> modelFile )
+    {
+        InterpreterCache::GetInstance().GetInterpreter( modelFile.data(),
+                                                        modelFile.size(),
+                                                        CreateScheduleConfig(),
+                                                        m_modelDigest );
+    }
+
     ProcessingResult MNN_String::StartProcessing( std::vector<std::vector<uint8_t>> &chunkhashes,
                                                    const sgns::IoDeclaration         &proc,
-                                                   std::vector<char>                 &textData,
-                                                   std::vector<char>                 &modelFile,
+                                                   gsl::span<const char>             textData,
+                                                   gsl::span<const char>             modelFile,
                                                    const std::vector<sgns::Parameter> *parameters )
     {
         (void)parameters;
-        std::vector<uint8_t> modelFile_bytes;
-        modelFile_bytes.assign(modelFile.begin(), modelFile.end());
 
-        std::vector<uint8_t> subTaskResultHash(SHA256_DIGEST_LENGTH);
+        // Configure session
+        const MNN::ScheduleConfig config = CreateScheduleConfig();
+
+        auto interpreter =
+            InterpreterCache::GetInstance().GetInterpreter( modelFile.data(), modelFile.size(), config, m_modelDigest );
+        if ( !interpreter )
+        {
+            m_logger->error( "Failed to create MNN interpreter" );
+            return ProcessingResult{};
+        }
+
+        const auto hashMode = ResultHash::ModeFromParameters( parameters );
+        if ( !hashMode )
+        {
+            m_logger->error( "Unknown resultHash mode, expected \"chain\" or \"merkle-v1\"" );
+            return ProcessingResult{};
+        }
+        ResultHash resultHash( *hashMode );
         
         // Convert text data to string
         std::string inputText( textData.begin(), textData.end() );
@@ -60,8 +92,6 @@ namespace sgns::sgprocessing
         // For string inputs, we process as a single "chunk"
         m_progress = 0.0f;
         
-        std::vector<uint8_t> shahash( SHA256_DIGEST_LENGTH );
-        
         // Default max length (could be extracted from parameters)
         int maxLength = 128;
 
@@ -85,7 +115,7 @@ namespace sgns::sgprocessing
             }
         }
 
-        auto procresults = Process( tokenIds, modelFile_bytes, maxLength );
+        auto procresults = Process( tokenIds, *interpreter, maxLength );
         
         const float *data     = procresults->host<float>();
         size_t       dataSize = procresults->elementSize() * sizeof( float );
@@ -103,102 +133,91 @@ namespace sgns::sgprocessing
             }
             m_logger->info( "{}", sample.str() );
         }
-        shahash               = sgprocmanagersha::sha256( data, dataSize );
-        std::string hashString( shahash.begin(), shahash.end() );
-        chunkhashes.push_back( shahash );
-        
-        std::string combinedHash = std::string(subTaskResultHash.begin(), subTaskResultHash.end()) + hashString;
-        subTaskResultHash = sgprocmanagersha::sha256( combinedHash.c_str(), combinedHash.length() );
+        const auto chunkHash = resultHash.Append( data, dataSize );
+        chunkhashes.emplace_back( chunkHash.begin(), chunkHash.end() );
         
         m_progress = 100.0f;
         
         m_logger->info( "String processing complete" );
         
         ProcessingResult result;
-        result.hash = subTaskResultHash;
+        result.hash = resultHash.GetHashBytes();
 
         if ( procresults && procresults->elementSize() > 0 )
         {
-            const size_t byteCount = procresults->elementSize() * sizeof( float );
-            std::vector<char> outputBytes( byteCount );
-            std::memcpy( outputBytes.data(), data, byteCount );
-
-            result.output_buffers = std::make_shared<std::pair<std::vector<std::string>, std::vector<std::vector<char>>>>();
-            result.output_buffers->first.push_back( "" );
-            result.output_buffers->second.push_back( std::move( outputBytes ) );
+            std::vector<size_t> shape;
+            for ( const int extent : procresults->shape() )
+            {
+                shape.push_back( static_cast<size_t>( extent ) );
+            }
+            OutputBuffer output( OutputBuffer::ElementType::Float32, std::move( shape ) );
+            std::memcpy( output.AsFloats().data(), data, output.GetBytes().size() );
+            result.outputs.push_back( std::move( output ) );
         }
 
         return result;
     }
 
     std::unique_ptr<MNN::Tensor> MNN_String::Process( const std::vector<int32_t> &tokenIds, 
-                                                        std::vector<uint8_t> &modelFile,
+                                                        CachedInterpreter &cachedInterpreter,
                                                         const int maxLength ) 
     {
-        m_logger->info( "Creating MNN interpreter from model file" );
-        
-        // Create MNN interpreter from model bytes
-        auto interpreter = std::shared_ptr<MNN::Interpreter>(
-            MNN::Interpreter::createFromBuffer(modelFile.data(), modelFile.size())
-        );
-        
-        if (!interpreter) {
-            m_logger->error( "Failed to create MNN interpreter" );
-            return std::make_unique<MNN::Tensor>();
-        }
-        
-        // Configure session
-        MNN::ScheduleConfig config;
-        config.type = MNN_FORWARD_VULKAN;  // Use Vulkan backend as requested
-        config.numThread = 4;
-        
-        auto session = interpreter->createSession(config);
+        auto *interpreter = cachedInterpreter.Get();
+        auto  lease       = cachedInterpreter.AcquireSession(
+            { maxLength },
+            [this, maxLength]( MNN::Interpreter *net, MNN::Session *session )
+            {
+                // Get all input tensors - BERT models typically have multiple inputs
+                auto inputTensors = net->getSessionInputAll(session);
+                m_logger->info( "Model has {} input tensor(s)", inputTensors.size() );
+                
+                // Log all input tensor names and shapes
+                for (const auto& inputPair : inputTensors) {
+                    m_logger->info( "Input '{}': shape {}x{}x{}x{}", 
+                                   inputPair.first,
+                                   inputPair.second->batch(), 
+                                   inputPair.second->channel(),
+                                   inputPair.second->height(), 
+                                   inputPair.second->width() );
+                }
+                
+                // Resize all input tensors to [batch=1, sequence_length=maxLength]
+                // BERT models expect: input_ids, attention_mask, token_type_ids (all same shape)
+                for (const auto& inputPair : inputTensors) {
+                    auto tensor = inputPair.second;
+                    if (tensor->elementSize() <= 4) {
+                        m_logger->info( "Resizing '{}' to [1, {}]", inputPair.first, maxLength );
+                        net->resizeTensor( tensor, { 1, maxLength } );
+                    }
+                }
+                net->resizeSession( session );
+                
+                // Log shapes after resize
+                for (const auto& inputPair : inputTensors) {
+                    m_logger->info( "After resize '{}': shape {}x{}x{}x{}", 
+                                   inputPair.first,
+                                   inputPair.second->batch(), 
+                                   inputPair.second->channel(),
+                                   inputPair.second->height(), 
+                                   inputPair.second->width() );
+                }
+                return true;
+            } );
+
+        auto session = lease.Get();
         if (!session) {
             m_logger->error( "Failed to create MNN session" );
             return std::make_unique<MNN::Tensor>();
         }
         
-        // Get all input tensors - BERT models typically have multiple inputs
-        auto inputTensors = interpreter->getSessionInputAll(session);
-        m_logger->info( "Model has {} input tensor(s)", inputTensors.size() );
-        
-        // Log all input tensor names and shapes
-        for (const auto& inputPair : inputTensors) {
-            m_logger->info( "Input '{}': shape {}x{}x{}x{}", 
-                           inputPair.first,
-                           inputPair.second->batch(), 
-                           inputPair.second->channel(),
-                           inputPair.second->height(), 
-                           inputPair.second->width() );
-        }
-        
         // Get the first input tensor (usually input_ids for BERT)
         auto inputTensor = interpreter->getSessionInput(session, nullptr);
         if (!inputTensor) {
             m_logger->error( "Failed to get input tensor" );
             return std::make_unique<MNN::Tensor>();
         }
-        
-        // Resize all input tensors to [batch=1, sequence_length=maxLength]
-        // BERT models expect: input_ids, attention_mask, token_type_ids (all same shape)
-        for (const auto& inputPair : inputTensors) {
-            auto tensor = inputPair.second;
-            if (tensor->elementSize() <= 4) {
-                m_logger->info( "Resizing '{}' to [1, {}]", inputPair.first, maxLength );
-                interpreter->resizeTensor( tensor, { 1, maxLength } );
-            }
-        }
-        interpreter->resizeSession( session );
-        
-        // Log shapes after resize
-        for (const auto& inputPair : inputTensors) {
-            m_logger->info( "After resize '{}': shape {}x{}x{}x{}", 
-                           inputPair.first,
-                           inputPair.second->batch(), 
-                           inputPair.second->channel(),
-                           inputPair.second->height(), 
-                           inputPair.second->width() );
-        }
+
+        auto inputTensors = interpreter->getSessionInputAll(session);
         
         // Fill input tensors with dummy data
         // In production, you would use a proper BERT tokenizer
@@ -7,6 +7,8 @@
 #include <string>
 #include <openssl/sha.h>
 #include "datasplitter/ImageSplitter.hpp"
+#include "processors/processing_result_hash.hpp"
+#include "util/FloatConversion.hpp"
 #include "util/InputTypes.hpp"
 #include "util/sha256.hpp"
 
@@ -16,6 +18,15 @@ namespace sgns::sgprocessing
 
     namespace
     {
+        MNN::ScheduleConfig CreateScheduleConfig()
+        {
+            MNN::ScheduleConfig config;
+            config.type = MNN_FORWARD_CPU;
+            config.numThread = 4;
+            config.backendConfig = nullptr;
+            return config;
+        }
+
         enum class CubeLayout
         {
             FacesInOrder,
@@ -72,54 +83,6 @@ namespace sgns::sgprocessing
             return "faces_in_order";
         }
 
-        float HalfToFloat( uint16_t value )
-        {
-            const uint16_t sign = static_cast<uint16_t>( value >> 15 );
-            const uint16_t exponent = static_cast<uint16_t>( ( value >> 10 ) & 0x1F );
-            const uint16_t mantissa = static_cast<uint16_t>( value & 0x03FF );
-
-            uint32_t sign32 = static_cast<uint32_t>( sign ) << 31;
-            uint32_t exponent32 = 0;
-            uint32_t mantissa32 = 0;
-
-            if ( exponent == 0 )
-            {
-                if ( mantissa == 0 )
-                {
-                    exponent32 = 0;
-                    mantissa32 = 0;
-                }
-                else
-                {
-                    int shift = 0;
-                    uint16_t mant = mantissa;
-                    while ( ( mant & 0x0400 ) == 0 )
-                    {
-                        mant <<= 1;
-                        ++shift;
-                    }
-                    mant &= 0x03FF;
-                    exponent32 = static_cast<uint32_t>( 127 - 15 - shift ) << 23;
-                    mantissa32 = static_cast<uint32_t>( mant ) << 13;
-                }
-            }
-            else if ( exponent == 31 )
-            {
-                exponent32 = 0xFFu << 23;
-                mantissa32 = static_cast<uint32_t>( mantissa ) << 13;
-            }
-            else
-            {
-                exponent32 = static_cast<uint32_t>( exponent + ( 127 - 15 ) ) << 23;
-                mantissa32 = static_cast<uint32_t>( mantissa ) << 13;
-            }
-
-            uint32_t bits = sign32 | exponent32 | mantissa32;
-            float result = 0.0f;
-            std::memcpy( &result, &bits, sizeof( result ) );
-            return result;
-        }
-
         bool HasAnyTexture2DChunkFields( const sgns::Dimensions &dimensions )
         {
             return dimensions.get_block_len() || dimensions.get_block_line_stride() || dimensions.get_block_stride() ||
@@ -136,11 +99,11 @@ namespace sgns::sgprocessing
                 dimensions.get_chunk_count();
         }
 
-        void AppendOutput( std::vector<float> &dest, const MNN::Tensor &tensor )
+        void AppendOutput( std::vector<char> &dest, const MNN::Tensor &tensor )
         {
-            const float *data = tensor.host<float>();
-            const size_t count = tensor.elementSize();
-            dest.insert( dest.end(), data, data + count );
+            const auto  *data = reinterpret_cast<const char *>( tensor.host<float>() );
+            const size_t size = tensor.elementSize() * sizeof( float );
+            dest.insert( dest.end(), data, data + size );
         }
 
         std::vector<uint8_t> ExtractFace( const std::vector<uint8_t> &atlas,
@@ -216,10 +179,7 @@ namespace sgns::sgprocessing
             else
             {
                 const auto *src = reinterpret_cast<const uint16_t *>( image.data() );
-                for ( size_t i = 0; i < total; ++i )
-                {
-                    output[i] = HalfToFloat( src[i] );
-                }
+                ConvertHalfToFloat( gsl::span<const uint16_t>( src, total ), output );
             }
 
             return output;
@@ -249,16 +209,54 @@ namespace sgns::sgprocessing
 
             return output;
         }
+
+        SessionPool::PrepareFunction ImageInputResizer( int width, int height, int channels )
+        {
+            return [width, height, channels]( MNN::Interpreter *interpreter, MNN::Session *session )
+            {
+                auto inputTensor = interpreter->getSessionInput( session, nullptr );
+                if ( !inputTensor )
+                {
+                    return false;
+                }
+
+                if ( inputTensor->getDimensionType() == MNN::Tensor::TENSORFLOW )
+                {
+                    interpreter->resizeTensor( inputTensor, { 1, height, width, channels } );
+                }
+                else
+                {
+                    interpreter->resizeTensor( inputTensor, { 1, channels, height, width } );
+                }
+                interpreter->resizeSession( session );
+                return true;
+            };
+        }
+    }
+
+    void MNN_TextureCube::PrepareModel( gsl::span<const char> modelFile )
+    {
+        InterpreterCache::GetInstance().GetInterpreter( modelFile.data(),
+                                                        modelFile.size(),
+                                                        CreateScheduleConfig(),
+                                                        m_modelDigest );
     }
 
     ProcessingResult MNN_TextureCube::StartProcessing( std::vector<std::vector<uint8_t>> &chunkhashes,
                                                        const sgns::IoDeclaration         &proc,
-                                                       std::vector<char>                 &cubeData,
-                                                       std::vector<char>                 &modelFile,
+                                                       gsl::span<const char>             cubeData,
+                                                       gsl::span<const char>             modelFile,
                                                        const std::vector<sgns::Parameter> *parameters )
     {
-        std::vector<uint8_t> modelFileBytes;
-        modelFileBytes.assign( modelFile.begin(), modelFile.end() );
+        const MNN::ScheduleConfig config = CreateScheduleConfig();
+
+        auto cachedInterpreter =
+            InterpreterCache::GetInstance().GetInterpreter( modelFile.data(), modelFile.size(), config, m_modelDigest );
+        if ( !cachedInterpreter )
+        {
+            m_logger->error( "Failed to create MNN interpreter from buffer" );
+            return ProcessingResult{};
+        }
 
         if ( !proc.get_dimensions() || !proc.get_dimensions()->get_width() || !proc.get_dimensions()->get_height() )
         {
@@ -346,8 +344,15 @@ namespace sgns::sgprocessing
             }
         }
 
-        std::vector<uint8_t> subTaskResultHash( SHA256_DIGEST_LENGTH );
-        std::vector<float> outputFloats;
+        const auto hashMode = ResultHash::ModeFromParameters( parameters );
+        if ( !hashMode )
+        {
+            m_logger->error( "Unknown resultHash mode, expected \"chain\" or \"merkle-v1\"" );
+            return ProcessingResult{};
+        }
+        ResultHash resultHash( *hashMode );
+        // Face outputs are appended as bytes so the result buffer can take them over without a copy
+        std::vector<char> outputBytes;
         size_t totalChunks = 0;
 
         for ( int faceIndex = 0; faceIndex < 6; ++faceIndex )
@@ -365,10 +370,11 @@ namespace sgns::sgprocessing
                 const auto chunk_subchunk_height = dimensions.get_chunk_subchunk_height().value();
                 const auto chunk_subchunk_width = dimensions.get_chunk_subchunk_width().value();
 
+                // faces outlives both splitters, chunkSplitter views into faceSplitter's part
                 ImageSplitter faceSplitter( face, block_line_stride, block_stride, block_len, channels );
                 const int chunkCount = static_cast<int>( dimensions.get_chunk_count().value() );
 
-                ImageSplitter chunkSplitter( faceSplitter.GetPart( 0 ),
+                ImageSplitter chunkSplitter( faceSplitter.GetPartView( 0 ),
                                              chunk_line_stride,
                                              chunk_stride,
                                              faceSplitter.GetPartHeightActual( 0 ) / chunk_subchunk_height *
@@ -381,20 +387,12 @@ namespace sgns::sgprocessing
                     const int chunkWidth = chunkSplitter.GetPartWidthActual( chunkIdx );
                     const int chunkHeight = chunkSplitter.GetPartHeightActual( chunkIdx );
 
-                    auto interpreter = std::unique_ptr<MNN::Interpreter>(
-                        MNN::Interpreter::createFromBuffer( modelFileBytes.data(), modelFileBytes.size() ) );
-                    if ( !interpreter )
-                    {
-                        m_logger->error( "Failed to create MNN interpreter from buffer" );
-                        return ProcessingResult{};
-                    }
-
-                    MNN::ScheduleConfig config;
-                    config.type = MNN_FORWARD_CPU;
-                    config.numThread = 4;
-                    config.backendConfig = nullptr;
+                    auto *interpreter = cachedInterpreter->Get();
+                    auto  lease       = cachedInterpreter->AcquireSession(
+                        { chunkHeight, chunkWidth, channels },
+                        ImageInputResizer( chunkWidth, chunkHeight, channels ) );
 
-                    auto session = interpreter->createSession( config );
+                    auto session = lease.Get();
                     if ( !session )
                     {
                         m_logger->error( "Failed to create MNN session" );
@@ -409,15 +407,6 @@ namespace sgns::sgprocessing
                     }
 
                     const auto dimType = inputTensor->getDimensionType();
-                    if ( dimType == MNN::Tensor::TENSORFLOW )
-                    {
-                        interpreter->resizeTensor( inputTensor, { 1, chunkHeight, chunkWidth, channels } );
-                    }
-                    else
-                    {
-                        interpreter->resizeTensor( inputTensor, { 1, channels, chunkHeight, chunkWidth } );
-                    }
-                    interpreter->resizeSession( session );
 
                     const auto inputInterleaved = ConvertImageToFloatsInterleaved( chunkData, chunkWidth, chunkHeight, channels );
                     const auto inputFloats = ( dimType == MNN::Tensor::TENSORFLOW ) ? inputInterleaved :
@@ -441,13 +430,10 @@ namespace sgns::sgprocessing
                     const float *data = outputUserTensor->host<float>();
                     const size_t dataSize = outputUserTensor->elementSize() * sizeof( float );
 
-                    auto hash = sgprocmanagersha::sha256( data, dataSize );
-                    chunkhashes.emplace_back( hash.begin(), hash.end() );
-                    std::string combinedHash = std::string( subTaskResultHash.begin(), subTaskResultHash.end() ) +
-                        std::string( hash.begin(), hash.end() );
-                    subTaskResultHash = sgprocmanagersha::sha256( combinedHash.c_str(), combinedHash.length() );
+                    const auto chunkHash = resultHash.Append( data, dataSize );
+                    chunkhashes.emplace_back( chunkHash.begin(), chunkHash.end() );
 
-                    AppendOutput( outputFloats, *outputUserTensor );
+                    AppendOutput( outputBytes, *outputUserTensor );
                     ++totalChunks;
                 }
             }
@@ -465,7 +451,7 @@ namespace sgns::sgprocessing
                     inputFloats = ConvertFloatImageToFloats( floatFace, faceWidth, faceHeight, format );
                 }
 
-                auto outputTensor = Process( inputFloats, modelFileBytes, faceWidth, faceHeight, channels, true );
+                auto outputTensor = Process( inputFloats, *cachedInterpreter, faceWidth, faceHeight, channels, true );
                 if ( !outputTensor )
                 {
                     m_logger->error( "Failed to process textureCube face" );
@@ -475,13 +461,10 @@ namespace sgns::sgprocessing
                 const float *data = outputTensor->host<float>();
                 const size_t dataSize = outputTensor->elementSize() * sizeof( float );
 
-                auto hash = sgprocmanagersha::sha256( data, dataSize );
-                chunkhashes.emplace_back( hash.begin(), hash.end() );
-                std::string combinedHash = std::string( subTaskResultHash.begin(), subTaskResultHash.end() ) +
-                    std::string( hash.begin(), hash.end() );
-                subTaskResultHash = sgprocmanagersha::sha256( combinedHash.c_str(), combinedHash.length() );
+                const auto chunkHash = resultHash.Append( data, dataSize );
+                chunkhashes.emplace_back( chunkHash.begin(), chunkHash.end() );
 
-                AppendOutput( outputFloats, *outputTensor );
+                AppendOutput( outputBytes, *outputTensor );
                 ++totalChunks;
             }
         }
@@ -489,18 +472,14 @@ namespace sgns::sgprocessing
         m_progress = 100.0f;
 
         ProcessingResult result;
-        result.hash = subTaskResultHash;
+        result.hash = resultHash.GetHashBytes();
 
-        if ( !outputFloats.empty() )
+        if ( !outputBytes.empty() )
         {
-            const size_t byteCount = outputFloats.size() * sizeof( float );
-            std::vector<char> outputBytes( byteCount );
-            std::memcpy( outputBytes.data(), outputFloats.data(), byteCount );
-
-            result.output_buffers =
-                std::make_shared<std::pair<std::vector<std::string>, std::vector<std::vector<char>>>>();
-            result.output_buffers->first.push_back( "" );
-            result.output_buffers->second.push_back( std::move( outputBytes ) );
+            const size_t elements = outputBytes.size() / sizeof( float );
+            result.outputs.emplace_back( OutputBuffer::ElementType::Float32,
+                                         std::vector<size_t>{ elements },
+                                         std::move( outputBytes ) );
         }
 
         m_logger->info( "TextureCube processing complete ({} chunks)", totalChunks );
@@ -508,26 +487,17 @@ namespace sgns::sgprocessing
     }
 
     std::unique_ptr<MNN::Tensor> MNN_TextureCube::Process( const std::vector<float> &inputData,
-                                                           std::vector<uint8_t>    &modelFile,
+                                                           CachedInterpreter       &cachedInterpreter,
                                                            int                      width,
                                                            int                      height,
                                                            int                      channels,
                                                            bool                     inputIsInterleaved )
     {
-        auto interpreter = std::unique_ptr<MNN::Interpreter>(
-            MNN::Interpreter::createFromBuffer( modelFile.data(), modelFile.size() ) );
-        if ( !interpreter )
-        {
-            m_logger->error( "Failed to create MNN interpreter from buffer" );
-            return nullptr;
-        }
+        auto *interpreter = cachedInterpreter.Get();
+        auto  lease       = cachedInterpreter.AcquireSession( { height, width, channels },
+                                                              ImageInputResizer( width, height, channels ) );
 
-        MNN::ScheduleConfig config;
-        config.type = MNN_FORWARD_CPU;
-        config.numThread = 4;
-        config.backendConfig = nullptr;
-
-        auto session = interpreter->createSession( config );
+        auto session = lease.Get();
         if ( !session )
         {
             m_logger->error( "Failed to create MNN session" );
@@ -542,15 +512,6 @@ namespace sgns::sgprocessing
         }
 
         const auto dimType = inputTensor->getDimensionType();
-        if ( dimType == MNN::Tensor::TENSORFLOW )
-        {
-            interpreter->resizeTensor( inputTensor, { 1, height, width, channels } );
-        }
-        else
-        {
-            interpreter->resizeTensor( inputTensor, { 1, channels, height, width } );
-        }
-        interpreter->resizeSession( session );
 
         std::vector<float> reordered;
         const std::vector<float> *srcData = &inputData;
@@ -8,7 +8,13 @@
 #include <cstdint>
 #include <cctype>
 #include <cstdlib>
+#include <numeric>
 #include <openssl/sha.h> // For SHA256_DIGEST_LENGTH
+#include "processors/processing_window_executor.hpp"
+#include "processors/processing_result_hash.hpp"
+#include "processors/processing_volume_source.hpp"
+#include "processors/processing_window_stitcher.hpp"
+#include "util/OutputSink.hpp"
 #include "util/sha256.hpp"
 
 namespace sgns::sgprocessing
@@ -17,150 +23,17 @@ namespace sgns::sgprocessing
 
     namespace
     {
-        enum class VolumeLayout
-        {
-            HWD,
-            HDW,
-            WHD,
-            WDH,
-            DHW,
-            DWH
-        };
-
-        std::string ToUpperAscii( std::string value )
-        {
-            std::transform( value.begin(), value.end(), value.begin(),
-                            []( unsigned char c ) { return static_cast<char>( std::toupper( c ) ); } );
-            return value;
-        }
-
-        VolumeLayout ParseLayout( const std::vector<sgns::Parameter> *parameters, const std::string &inputName )
-        {
-            const std::vector<std::string> keys = {
-                inputName + "Layout",
-                inputName + "_layout",
-                "volumeLayout",
-                "layout"
-            };
-
-            if ( parameters )
-            {
-                for ( const auto &key : keys )
-                {
-                    auto it = std::find_if( parameters->begin(), parameters->end(),
-                                            [&key]( const sgns::Parameter &param ) {
-                                                return param.get_name() == key;
-                                            } );
-                    if ( it != parameters->end() && it->get_parameter_default().is_string() )
-                    {
-                        const std::string layout = ToUpperAscii( it->get_parameter_default().get<std::string>() );
-                        if ( layout == "HWD" ) return VolumeLayout::HWD;
-                        if ( layout == "HDW" ) return VolumeLayout::HDW;
-                        if ( layout == "WHD" ) return VolumeLayout::WHD;
-                        if ( layout == "WDH" ) return VolumeLayout::WDH;
-                        if ( layout == "DHW" ) return VolumeLayout::DHW;
-                        if ( layout == "DWH" ) return VolumeLayout::DWH;
-                    }
-                }
-            }
+        // Fewer voxels per thread than this are not worth starting a thread for
+        constexpr size_t MIN_VOXELS_PER_GATHER_WORKER = size_t( 1 ) << 18;
 
-            return VolumeLayout::HWD;
-        }
-
-        const char *LayoutToString( VolumeLayout layout )
+        MNN::ScheduleConfig CreateScheduleConfig()
         {
-            switch ( layout )
-            {
-                case VolumeLayout::HWD:
-                    return "HWD";
-                case VolumeLayout::HDW:
-                    return "HDW";
-                case VolumeLayout::WHD:
-                    return "WHD";
-                case VolumeLayout::WDH:
-                    return "WDH";
-                case VolumeLayout::DHW:
-                    return "DHW";
-                case VolumeLayout::DWH:
-                    return "DWH";
-            }
-            return "HWD";
+            MNN::ScheduleConfig config;
+            config.type = MNN_FORWARD_VULKAN;
+            config.numThread = 4;
+            return config;
         }
 
-        size_t LayoutIndex( VolumeLayout layout,
-                            int h,
-                            int w,
-                            int d,
-                            int height,
-                            int width,
-                            int depth )
-        {
-            switch ( layout )
-            {
-                case VolumeLayout::HWD:
-                    return ( static_cast<size_t>( h ) * width + static_cast<size_t>( w ) ) * depth + static_cast<size_t>( d );
-                case VolumeLayout::HDW:
-                    return ( static_cast<size_t>( h ) * depth + static_cast<size_t>( d ) ) * width + static_cast<size_t>( w );
-                case VolumeLayout::WHD:
-                    return ( static_cast<size_t>( w ) * height + static_cast<size_t>( h ) ) * depth + static_cast<size_t>( d );
-                case VolumeLayout::WDH:
-                    return ( static_cast<size_t>( w ) * depth + static_cast<size_t>( d ) ) * height + static_cast<size_t>( h );
-                case VolumeLayout::DHW:
-                    return ( static_cast<size_t>( d ) * height + static_cast<size_t>( h ) ) * width + static_cast<size_t>( w );
-                case VolumeLayout::DWH:
-                    return ( static_cast<size_t>( d ) * width + static_cast<size_t>( w ) ) * height + static_cast<size_t>( h );
-            }
-
-            return ( static_cast<size_t>( h ) * width + static_cast<size_t>( w ) ) * depth + static_cast<size_t>( d );
-        }
-
-        float HalfToFloat( uint16_t value )
-        {
-            const uint16_t sign = static_cast<uint16_t>( value >> 15 );
-            const uint16_t exponent = static_cast<uint16_t>( ( value >> 10 ) & 0x1F );
-            const uint16_t mantissa = static_cast<uint16_t>( value & 0x03FF );
-
-            uint32_t sign32 = static_cast<uint32_t>( sign ) << 31;
-            uint32_t exponent32 = 0;
-            uint32_t mantissa32 = 0;
-
-            if ( exponent == 0 )
-            {
-                if ( mantissa == 0 )
-                {
-                    exponent32 = 0;
-                    mantissa32 = 0;
-                }
-                else
-                {
-                    int shift = 0;
-                    uint16_t mant = mantissa;
-                    while ( ( mant & 0x0400 ) == 0 )
-                    {
-                        mant <<= 1;
-                        ++shift;
-                    }
-                    mant &= 0x03FF;
-                    exponent32 = static_cast<uint32_t>( 127 - 15 - shift ) << 23;
-                    mantissa32 = static_cast<uint32_t>( mant ) << 13;
-                }
-            }
-            else if ( exponent == 31 )
-            {
-                exponent32 = 0xFFu << 23;
-                mantissa32 = static_cast<uint32_t>( mantissa ) << 13;
-            }
-            else
-            {
-                exponent32 = static_cast<uint32_t>( exponent + ( 127 - 15 ) ) << 23;
-                mantissa32 = static_cast<uint32_t>( mantissa ) << 13;
-            }
-
-            uint32_t bits = sign32 | exponent32 | mantissa32;
-            float result = 0.0f;
-            std::memcpy( &result, &bits, sizeof( result ) );
-            return result;
-        }
         std::string FormatTensorShape( const MNN::Tensor &tensor )
         {
             std::ostringstream out;
@@ -177,42 +50,40 @@ namespace sgns::sgprocessing
             out << "]";
             return out.str();
         }
+    }
 
-        std::vector<int> ComputeWindowStarts( int length, int roi, int stride )
-        {
-            std::vector<int> starts;
-            if ( length <= roi )
-            {
-                starts.push_back( 0 );
-                return starts;
-            }
-
-            const int step = std::max( 1, stride );
-            for ( int pos = 0; pos <= length - roi; pos += step )
-            {
-                starts.push_back( pos );
-            }
-
-            const int last = length - roi;
-            if ( starts.empty() || starts.back() != last )
-            {
-                starts.push_back( last );
-            }
-
-            return starts;
-        }
+    void MNN_Volume::PrepareModel( gsl::span<const char> modelFile )
+    {
+        InterpreterCache::GetInstance().GetInterpreter( modelFile.data(),
+                                                        modelFile.size(),
+                                                        CreateScheduleConfig(),
+                                                        m_modelDigest );
     }
 
     ProcessingResult MNN_Volume::StartProcessing( std::vector<std::vector<uint8_t>> &chunkhashes,
                                                    const sgns::IoDeclaration         &proc,
-                                                   std::vector<char>                 &volumeData,
-                                                   std::vector<char>                 &modelFile,
+                                                   gsl::span<const char>             volumeData,
+                                                   gsl::span<const char>             modelFile,
                                                    const std::vector<sgns::Parameter> *parameters )
     {
-        std::vector<uint8_t> modelFile_bytes;
-        modelFile_bytes.assign(modelFile.begin(), modelFile.end());
+        const MNN::ScheduleConfig config = CreateScheduleConfig();
+        m_logger->info( "Using MNN Vulkan backend" );
+
+        auto interpreter =
+            InterpreterCache::GetInstance().GetInterpreter( modelFile.data(), modelFile.size(), config, m_modelDigest );
+        if ( !interpreter )
+        {
+            m_logger->error( "Failed to create MNN interpreter" );
+            return ProcessingResult{};
+        }
 
-        std::vector<uint8_t> subTaskResultHash(SHA256_DIGEST_LENGTH);
+        const auto hashMode = ResultHash::ModeFromParameters( parameters );
+        if ( !hashMode )
+        {
+            m_logger->error( "Unknown resultHash mode, expected \"chain\" or \"merkle-v1\"" );
+            return ProcessingResult{};
+        }
+        ResultHash resultHash( *hashMode );
 
         if ( !proc.get_dimensions() || !proc.get_dimensions()->get_width() ||
              !proc.get_dimensions()->get_height() || !proc.get_dimensions()->get_chunk_count() )
@@ -252,64 +123,25 @@ namespace sgns::sgprocessing
             return ProcessingResult{};
         }
 
-        const VolumeLayout layout = ParseLayout( parameters, proc.get_name() );
+        if ( !VolumeSource::IsSupportedFormat( format ) )
+        {
+            m_logger->error( "Unsupported texture3D format for volume input" );
+            return ProcessingResult{};
+        }
+
+        const VolumeLayout layout = VolumeSource::ParseLayout( parameters, proc.get_name() );
         m_logger->info( "Texture3D input format: {} | layout: {}",
                 format == sgns::InputFormat::FLOAT16 ? "FLOAT16" : "FLOAT32",
-                LayoutToString( layout ) );
-
-        std::vector<float> volumeFloats;
-        volumeFloats.resize( expectedElements );
+                VolumeSource::LayoutToString( layout ) );
 
-        if ( format == sgns::InputFormat::FLOAT32 && layout == VolumeLayout::HWD )
-        {
-            std::memcpy( volumeFloats.data(), volumeData.data(), expectedBytes );
-        }
-        else
-        {
-            if ( format == sgns::InputFormat::FLOAT32 )
-            {
-                const auto *src = reinterpret_cast<const float *>( volumeData.data() );
-                for ( int h = 0; h < height; ++h )
-                {
-                    for ( int w = 0; w < width; ++w )
-                    {
-                        for ( int d = 0; d < depth; ++d )
-                        {
-                            const size_t srcIndex = LayoutIndex( layout, h, w, d, height, width, depth );
-                            const size_t dstIndex = LayoutIndex( VolumeLayout::HWD, h, w, d, height, width, depth );
-                            volumeFloats[dstIndex] = src[srcIndex];
-                        }
-                    }
-                }
-            }
-            else if ( format == sgns::InputFormat::FLOAT16 )
-            {
-                const auto *src = reinterpret_cast<const uint16_t *>( volumeData.data() );
-                for ( int h = 0; h < height; ++h )
-                {
-                    for ( int w = 0; w < width; ++w )
-                    {
-                        for ( int d = 0; d < depth; ++d )
-                        {
-                            const size_t srcIndex = LayoutIndex( layout, h, w, d, height, width, depth );
-                            const size_t dstIndex = LayoutIndex( VolumeLayout::HWD, h, w, d, height, width, depth );
-                            volumeFloats[dstIndex] = HalfToFloat( src[srcIndex] );
-                        }
-                    }
-                }
-            }
-            else
-            {
-                m_logger->error( "Unsupported texture3D format for volume input" );
-                return ProcessingResult{};
-            }
-        }
+        // Patches are decoded straight from the input, no full float copy of the volume is made
+        const VolumeSource source( volumeData, format, layout, width, height, depth );
 
-        m_logger->info( "Processing volume input (H,W,D): {}x{}x{} ({} floats)",
+        m_logger->info( "Processing volume input (H,W,D): {}x{}x{} ({} voxels)",
                 width,
                 height,
                 depth,
-                volumeFloats.size() );
+                expectedElements );
 
         m_logger->info( "Patch size: {}x{}x{} | Stride: {}x{}x{}",
                 patchWidth,
@@ -321,192 +153,370 @@ namespace sgns::sgprocessing
 
         m_progress = 0.0f;
 
-        std::vector<uint8_t> shahash( SHA256_DIGEST_LENGTH );
+        const auto startsX = WindowStitcher::ComputeWindowStarts( width, patchWidth, strideX );
+        const auto startsY = WindowStitcher::ComputeWindowStarts( height, patchHeight, strideY );
+        const auto startsZ = WindowStitcher::ComputeWindowStarts( depth, patchDepth, strideZ );
+
+        // The patch weight is separable, one kernel per axis. Uniform kernels are all ones, which
+        // keeps the plain average exact.
+        const auto blend   = WindowStitcher::GetBlend( parameters );
+        const auto kernelX = WindowStitcher::GetBlendKernel( blend, patchWidth );
+        const auto kernelY = WindowStitcher::GetBlendKernel( blend, patchHeight );
+        const auto kernelZ = WindowStitcher::GetBlendKernel( blend, patchDepth );
+
+        struct PatchOrigin
+        {
+            int x;
+            int y;
+            int z;
+        };
+        std::vector<PatchOrigin> origins;
+        origins.reserve( startsX.size() * startsY.size() * startsZ.size() );
+        for ( const int z : startsZ )
+        {
+            for ( const int y : startsY )
+            {
+                for ( const int x : startsX )
+                {
+                    origins.push_back( { x, y, z } );
+                }
+            }
+        }
+
+        // Streaming writes finished output rows to a file as soon as no later patch can touch
+        // them, so only one patch height of stitched rows is held instead of the whole volume
+        std::unique_ptr<FileOutputSink> sink;
+        if ( WindowStitcher::IsStreamEnabled( parameters, m_streamDirectory ) )
+        {
+            sink = FileOutputSink::Create( m_streamDirectory );
+            if ( !sink )
+            {
+                m_logger->error( "Cannot create stream output file in {}", m_streamDirectory.string() );
+                return ProcessingResult{};
+            }
+        }
 
-        const auto startsX = ComputeWindowStarts( width, patchWidth, strideX );
-        const auto startsY = ComputeWindowStarts( height, patchHeight, strideY );
-        const auto startsZ = ComputeWindowStarts( depth, patchDepth, strideZ );
+        // Patches run row of patches by row of patches when streaming. Their hashes are still
+        // reported in the original order, so the result hash does not depend on the mode.
+        std::vector<size_t> order( origins.size() );
+        std::iota( order.begin(), order.end(), size_t( 0 ) );
+        if ( sink )
+        {
+            std::stable_sort( order.begin(),
+                              order.end(),
+                              [&origins]( size_t a, size_t b ) { return origins[a].y < origins[b].y; } );
+        }
+        std::vector<sgprocmanagersha::Sha256Digest> patchHashes( origins.size() );
+
+        size_t       batchSize     = GetBatchSize();
+        const size_t patchElements = static_cast<size_t>( patchWidth ) * patchHeight * patchDepth;
+        const size_t gatherThreads = std::max<size_t>( 1, std::thread::hardware_concurrency() );
+        m_logger->info( "Running {} patches in batches of {}", origins.size(), batchSize );
 
         size_t patchIndex = 0;
         int outputChannels = 0;
         int outputHeight = patchHeight;
         int outputWidth = patchWidth;
         int outputDepth = patchDepth;
-        std::vector<float> stitchedOutput;
+
+        // Output row y lives in row slot y % windowRows of the stitched buffers
+        const int          windowRows  = sink ? std::min( patchHeight, height ) : height;
+        const size_t       rowElements = static_cast<size_t>( width ) * depth;
+        OutputBuffer       stitchedBuffer;
+        gsl::span<float>   stitchedOutput;
         std::vector<float> stitchedWeights;
-        for ( const int z : startsZ )
+
+        // Normalize all rows before end, hand them to the sink and clear their slots for reuse
+        int  flushedRows = 0;
+        auto flushRows   = [&]( int end ) -> bool
         {
-            for ( const int y : startsY )
+            for ( ; flushedRows < end; ++flushedRows )
             {
-                for ( const int x : startsX )
+                const size_t slot    = static_cast<size_t>( flushedRows % windowRows );
+                float       *weights = stitchedWeights.data() + slot * rowElements;
+                for ( int c = 0; c < outputChannels; ++c )
                 {
-                    std::vector<float> patch;
-                    patch.resize( static_cast<size_t>( patchWidth ) * patchHeight * patchDepth, 0.0f );
-
-                    for ( int dz = 0; dz < patchDepth; ++dz )
+                    float *values =
+                        stitchedOutput.data() + ( static_cast<size_t>( c ) * windowRows + slot ) * rowElements;
+                    for ( size_t i = 0; i < rowElements; ++i )
                     {
-                        const int srcZ = z + dz;
-                        if ( srcZ >= depth )
-                        {
-                            continue;
-                        }
-                        for ( int dy = 0; dy < patchHeight; ++dy )
+                        if ( weights[i] > 0.0f )
                         {
-                            const int srcY = y + dy;
-                            if ( srcY >= height )
-                            {
-                                continue;
-                            }
-                                                        for ( int dx = 0; dx < patchWidth; ++dx )
-                                                        {
-                                                                const int srcX = x + dx;
-                                                                if ( srcX >= width )
-                                                                {
-                                                                        continue;
-                                                                }
-                                                                const size_t srcIndex =
-                                                                        ( static_cast<size_t>( srcY ) * width +
-                                                                            static_cast<size_t>( srcX ) ) * depth +
-                                                                        static_cast<size_t>( srcZ );
-                                                                const size_t dstIndex =
-                                                                        ( static_cast<size_t>( dy ) * patchWidth +
-                                                                            static_cast<size_t>( dx ) ) * patchDepth +
-                                                                        static_cast<size_t>( dz );
-                                                                patch[dstIndex] = volumeFloats[srcIndex];
-                                                        }
+                            values[i] /= weights[i];
                         }
                     }
+                    const uint64_t offset =
+                        ( static_cast<uint64_t>( c ) * height + static_cast<uint64_t>( flushedRows ) ) * rowElements *
+                        sizeof( float );
+                    if ( !sink->Write( offset,
+                                       gsl::span<const char>( reinterpret_cast<const char *>( values ),
+                                                              rowElements * sizeof( float ) ) ) )
+                    {
+                        m_logger->error( "Failed to write stitched row {} to {}", flushedRows, sink->GetPath() );
+                        return false;
+                    }
+                    std::fill( values, values + rowElements, 0.0f );
+                }
+                std::fill( weights, weights + rowElements, 0.0f );
+            }
+            return true;
+        };
 
-                    auto procresults = Process( patch, modelFile_bytes, patchWidth, patchHeight, patchDepth );
-                    const float *data     = procresults->host<float>();
-                    size_t       dataSize = procresults->elementSize() * sizeof( float );
+        for ( size_t firstPatch = 0; firstPatch < origins.size(); )
+        {
+            const size_t patchCount = std::min( batchSize, origins.size() - firstPatch );
+
+            // A short last batch is padded with zero patches so the session shape stays the same
+            std::vector<float> patches( batchSize * patchElements, 0.0f );
+
+            // Every patch decodes into its own slot and disjoint row ranges of a patch into disjoint parts
+            // of it. With fewer patches than threads, as with the default batch of 1, each patch is split
+            // into row ranges so decoding still runs on several threads.
+            const size_t threadBudget =
+                std::min( gatherThreads, patchCount * patchElements / MIN_VOXELS_PER_GATHER_WORKER );
+            const size_t slicesPerPatch = std::min( static_cast<size_t>( patchHeight ),
+                                                    std::max<size_t>( 1, ( threadBudget + patchCount - 1 ) / patchCount ) );
+            const size_t sliceCount    = patchCount * slicesPerPatch;
+            const size_t gatherWorkers = std::min( threadBudget, sliceCount );
+            auto         gatherPatches = [&]( size_t begin, size_t step )
+            {
+                for ( size_t slice = begin; slice < sliceCount; slice += step )
+                {
+                    const size_t b        = slice / slicesPerPatch;
+                    const size_t part     = slice % slicesPerPatch;
+                    const int    rowBegin = static_cast<int>( part * patchHeight / slicesPerPatch );
+                    const int    rowEnd   = static_cast<int>( ( part + 1 ) * patchHeight / slicesPerPatch );
+                    const auto  &origin   = origins[order[firstPatch + b]];
+                    source.GatherPatchRows( origin.x,
+                                            origin.y,
+                                            origin.z,
+                                            patchWidth,
+                                            patchHeight,
+                                            patchDepth,
+                                            rowBegin,
+                                            rowEnd,
+                                            patches.data() + b * patchElements );
+                }
+            };
 
-                    if ( outputChannels == 0 )
-                    {
-                        const int dims = procresults->dimensions();
-                        if ( dims >= 5 )
-                        {
-                            outputChannels = procresults->length( 1 );
-                            outputHeight = procresults->length( 2 );
-                            outputWidth = procresults->length( 3 );
-                            outputDepth = procresults->length( 4 );
-                        }
-                        else if ( dims == 4 )
-                        {
-                            outputChannels = procresults->length( 0 );
-                            outputHeight = procresults->length( 1 );
-                            outputWidth = procresults->length( 2 );
-                            outputDepth = procresults->length( 3 );
-                        }
-                        else
-                        {
-                            outputChannels = 1;
-                            outputHeight = patchHeight;
-                            outputWidth = patchWidth;
-                            outputDepth = patchDepth;
-                        }
+            if ( gatherWorkers <= 1 )
+            {
+                gatherPatches( 0, 1 );
+            }
+            else
+            {
+                std::vector<std::thread> threads;
+                threads.reserve( gatherWorkers );
+                for ( size_t worker = 0; worker < gatherWorkers; ++worker )
+                {
+                    threads.emplace_back( gatherPatches, worker, gatherWorkers );
+                }
+                for ( auto &thread : threads )
+                {
+                    thread.join();
+                }
+            }
+
+            auto batchResults =
+                Process( patches, *interpreter, patchWidth, patchHeight, patchDepth, static_cast<int>( batchSize ) );
+            if ( batchResults.size() < patchCount )
+            {
+                // Models with a fixed batch of 1 or outputs without a batch dimension fail the first batch
+                if ( firstPatch == 0 && batchSize > 1 )
+                {
+                    m_logger->warn( "Batch of {} patches failed, running the model with batch 1", batchSize );
+                    batchSize = 1;
+                    continue;
+                }
+                m_logger->error( "MNN inference failed for patches {} to {}", firstPatch, firstPatch + patchCount - 1 );
+                return ProcessingResult{};
+            }
+
+            std::vector<sgprocmanagersha::Sha256Input> outputs;
+            outputs.reserve( patchCount );
+            for ( size_t b = 0; b < patchCount; ++b )
+            {
+                outputs.push_back( { batchResults[b]->host<float>(),
+                                     batchResults[b]->elementSize() * sizeof( float ) } );
+            }
+            const auto outputHashes = sgprocmanagersha::sha256Batch( outputs );
+
+            for ( size_t b = 0; b < patchCount; ++b )
+            {
+                const int    x           = origins[order[firstPatch + b]].x;
+                const int    y           = origins[order[firstPatch + b]].y;
+                const int    z           = origins[order[firstPatch + b]].z;
+                MNN::Tensor &procresults = *batchResults[b];
+                const float *data        = procresults.host<float>();
 
-                        stitchedOutput.assign( static_cast<size_t>( outputChannels ) * width * height * depth, 0.0f );
-                        stitchedWeights.assign( static_cast<size_t>( width ) * height * depth, 0.0f );
+                if ( outputChannels == 0 )
+                {
+                    const int dims = procresults.dimensions();
+                    if ( dims >= 5 )
+                    {
+                        outputChannels = procresults.length( 1 );
+                        outputHeight = procresults.length( 2 );
+                        outputWidth = procresults.length( 3 );
+                        outputDepth = procresults.length( 4 );
+                    }
+                    else if ( dims == 4 )
+                    {
+                        outputChannels = procresults.length( 0 );
+                        outputHeight = procresults.length( 1 );
+                        outputWidth = procresults.length( 2 );
+                        outputDepth = procresults.length( 3 );
+                    }
+                    else
+                    {
+                        outputChannels = 1;
+                        outputHeight = patchHeight;
+                        outputWidth = patchWidth;
+                        outputDepth = patchDepth;
                     }
 
+                    // Only outputs the size of their patch can be stitched, otherwise there is no stitched output
                     if ( outputHeight == patchHeight && outputWidth == patchWidth && outputDepth == patchDepth )
                     {
-                        for ( int dy = 0; dy < patchHeight; ++dy )
+                        stitchedBuffer = OutputBuffer( OutputBuffer::ElementType::Float32,
+                                                       { static_cast<size_t>( outputChannels ),
+                                                         static_cast<size_t>( windowRows ),
+                                                         static_cast<size_t>( width ),
+                                                         static_cast<size_t>( depth ) } );
+                        stitchedOutput = stitchedBuffer.AsFloats();
+                        stitchedWeights.assign( static_cast<size_t>( windowRows ) * rowElements, 0.0f );
+                    }
+                    else
+                    {
+                        m_logger->warn( "Patch output {}x{}x{} differs from patch {}x{}x{}, not stitching",
+                                        outputHeight,
+                                        outputWidth,
+                                        outputDepth,
+                                        patchHeight,
+                                        patchWidth,
+                                        patchDepth );
+                    }
+                }
+
+                if ( !stitchedOutput.empty() )
+                {
+                    // Patches arrive sorted by row when streaming, rows above this one are final
+                    if ( sink && !flushRows( y ) )
+                    {
+                        return ProcessingResult{};
+                    }
+
+                    for ( int dy = 0; dy < patchHeight; ++dy )
+                    {
+                        const int outY = y + dy;
+                        if ( outY >= height )
+                        {
+                            continue;
+                        }
+                        const size_t rowSlot = static_cast<size_t>( outY % windowRows );
+                        for ( int dx = 0; dx < patchWidth; ++dx )
                         {
-                            const int outY = y + dy;
-                            if ( outY >= height )
+                            const int outX = x + dx;
+                            if ( outX >= width )
                             {
                                 continue;
                             }
-                            for ( int dx = 0; dx < patchWidth; ++dx )
+                            const float weightYX = kernelY[static_cast<size_t>( dy )] * kernelX[static_cast<size_t>( dx )];
+                            for ( int dz = 0; dz < patchDepth; ++dz )
                             {
-                                const int outX = x + dx;
-                                if ( outX >= width )
+                                const int outZ = z + dz;
+                                if ( outZ >= depth )
                                 {
                                     continue;
                                 }
-                                for ( int dz = 0; dz < patchDepth; ++dz )
+
+                                const size_t weightIndex =
+                                    ( rowSlot * width + static_cast<size_t>( outX ) ) * depth +
+                                    static_cast<size_t>( outZ );
+                                const float weight = weightYX * kernelZ[static_cast<size_t>( dz )];
+                                stitchedWeights[weightIndex] += weight;
+
+                                for ( int c = 0; c < outputChannels; ++c )
                                 {
-                                    const int outZ = z + dz;
-                                    if ( outZ >= depth )
-                                    {
-                                        continue;
-                                    }
-
-                                    const size_t weightIndex =
-                                        ( static_cast<size_t>( outY ) * width + static_cast<size_t>( outX ) ) * depth +
+                                    const size_t srcIndex =
+                                        ( ( static_cast<size_t>( c ) * outputHeight + static_cast<size_t>( dy ) ) *
+                                          outputWidth + static_cast<size_t>( dx ) ) * outputDepth +
+                                        static_cast<size_t>( dz );
+                                    const size_t dstIndex =
+                                        ( static_cast<size_t>( c ) * windowRows + rowSlot ) * width * depth +
+                                        static_cast<size_t>( outX ) * depth +
                                         static_cast<size_t>( outZ );
-                                    stitchedWeights[weightIndex] += 1.0f;
-
-                                    for ( int c = 0; c < outputChannels; ++c )
-                                    {
-                                        const size_t srcIndex =
-                                            ( ( static_cast<size_t>( c ) * outputHeight + static_cast<size_t>( dy ) ) *
-                                              outputWidth + static_cast<size_t>( dx ) ) * outputDepth +
-                                            static_cast<size_t>( dz );
-                                        const size_t dstIndex =
-                                            ( static_cast<size_t>( c ) * height + static_cast<size_t>( outY ) ) * width * depth +
-                                            static_cast<size_t>( outX ) * depth +
-                                            static_cast<size_t>( outZ );
-                                        stitchedOutput[dstIndex] += data[srcIndex];
-                                    }
+                                    stitchedOutput[dstIndex] += data[srcIndex] * weight;
                                 }
                             }
                         }
                     }
+                }
 
-                    if ( patchIndex == 0 )
+                if ( patchIndex == 0 )
+                {
                     {
+                        std::ofstream inputDump( "first_patch_input.raw", std::ios::binary );
+                        if ( inputDump.is_open() )
                         {
-                            std::ofstream inputDump( "first_patch_input.raw", std::ios::binary );
-                            if ( inputDump.is_open() )
-                            {
-                                inputDump.write( reinterpret_cast<const char *>( patch.data() ),
-                                                 static_cast<std::streamsize>( patch.size() * sizeof( float ) ) );
-                                m_logger->info( "Wrote first patch input to first_patch_input.raw" );
-                            }
+                            inputDump.write( reinterpret_cast<const char *>( patches.data() ),
+                                             static_cast<std::streamsize>( patchElements * sizeof( float ) ) );
+                            m_logger->info( "Wrote first patch input to first_patch_input.raw" );
                         }
+                    }
 
-                        std::ostringstream sample;
-                        size_t sampleCount = std::min<size_t>( 16, procresults->elementSize() );
-                        sample << "Output sample (first " << sampleCount << "): ";
-                        for ( size_t i = 0; i < sampleCount; ++i )
+                    std::ostringstream sample;
+                    size_t sampleCount = std::min<size_t>( 16, procresults.elementSize() );
+                    sample << "Output sample (first " << sampleCount << "): ";
+                    for ( size_t i = 0; i < sampleCount; ++i )
+                    {
+                        if ( i > 0 )
                         {
-                            if ( i > 0 )
-                            {
-                                sample << ", ";
-                            }
-                            sample << data[i];
+                            sample << ", ";
                         }
-                        m_logger->info( "{}", sample.str() );
+                        sample << data[i];
+                    }
+                    m_logger->info( "{}", sample.str() );
 
+                    {
+                        std::ofstream outputDump( "first_patch_output.raw", std::ios::binary );
+                        if ( outputDump.is_open() )
                         {
-                            std::ofstream outputDump( "first_patch_output.raw", std::ios::binary );
-                            if ( outputDump.is_open() )
-                            {
-                                outputDump.write( reinterpret_cast<const char *>( data ),
-                                                  static_cast<std::streamsize>( procresults->elementSize() * sizeof( float ) ) );
-                                m_logger->info( "Wrote first patch output to first_patch_output.raw" );
-                            }
+                            outputDump.write( reinterpret_cast<const char *>( data ),
+                                              static_cast<std::streamsize>( procresults.elementSize() * sizeof( float ) ) );
+                            m_logger->info( "Wrote first patch output to first_patch_output.raw" );
                         }
                     }
+                }
 
-                    shahash = sgprocmanagersha::sha256( data, dataSize );
-                    std::string hashString( shahash.begin(), shahash.end() );
-                    chunkhashes.push_back( shahash );
-
-                    std::string combinedHash = std::string(subTaskResultHash.begin(), subTaskResultHash.end()) + hashString;
-                    subTaskResultHash = sgprocmanagersha::sha256( combinedHash.c_str(), combinedHash.length() );
+                patchHashes[order[firstPatch + b]] = outputHashes[b];
 
-                    ++patchIndex;
-                }
+                ++patchIndex;
             }
+            firstPatch += patchCount;
+        }
+
+        for ( const auto &patchHash : patchHashes )
+        {
+            resultHash.AppendDigest( patchHash );
+            chunkhashes.emplace_back( patchHash.begin(), patchHash.end() );
         }
 
         m_progress = 100.0f;
 
-        if ( !stitchedOutput.empty() )
+        if ( sink && !stitchedOutput.empty() )
+        {
+            if ( !flushRows( height ) )
+            {
+                return ProcessingResult{};
+            }
+            if ( !sink->Flush() )
+            {
+                m_logger->error( "Failed to flush stream output {}", sink->GetPath() );
+                return ProcessingResult{};
+            }
+            m_logger->info( "Streamed stitched logits to {}", sink->GetPath() );
+        }
+        else if ( !sink && !stitchedOutput.empty() )
         {
             for ( int c = 0; c < outputChannels; ++c )
             {
@@ -532,86 +542,83 @@ namespace sgns::sgprocessing
                     }
                 }
             }
-
-            std::ofstream outputVolume( "stitched_logits.raw", std::ios::binary );
-            if ( outputVolume.is_open() )
-            {
-                outputVolume.write( reinterpret_cast<const char *>( stitchedOutput.data() ),
-                                    static_cast<std::streamsize>( stitchedOutput.size() * sizeof( float ) ) );
-                m_logger->info( "Wrote stitched logits to stitched_logits.raw" );
-            }
         }
 
         m_logger->info( "Volume processing complete" );
 
         ProcessingResult result;
-        result.hash = subTaskResultHash;
+        result.hash = resultHash.GetHashBytes();
 
-        if ( !stitchedOutput.empty() )
+        // A streamed result is handed out as its spool file, which the output saving moves into place
+        if ( sink && !stitchedOutput.empty() )
         {
-            const size_t byteCount = stitchedOutput.size() * sizeof( float );
-            std::vector<char> outputBytes( byteCount );
-            std::memcpy( outputBytes.data(), stitchedOutput.data(), byteCount );
-
-            result.output_buffers = std::make_shared<std::pair<std::vector<std::string>, std::vector<std::vector<char>>>>();
-            result.output_buffers->first.push_back( "" );
-            result.output_buffers->second.push_back( std::move( outputBytes ) );
+            sink->Keep();
+            result.outputs.push_back( OutputBuffer::FromFile( OutputBuffer::ElementType::Float32,
+                                                              { static_cast<size_t>( outputChannels ),
+                                                                static_cast<size_t>( height ),
+                                                                static_cast<size_t>( width ),
+                                                                static_cast<size_t>( depth ) },
+                                                              sink->GetPath() ) );
+        }
+        else if ( !sink && !stitchedBuffer.Empty() )
+        {
+            result.outputs.push_back( std::move( stitchedBuffer ) );
         }
 
         return result;
     }
 
-    std::unique_ptr<MNN::Tensor> MNN_Volume::Process( const std::vector<float> &volumeData,
-                                                        std::vector<uint8_t> &modelFile,
-                                                        const int width,
-                                                        const int height,
-                                                        const int depth )
+    std::vector<std::unique_ptr<MNN::Tensor>> MNN_Volume::Process( const std::vector<float> &volumeData,
+                                                                     CachedInterpreter &cachedInterpreter,
+                                                                     const int width,
+                                                                     const int height,
+                                                                     const int depth,
+                                                                     const int batch )
     {
-        m_logger->info( "Creating MNN interpreter from model file" );
+        auto *interpreter = cachedInterpreter.Get();
+        auto  lease       = cachedInterpreter.AcquireSession(
+            { batch, 1, height, width, depth },
+            [this, width, height, depth, batch]( MNN::Interpreter *net, MNN::Session *session )
+            {
+                auto inputTensors = net->getSessionInputAll(session);
+                m_logger->info( "Model has {} input tensor(s)", inputTensors.size() );
 
-        auto interpreter = std::shared_ptr<MNN::Interpreter>(
-            MNN::Interpreter::createFromBuffer(modelFile.data(), modelFile.size())
-        );
+                for (const auto& inputPair : inputTensors) {
+                    m_logger->info( "Input '{}': shape {}", 
+                                   inputPair.first,
+                                   FormatTensorShape( *inputPair.second ) );
+                }
 
-        if (!interpreter) {
-            m_logger->error( "Failed to create MNN interpreter" );
-            return std::make_unique<MNN::Tensor>();
-        }
+                for (const auto& inputPair : inputTensors) {
+                    auto tensor = inputPair.second;
+                    if (tensor->elementSize() <= 4) {
+                        m_logger->info( "Resizing '{}' to [{}, 1, {}, {}, {}]", inputPair.first, batch, height, width, depth );
+                        net->resizeTensor( tensor, { batch, 1, height, width, depth } );
+                    }
+                    else if ( batch > 1 ) {
+                        if ( !WindowExecutor::ResizeBatch( net, tensor, batch ) )
+                        {
+                            return false;
+                        }
+                    }
+                }
+                net->resizeSession( session );
 
-        MNN::ScheduleConfig config;
-        config.type = MNN_FORWARD_VULKAN;
-        m_logger->info( "Using MNN Vulkan backend" );
-        config.numThread = 4;
+                for (const auto& inputPair : inputTensors) {
+                    m_logger->info( "After resize '{}': shape {}", 
+                                   inputPair.first,
+                                   FormatTensorShape( *inputPair.second ) );
+                }
+                return true;
+            } );
 
-        auto session = interpreter->createSession(config);
+        auto session = lease.Get();
         if (!session) {
             m_logger->error( "Failed to create MNN session" );
-            return std::make_unique<MNN::Tensor>();
+            return {};
         }
 
         auto inputTensors = interpreter->getSessionInputAll(session);
-        m_logger->info( "Model has {} input tensor(s)", inputTensors.size() );
-
-        for (const auto& inputPair : inputTensors) {
-            m_logger->info( "Input '{}': shape {}", 
-                           inputPair.first,
-                           FormatTensorShape( *inputPair.second ) );
-        }
-
-        for (const auto& inputPair : inputTensors) {
-            auto tensor = inputPair.second;
-            if (tensor->elementSize() <= 4) {
-                m_logger->info( "Resizing '{}' to [1, 1, {}, {}, {}]", inputPair.first, height, width, depth );
-                interpreter->resizeTensor( tensor, { 1, 1, height, width, depth } );
-            }
-        }
-        interpreter->resizeSession( session );
-
-        for (const auto& inputPair : inputTensors) {
-            m_logger->info( "After resize '{}': shape {}", 
-                           inputPair.first,
-                           FormatTensorShape( *inputPair.second ) );
-        }
 
         for (const auto& inputPair : inputTensors) {
             auto tensor = inputPair.second;
@@ -619,7 +626,7 @@ namespace sgns::sgprocessing
 
             auto inputData = inputTensorUser.host<float>();
             const size_t elementCount = inputTensorUser.elementSize();
-            const size_t expectedElements = static_cast<size_t>( width ) * height * depth;
+            const size_t expectedElements = static_cast<size_t>( batch ) * width * height * depth;
             if ( elementCount != expectedElements )
             {
                 m_logger->warn( "Input tensor element count {} does not match expected volume size {}",
@@ -646,7 +653,7 @@ namespace sgns::sgprocessing
         auto outputTensor = interpreter->getSessionOutput(session, nullptr);
         if (!outputTensor) {
             m_logger->error( "Failed to get output tensor" );
-            return std::make_unique<MNN::Tensor>();
+            return {};
         }
 
         m_logger->info( "Output tensor shape: {}", FormatTensorShape( *outputTensor ) );
@@ -656,6 +663,6 @@ namespace sgns::sgprocessing
 
         m_logger->info( "MNN inference complete" );
 
-        return outputHost;
+        return WindowExecutor::SplitBatch( std::move( outputHost ), static_cast<size_t>( batch ) );
     }
 }
@@ -0,0 +1,58 @@
+#include "processors/processing_result_hash.hpp"
+
+#include "processors/processing_parameters.hpp"
+
+namespace sgns::sgprocessing
+{
+    ResultHash::ResultHash( Mode mode ) : mode_( mode )
+    {
+    }
+
+    std::optional<ResultHash::Mode> ResultHash::ModeFromParameters( const std::vector<sgns::Parameter> *parameters )
+    {
+        const auto mode = ProcessingParameters::GetString( parameters, "resultHash", "chain" );
+        if ( mode == "chain" )
+        {
+            return Mode::Chain;
+        }
+        if ( mode == "merkle-v1" )
+        {
+            return Mode::MerkleV1;
+        }
+        return std::nullopt;
+    }
+
+    ResultHash::Mode ResultHash::GetMode() const
+    {
+        return mode_;
+    }
+
+    sgprocmanagersha::Sha256Digest ResultHash::Append( const void *data, size_t dataSize )
+    {
+        const auto chunkHash = hasher_.Digest( data, dataSize );
+        AppendDigest( chunkHash );
+        return chunkHash;
+    }
+
+    void ResultHash::AppendDigest( const sgprocmanagersha::Sha256Digest &chunkHash )
+    {
+        if ( mode_ == Mode::MerkleV1 )
+        {
+            tree_.AppendDigest( chunkHash );
+        }
+        else
+        {
+            chain_.AppendDigest( chunkHash );
+        }
+    }
+
+    std::vector<uint8_t> ResultHash::GetHashBytes() const
+    {
+        if ( mode_ == Mode::MerkleV1 )
+        {
+            const auto root = tree_.GetRoot();
+            return std::vector<uint8_t>( root.begin(), root.end() );
+        }
+        return chain_.GetHashBytes();
+    }
+}
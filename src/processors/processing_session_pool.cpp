@@ -0,0 +1,146 @@
+#include "processors/processing_session_pool.hpp"
+
+namespace sgns::sgprocessing
+{
+    SessionLease::SessionLease( SessionPool &pool, std::vector<int> shape, MNN::Session *session ) :
+        pool_( &pool ), shape_( std::move( shape ) ), session_( session )
+    {
+    }
+
+    SessionLease::~SessionLease()
+    {
+        Reset();
+    }
+
+    SessionLease::SessionLease( SessionLease &&other ) noexcept :
+        pool_( other.pool_ ), shape_( std::move( other.shape_ ) ), session_( other.session_ )
+    {
+        other.pool_    = nullptr;
+        other.session_ = nullptr;
+    }
+
+    SessionLease &SessionLease::operator=( SessionLease &&other ) noexcept
+    {
+        if ( this != &other )
+        {
+            Reset();
+            pool_          = other.pool_;
+            shape_         = std::move( other.shape_ );
+            session_       = other.session_;
+            other.pool_    = nullptr;
+            other.session_ = nullptr;
+        }
+        return *this;
+    }
+
+    void SessionLease::Reset()
+    {
+        if ( pool_ && session_ )
+        {
+            pool_->Release( shape_, session_ );
+        }
+        pool_    = nullptr;
+        session_ = nullptr;
+    }
+
+    SessionPool::SessionPool( MNN::Interpreter *interpreter, const MNN::ScheduleConfig &config, std::mutex &mutex ) :
+        interpreter_( interpreter ), config_( config ), mutex_( mutex )
+    {
+    }
+
+    SessionPool::~SessionPool()
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        for ( auto &[shape, idle] : idle_ )
+        {
+            for ( auto *session : idle.sessions )
+            {
+                interpreter_->releaseSession( session );
+            }
+        }
+        idle_.clear();
+        recent_.clear();
+        idleCount_ = 0;
+    }
+
+    SessionLease SessionPool::Acquire( const std::vector<int> &shape, const PrepareFunction &prepare )
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+
+        auto it = idle_.find( shape );
+        if ( it != idle_.end() && !it->second.sessions.empty() )
+        {
+            auto *session = it->second.sessions.back();
+            it->second.sessions.pop_back();
+            --idleCount_;
+            // Shapes without idle sessions are dropped, Release adds them back as most recent
+            if ( it->second.sessions.empty() )
+            {
+                recent_.erase( it->second.recent );
+                idle_.erase( it );
+            }
+            return SessionLease( *this, shape, session );
+        }
+
+        auto *session = interpreter_->createSession( config_ );
+        if ( !session )
+        {
+            return SessionLease();
+        }
+
+        if ( prepare && !prepare( interpreter_, session ) )
+        {
+            interpreter_->releaseSession( session );
+            return SessionLease();
+        }
+
+        return SessionLease( *this, shape, session );
+    }
+
+    size_t SessionPool::GetIdleCount() const
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        return idleCount_;
+    }
+
+    void SessionPool::SetMaxIdle( size_t maxIdle )
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        maxIdle_ = maxIdle;
+        EvictLocked();
+    }
+
+    void SessionPool::Release( const std::vector<int> &shape, MNN::Session *session )
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        auto                        it = idle_.find( shape );
+        if ( it == idle_.end() )
+        {
+            recent_.push_front( shape );
+            it = idle_.emplace( shape, IdleSessions{ {}, recent_.begin() } ).first;
+        }
+        else
+        {
+            recent_.splice( recent_.begin(), recent_, it->second.recent );
+        }
+        it->second.sessions.push_back( session );
+        ++idleCount_;
+        EvictLocked();
+    }
+
+    void SessionPool::EvictLocked()
+    {
+        while ( idleCount_ > maxIdle_ )
+        {
+            auto it = idle_.find( recent_.back() );
+            interpreter_->releaseSession( it->second.sessions.back() );
+            it->second.sessions.pop_back();
+            --idleCount_;
+            if ( it->second.sessions.empty() )
+            {
+                recent_.pop_back();
+                idle_.erase( it );
+            }
+        }
+    }
+}
@@ -0,0 +1,124 @@
+#include "processors/processing_signal_source.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include "util/FloatConversion.hpp"
+
+namespace sgns::sgprocessing
+{
+    SignalSource::SignalSource( gsl::span<const char> data,
+                                sgns::InputFormat     format,
+                                size_t                elements,
+                                float                 scale,
+                                float                 zeroPoint,
+                                IntegerValues         integerValues ) :
+        data_( data ),
+        format_( format ),
+        elements_( elements ),
+        scale_( scale ),
+        zeroPoint_( zeroPoint ),
+        integerValues_( integerValues )
+    {
+    }
+
+    void SignalSource::Materialize()
+    {
+        if ( format_ == sgns::InputFormat::FLOAT32 || !converted_.empty() || !WaitForValues( 0, elements_ ) )
+        {
+            return;
+        }
+        std::vector<float> converted( elements_ );
+        Convert( 0, converted );
+        converted_ = std::move( converted );
+    }
+
+    size_t SignalSource::Read( size_t first, gsl::span<float> destination ) const
+    {
+        if ( first >= elements_ )
+        {
+            return 0;
+        }
+        const size_t count = std::min( destination.size(), elements_ - first );
+        if ( !converted_.empty() )
+        {
+            std::memcpy( destination.data(), converted_.data() + first, count * sizeof( float ) );
+        }
+        else
+        {
+            if ( !WaitForValues( first, count ) )
+            {
+                return 0;
+            }
+            Convert( first, destination.first( count ) );
+        }
+        return count;
+    }
+
+    bool SignalSource::WaitForValues( size_t first, size_t count ) const
+    {
+        if ( !input_ )
+        {
+            return true;
+        }
+        size_t valueSize = sizeof( float );
+        switch ( format_ )
+        {
+            case sgns::InputFormat::FLOAT16:
+            case sgns::InputFormat::INT16:
+                valueSize = sizeof( int16_t );
+                break;
+            case sgns::InputFormat::INT8:
+                valueSize = sizeof( int8_t );
+                break;
+            default:
+                break;
+        }
+        return input_->WaitFor( ( first + count ) * valueSize );
+    }
+
+    void SignalSource::Convert( size_t first, gsl::span<float> destination ) const
+    {
+        const size_t count = destination.size();
+        switch ( format_ )
+        {
+            case sgns::InputFormat::FLOAT16:
+                ConvertHalfToFloat(
+                    gsl::span<const uint16_t>( reinterpret_cast<const uint16_t *>( data_.data() ) + first, count ),
+                    destination );
+                return;
+            case sgns::InputFormat::INT32:
+                ConvertInt32ToFloat(
+                    gsl::span<const int32_t>( reinterpret_cast<const int32_t *>( data_.data() ) + first, count ),
+                    destination,
+                    scale_,
+                    zeroPoint_ );
+                return;
+            case sgns::InputFormat::INT16:
+                ConvertInt16ToFloat(
+                    gsl::span<const int16_t>( reinterpret_cast<const int16_t *>( data_.data() ) + first, count ),
+                    destination,
+                    scale_,
+                    zeroPoint_ );
+                return;
+            case sgns::InputFormat::INT8:
+            {
+                const auto *src = reinterpret_cast<const int8_t *>( data_.data() ) + first;
+                if ( integerValues_ == IntegerValues::Boolean )
+                {
+                    for ( size_t i = 0; i < count; ++i )
+                    {
+                        destination[i] = ( src[i] != 0 ) ? 1.0f : 0.0f;
+                    }
+                    return;
+                }
+                ConvertInt8ToFloat( gsl::span<const int8_t>( src, count ), destination, scale_, zeroPoint_ );
+                return;
+            }
+            default:
+                // FLOAT32, read in place
+                std::memcpy( destination.data(), data_.data() + first * sizeof( float ), count * sizeof( float ) );
+                return;
+        }
+    }
+}
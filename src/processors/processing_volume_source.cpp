@@ -0,0 +1,304 @@
+#include "processors/processing_volume_source.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include "processors/processing_parameters.hpp"
+#include "util/FloatConversion.hpp"
+
+namespace sgns::sgprocessing
+{
+    namespace
+    {
+        // 16^3 floats of output and at most 16^2 source cache lines per tile fit in L1 and L2
+        constexpr int TILE = 16;
+
+        struct Strides
+        {
+            size_t h;
+            size_t w;
+            size_t d;
+        };
+
+        /** Source element distance between neighbours along each axis. The unit stride is a
+        * compile time constant in every instantiation.
+        */
+        template <VolumeLayout Layout>
+        constexpr Strides SourceStrides( size_t height, size_t width, size_t depth )
+        {
+            if constexpr ( Layout == VolumeLayout::HWD )
+            {
+                return { width * depth, depth, 1 };
+            }
+            else if constexpr ( Layout == VolumeLayout::HDW )
+            {
+                return { depth * width, 1, width };
+            }
+            else if constexpr ( Layout == VolumeLayout::WHD )
+            {
+                return { depth, height * depth, 1 };
+            }
+            else if constexpr ( Layout == VolumeLayout::WDH )
+            {
+                return { 1, depth * height, height };
+            }
+            else if constexpr ( Layout == VolumeLayout::DHW )
+            {
+                return { width, 1, height * width };
+            }
+            else
+            {
+                return { 1, height, width * height };
+            }
+        }
+
+        void DecodeRow( const float *source, float *destination, size_t count )
+        {
+            std::memcpy( destination, source, count * sizeof( float ) );
+        }
+
+        void DecodeRow( const uint16_t *source, float *destination, size_t count )
+        {
+            ConvertHalfToFloat( gsl::span<const uint16_t>( source, count ), gsl::span<float>( destination, count ) );
+        }
+
+        template <VolumeLayout Layout, typename T>
+        void CopyBoxKernel( const T                 *source,
+                            int                      height,
+                            int                      width,
+                            int                      depth,
+                            const VolumeSource::Box &box,
+                            float                   *destination,
+                            size_t                   rowStride,
+                            size_t                   planeStride )
+        {
+            const Strides strides = SourceStrides<Layout>( height, width, depth );
+
+            if constexpr ( Layout == VolumeLayout::HWD || Layout == VolumeLayout::WHD )
+            {
+                // Depth runs are contiguous on both sides, decode them whole
+                const bool wholePlanes = Layout == VolumeLayout::HWD && box.x == 0 && box.width == width &&
+                                         box.z == 0 && box.depth == depth && rowStride == static_cast<size_t>( depth );
+                for ( int h = box.y; h < box.y + box.height; ++h )
+                {
+                    float *plane = destination + static_cast<size_t>( h - box.y ) * planeStride;
+                    if ( wholePlanes )
+                    {
+                        DecodeRow( source + h * strides.h, plane, static_cast<size_t>( width ) * depth );
+                        continue;
+                    }
+                    for ( int w = box.x; w < box.x + box.width; ++w )
+                    {
+                        DecodeRow( source + h * strides.h + w * strides.w + box.z,
+                                   plane + static_cast<size_t>( w - box.x ) * rowStride,
+                                   static_cast<size_t>( box.depth ) );
+                    }
+                }
+                return;
+            }
+
+            // Depth is strided in the source, walk tiles so every source cache line brought in for
+            // one output row is still there for the neighbouring rows
+            for ( int h0 = box.y; h0 < box.y + box.height; h0 += TILE )
+            {
+                const int hEnd = std::min( h0 + TILE, box.y + box.height );
+                for ( int w0 = box.x; w0 < box.x + box.width; w0 += TILE )
+                {
+                    const int wEnd = std::min( w0 + TILE, box.x + box.width );
+                    for ( int d0 = box.z; d0 < box.z + box.depth; d0 += TILE )
+                    {
+                        const int dEnd = std::min( d0 + TILE, box.z + box.depth );
+                        for ( int h = h0; h < hEnd; ++h )
+                        {
+                            for ( int w = w0; w < wEnd; ++w )
+                            {
+                                const T *row = source + h * strides.h + w * strides.w;
+                                float   *out = destination + static_cast<size_t>( h - box.y ) * planeStride +
+                                             static_cast<size_t>( w - box.x ) * rowStride;
+                                if constexpr ( std::is_same_v<T, uint16_t> )
+                                {
+                                    // Gather one tile row of halves so they convert eight at a time
+                                    uint16_t halves[TILE];
+                                    for ( int d = d0; d < dEnd; ++d )
+                                    {
+                                        halves[d - d0] = row[d * strides.d];
+                                    }
+                                    DecodeRow( halves, out + ( d0 - box.z ), static_cast<size_t>( dEnd - d0 ) );
+                                }
+                                else
+                                {
+                                    for ( int d = d0; d < dEnd; ++d )
+                                    {
+                                        out[d - box.z] = row[d * strides.d];
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        template <typename T>
+        void CopyBoxForLayout( VolumeLayout             layout,
+                               const T                 *source,
+                               int                      height,
+                               int                      width,
+                               int                      depth,
+                               const VolumeSource::Box &box,
+                               float                   *destination,
+                               size_t                   rowStride,
+                               size_t                   planeStride )
+        {
+            switch ( layout )
+            {
+                case VolumeLayout::HWD:
+                    return CopyBoxKernel<VolumeLayout::HWD>( source, height, width, depth, box, destination, rowStride, planeStride );
+                case VolumeLayout::HDW:
+                    return CopyBoxKernel<VolumeLayout::HDW>( source, height, width, depth, box, destination, rowStride, planeStride );
+                case VolumeLayout::WHD:
+                    return CopyBoxKernel<VolumeLayout::WHD>( source, height, width, depth, box, destination, rowStride, planeStride );
+                case VolumeLayout::WDH:
+                    return CopyBoxKernel<VolumeLayout::WDH>( source, height, width, depth, box, destination, rowStride, planeStride );
+                case VolumeLayout::DHW:
+                    return CopyBoxKernel<VolumeLayout::DHW>( source, height, width, depth, box, destination, rowStride, planeStride );
+                case VolumeLayout::DWH:
+                    return CopyBoxKernel<VolumeLayout::DWH>( source, height, width, depth, box, destination, rowStride, planeStride );
+            }
+        }
+    }
+
+    VolumeSource::VolumeSource( gsl::span<const char> data,
+                                sgns::InputFormat     format,
+                                VolumeLayout          layout,
+                                int                   width,
+                                int                   height,
+                                int                   depth ) :
+        data_( data ), format_( format ), layout_( layout ), width_( width ), height_( height ), depth_( depth )
+    {
+    }
+
+    bool VolumeSource::IsSupportedFormat( sgns::InputFormat format )
+    {
+        return format == sgns::InputFormat::FLOAT32 || format == sgns::InputFormat::FLOAT16;
+    }
+
+    VolumeLayout VolumeSource::ParseLayout( const std::vector<sgns::Parameter> *parameters, const std::string &inputName )
+    {
+        const std::vector<std::string> keys = { inputName + "Layout", inputName + "_layout", "volumeLayout", "layout" };
+        for ( const auto &key : keys )
+        {
+            std::string layout = ProcessingParameters::GetString( parameters, key, "" );
+            std::transform( layout.begin(),
+                            layout.end(),
+                            layout.begin(),
+                            []( unsigned char c ) { return static_cast<char>( std::toupper( c ) ); } );
+            if ( layout == "HWD" ) return VolumeLayout::HWD;
+            if ( layout == "HDW" ) return VolumeLayout::HDW;
+            if ( layout == "WHD" ) return VolumeLayout::WHD;
+            if ( layout == "WDH" ) return VolumeLayout::WDH;
+            if ( layout == "DHW" ) return VolumeLayout::DHW;
+            if ( layout == "DWH" ) return VolumeLayout::DWH;
+        }
+        return VolumeLayout::HWD;
+    }
+
+    const char *VolumeSource::LayoutToString( VolumeLayout layout )
+    {
+        switch ( layout )
+        {
+            case VolumeLayout::HWD:
+                return "HWD";
+            case VolumeLayout::HDW:
+                return "HDW";
+            case VolumeLayout::WHD:
+                return "WHD";
+            case VolumeLayout::WDH:
+                return "WDH";
+            case VolumeLayout::DHW:
+                return "DHW";
+            case VolumeLayout::DWH:
+                return "DWH";
+        }
+        return "HWD";
+    }
+
+    void VolumeSource::GatherPatch( int    x,
+                                    int    y,
+                                    int    z,
+                                    int    patchWidth,
+                                    int    patchHeight,
+                                    int    patchDepth,
+                                    float *patch ) const
+    {
+        GatherPatchRows( x, y, z, patchWidth, patchHeight, patchDepth, 0, patchHeight, patch );
+    }
+
+    void VolumeSource::GatherPatchRows( int    x,
+                                        int    y,
+                                        int    z,
+                                        int    patchWidth,
+                                        int    patchHeight,
+                                        int    patchDepth,
+                                        int    rowBegin,
+                                        int    rowEnd,
+                                        float *patch ) const
+    {
+        const size_t rowStride   = static_cast<size_t>( patchDepth );
+        const size_t planeStride = static_cast<size_t>( patchWidth ) * patchDepth;
+
+        rowBegin = std::max( rowBegin, 0 );
+        rowEnd   = std::min( rowEnd, patchHeight );
+        if ( rowBegin >= rowEnd )
+        {
+            return;
+        }
+        float *rows = patch + static_cast<size_t>( rowBegin ) * planeStride;
+
+        const Box box{ x,
+                       y + rowBegin,
+                       z,
+                       std::min( patchWidth, width_ - x ),
+                       std::min( rowEnd - rowBegin, height_ - y - rowBegin ),
+                       std::min( patchDepth, depth_ - z ) };
+        if ( box.width < patchWidth || box.height < rowEnd - rowBegin || box.depth < patchDepth )
+        {
+            std::fill( rows, rows + planeStride * static_cast<size_t>( rowEnd - rowBegin ), 0.0f );
+        }
+        if ( box.width <= 0 || box.height <= 0 || box.depth <= 0 )
+        {
+            return;
+        }
+        CopyBox( box, rows, rowStride, planeStride );
+    }
+
+    void VolumeSource::CopyBox( const Box &box, float *destination, size_t rowStride, size_t planeStride ) const
+    {
+        if ( format_ == sgns::InputFormat::FLOAT16 )
+        {
+            CopyBoxForLayout( layout_,
+                              reinterpret_cast<const uint16_t *>( data_.data() ),
+                              height_,
+                              width_,
+                              depth_,
+                              box,
+                              destination,
+                              rowStride,
+                              planeStride );
+        }
+        else
+        {
+            CopyBoxForLayout( layout_,
+                              reinterpret_cast<const float *>( data_.data() ),
+                              height_,
+                              width_,
+                              depth_,
+                              box,
+                              destination,
+                              rowStride,
+                              planeStride );
+        }
+    }
+}
@@ -0,0 +1,302 @@
+#include "processors/processing_window_executor.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include "processors/processing_parameters.hpp"
+#include "util/sgprocmgr-logger.hpp"
+
+namespace sgns::sgprocessing
+{
+    namespace
+    {
+        const sgns::sgprocmanager::Logger &GetLogger()
+        {
+            static const auto logger = sgns::sgprocmanager::createLogger( "WindowExecutor" );
+            return logger;
+        }
+
+        /** Run a batch task, turning an exception from MNN or an allocation into a failed batch so it
+        * never escapes a worker thread
+        */
+        std::vector<std::unique_ptr<MNN::Tensor>> RunTask( const WindowExecutor::BatchTask &task,
+                                                           size_t                           firstWindow,
+                                                           size_t                           windowCount,
+                                                           size_t                           batchSize )
+        {
+            try
+            {
+                return task( firstWindow, windowCount, batchSize );
+            }
+            catch ( const std::exception &e )
+            {
+                GetLogger()->error( "Inference of windows {}-{} failed: {}",
+                                    firstWindow,
+                                    firstWindow + windowCount - 1,
+                                    e.what() );
+            }
+            catch ( ... )
+            {
+                GetLogger()->error( "Inference of windows {}-{} failed with an unknown exception",
+                                    firstWindow,
+                                    firstWindow + windowCount - 1 );
+            }
+            return {};
+        }
+    }
+
+    WindowExecutor::WindowExecutor( size_t workerCount, size_t windowsInFlight ) :
+        workerCount_( std::max<size_t>( 1, workerCount ) ), windowsInFlight_( std::max<size_t>( 1, windowsInFlight ) )
+    {
+    }
+
+    bool WindowExecutor::Run( size_t windowCount, const WindowTask &task, const MergeFunction &merge ) const
+    {
+        return RunBatched( windowCount,
+                           1,
+                           [&task]( size_t firstWindow, size_t, size_t )
+                           {
+                               std::vector<std::unique_ptr<MNN::Tensor>> outputs;
+                               auto                                      output = task( firstWindow );
+                               if ( output )
+                               {
+                                   outputs.push_back( std::move( output ) );
+                               }
+                               return outputs;
+                           },
+                           merge );
+    }
+
+    bool WindowExecutor::RunBatched( size_t               windowCount,
+                                     size_t               batchSize,
+                                     const BatchTask     &task,
+                                     const MergeFunction &merge ) const
+    {
+        using BatchOutputs = std::vector<std::unique_ptr<MNN::Tensor>>;
+
+        batchSize               = std::max<size_t>( 1, batchSize );
+        const size_t batchCount = ( windowCount + batchSize - 1 ) / batchSize;
+        const size_t workers    = std::min( workerCount_, batchCount );
+
+        auto windowsInBatch = [&]( size_t batchIndex )
+        { return std::min( batchSize, windowCount - batchIndex * batchSize ); };
+
+        // Merge the windows of one batch in order, false if the batch failed or merge aborted
+        auto mergeBatch = [&]( size_t batchIndex, BatchOutputs &outputs )
+        {
+            const size_t count = windowsInBatch( batchIndex );
+            if ( outputs.size() < count )
+            {
+                return false;
+            }
+            try
+            {
+                for ( size_t i = 0; i < count; ++i )
+                {
+                    if ( !outputs[i] || !merge( batchIndex * batchSize + i, *outputs[i] ) )
+                    {
+                        return false;
+                    }
+                }
+            }
+            catch ( const std::exception &e )
+            {
+                // Workers may still be running, they have to be stopped and joined before returning
+                GetLogger()->error( "Merging batch {} failed: {}", batchIndex, e.what() );
+                return false;
+            }
+            catch ( ... )
+            {
+                GetLogger()->error( "Merging batch {} failed with an unknown exception", batchIndex );
+                return false;
+            }
+            return true;
+        };
+
+        // The first batch shows whether the model runs batches at all. Models with a fixed batch of 1
+        // or outputs without a batch dimension fail it, and the whole run falls back to batch 1.
+        size_t firstBatch = 0;
+        if ( batchSize > 1 && batchCount > 0 )
+        {
+            auto outputs = RunTask( task, 0, windowsInBatch( 0 ), batchSize );
+            if ( outputs.size() < windowsInBatch( 0 ) )
+            {
+                GetLogger()->warn( "Batch of {} windows failed, running the model with batch 1", batchSize );
+                return RunBatched( windowCount, 1, task, merge );
+            }
+            if ( !mergeBatch( 0, outputs ) )
+            {
+                return false;
+            }
+            firstBatch = 1;
+        }
+
+        if ( workers <= 1 )
+        {
+            for ( size_t batchIndex = firstBatch; batchIndex < batchCount; ++batchIndex )
+            {
+                auto outputs = RunTask( task, batchIndex * batchSize, windowsInBatch( batchIndex ), batchSize );
+                if ( !mergeBatch( batchIndex, outputs ) )
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Results wait in a ring of slots until merged, so workers can only run ahead of the
+        // merge cursor by the ring size and memory stays bounded on long inputs.
+        const size_t              capacity = workers * windowsInFlight_;
+        std::vector<BatchOutputs> slots( capacity );
+        std::vector<bool>         ready( capacity, false );
+        std::mutex                mutex;
+        std::condition_variable   condition;
+        size_t                    nextBatch = firstBatch;
+        size_t                    mergeCursor = firstBatch;
+        bool                      aborted = false;
+
+        auto worker = [&]()
+        {
+            while ( true )
+            {
+                size_t batchIndex = 0;
+                {
+                    std::unique_lock<std::mutex> lock( mutex );
+                    condition.wait( lock,
+                                    [&]
+                                    {
+                                        return aborted || nextBatch >= batchCount ||
+                                               nextBatch < mergeCursor + capacity;
+                                    } );
+                    if ( aborted || nextBatch >= batchCount )
+                    {
+                        return;
+                    }
+                    batchIndex = nextBatch++;
+                }
+
+                auto outputs = RunTask( task, batchIndex * batchSize, windowsInBatch( batchIndex ), batchSize );
+
+                std::lock_guard<std::mutex> lock( mutex );
+                slots[batchIndex % capacity] = std::move( outputs );
+                ready[batchIndex % capacity] = true;
+                condition.notify_all();
+            }
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve( workers );
+        for ( size_t i = 0; i < workers; ++i )
+        {
+            threads.emplace_back( worker );
+        }
+
+        bool success = true;
+        for ( size_t batchIndex = firstBatch; batchIndex < batchCount; ++batchIndex )
+        {
+            BatchOutputs outputs;
+            {
+                std::unique_lock<std::mutex> lock( mutex );
+                condition.wait( lock, [&] { return ready[batchIndex % capacity]; } );
+                outputs                      = std::move( slots[batchIndex % capacity] );
+                ready[batchIndex % capacity] = false;
+                mergeCursor                  = batchIndex + 1;
+            }
+            condition.notify_all();
+
+            if ( !mergeBatch( batchIndex, outputs ) )
+            {
+                success = false;
+                break;
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            aborted = !success;
+        }
+        condition.notify_all();
+
+        for ( auto &thread : threads )
+        {
+            thread.join();
+        }
+
+        return success;
+    }
+
+    std::vector<std::unique_ptr<MNN::Tensor>> WindowExecutor::SplitBatch( std::unique_ptr<MNN::Tensor> output,
+                                                                          size_t                       batchSize )
+    {
+        std::vector<std::unique_ptr<MNN::Tensor>> outputs;
+        if ( !output )
+        {
+            return outputs;
+        }
+        if ( batchSize <= 1 )
+        {
+            outputs.push_back( std::move( output ) );
+            return outputs;
+        }
+
+        auto shape = output->shape();
+        if ( shape.empty() || static_cast<size_t>( shape[0] ) != batchSize )
+        {
+            return outputs;
+        }
+        shape[0] = 1;
+
+        const size_t sliceElements = static_cast<size_t>( output->elementSize() ) / batchSize;
+        const float *src           = output->host<float>();
+        outputs.reserve( batchSize );
+        for ( size_t b = 0; b < batchSize; ++b )
+        {
+            auto slice = std::unique_ptr<MNN::Tensor>(
+                MNN::Tensor::create<float>( shape, nullptr, output->getDimensionType() ) );
+            std::memcpy( slice->host<float>(), src + b * sliceElements, sliceElements * sizeof( float ) );
+            outputs.push_back( std::move( slice ) );
+        }
+        return outputs;
+    }
+
+    bool WindowExecutor::ResizeBatch( MNN::Interpreter *interpreter, MNN::Tensor *input, int batchSize )
+    {
+        if ( !input || input->dimensions() == 0 )
+        {
+            return false;
+        }
+        auto shape = input->shape();
+        shape[0]   = batchSize;
+        interpreter->resizeTensor( input, shape );
+        return true;
+    }
+
+    size_t WindowExecutor::GetWorkerCount( const std::vector<sgns::Parameter> *parameters, int sessionThreads )
+    {
+        // More sessions than the cores can run only adds memory and contention
+        const unsigned int hardwareThreads = std::thread::hardware_concurrency();
+        const size_t       maxWorkers =
+            hardwareThreads == 0
+                ? 1
+                : std::max<size_t>( 1, hardwareThreads / static_cast<size_t>( std::max( 1, sessionThreads ) ) );
+
+        const int requested = ProcessingParameters::GetInt( parameters, "parallelWorkers", 0 );
+        if ( requested > 0 )
+        {
+            if ( static_cast<size_t>( requested ) > maxWorkers )
+            {
+                GetLogger()->warn( "parallelWorkers {} exceeds {} hardware threads / {} session threads, using {}",
+                                   requested,
+                                   hardwareThreads,
+                                   sessionThreads,
+                                   maxWorkers );
+                return maxWorkers;
+            }
+            return static_cast<size_t>( requested );
+        }
+        return maxWorkers;
+    }
+}
@@ -0,0 +1,490 @@
+#include "processors/processing_window_stitcher.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numbers>
+#include "processors/processing_parameters.hpp"
+#include "util/sgprocmgr-logger.hpp"
+
+namespace sgns::sgprocessing
+{
+    namespace
+    {
+        const sgns::sgprocmanager::Logger &GetLogger()
+        {
+            static const auto logger = sgns::sgprocmanager::createLogger( "WindowStitcher" );
+            return logger;
+        }
+
+        void AddRow( float *__restrict destination, const float *__restrict source, size_t count )
+        {
+            for ( size_t i = 0; i < count; ++i )
+            {
+                destination[i] += source[i];
+            }
+        }
+
+        void AddWeightedRow( float *__restrict destination,
+                             const float *__restrict source,
+                             const float *__restrict weights,
+                             size_t count )
+        {
+            for ( size_t i = 0; i < count; ++i )
+            {
+                destination[i] += source[i] * weights[i];
+            }
+        }
+
+        void AddStrided( float *destination, const float *source, const float *weights, size_t count, size_t sourceStride )
+        {
+            if ( sourceStride == 1 )
+            {
+                if ( weights )
+                {
+                    AddWeightedRow( destination, source, weights, count );
+                }
+                else
+                {
+                    AddRow( destination, source, count );
+                }
+                return;
+            }
+            for ( size_t i = 0; i < count; ++i )
+            {
+                destination[i] += weights ? source[i * sourceStride] * weights[i] : source[i * sourceStride];
+            }
+        }
+    }
+
+    WindowStitcher::WindowStitcher( std::vector<int> starts, int length, int windowLength, Blend blend, Layout layout ) :
+        starts_( std::move( starts ) ),
+        length_( length ),
+        windowLength_( windowLength ),
+        layout_( layout ),
+        capacity_( static_cast<size_t>( length ) ),
+        coverage_( static_cast<size_t>( length ), 0.0f )
+    {
+        if ( blend != Blend::Uniform )
+        {
+            kernel_ = GetBlendKernel( blend, windowLength_ );
+        }
+    }
+
+    WindowStitcher::Blend WindowStitcher::GetBlend( const std::vector<sgns::Parameter> *parameters )
+    {
+        const auto blend = ProcessingParameters::GetString( parameters, "stitchBlend", "uniform" );
+        if ( blend == "gaussian" )
+        {
+            return Blend::Gaussian;
+        }
+        if ( blend == "hann" )
+        {
+            return Blend::Hann;
+        }
+        return Blend::Uniform;
+    }
+
+    std::vector<float> WindowStitcher::GetBlendKernel( Blend blend, int windowLength )
+    {
+        std::vector<float> kernel( static_cast<size_t>( std::max( windowLength, 0 ) ), 1.0f );
+        const double       center = 0.5 * windowLength;
+        for ( int i = 0; i < windowLength; ++i )
+        {
+            // Sample at position centers so the kernel is symmetric and never exactly zero
+            const double position = i + 0.5;
+            if ( blend == Blend::Gaussian )
+            {
+                const double sigma    = windowLength / 8.0;
+                const double distance = ( position - center ) / sigma;
+                kernel[static_cast<size_t>( i )] = static_cast<float>( std::exp( -0.5 * distance * distance ) );
+            }
+            else if ( blend == Blend::Hann )
+            {
+                kernel[static_cast<size_t>( i )] =
+                    static_cast<float>( 0.5 - 0.5 * std::cos( 2.0 * std::numbers::pi * position / windowLength ) );
+            }
+        }
+        return kernel;
+    }
+
+    std::vector<int> WindowStitcher::ComputeWindowStarts( int length, int roi, int stride )
+    {
+        std::vector<int> starts;
+        if ( length <= roi )
+        {
+            starts.push_back( 0 );
+            return starts;
+        }
+
+        const int step = std::max( 1, stride );
+        for ( int pos = 0; pos <= length - roi; pos += step )
+        {
+            starts.push_back( pos );
+        }
+
+        const int last = length - roi;
+        if ( starts.empty() || starts.back() != last )
+        {
+            starts.push_back( last );
+        }
+
+        return starts;
+    }
+
+    bool WindowStitcher::IsStreamEnabled( const std::vector<sgns::Parameter> *parameters,
+                                          const std::filesystem::path        &directory )
+    {
+        if ( ProcessingParameters::Find( parameters, "streamOutputPath" ) )
+        {
+            GetLogger()->warn( "Ignoring streamOutputPath, streamed outputs go to the declared outputs" );
+        }
+        if ( ProcessingParameters::GetInt( parameters, "streamOutput", 0 ) != 1 )
+        {
+            return false;
+        }
+        if ( directory.empty() )
+        {
+            GetLogger()->warn( "Streaming requested but not available to this job, stitching in memory" );
+            return false;
+        }
+        return true;
+    }
+
+    bool WindowStitcher::StreamFromParameters( const std::vector<sgns::Parameter> *parameters,
+                                               const std::filesystem::path        &directory )
+    {
+        if ( !IsStreamEnabled( parameters, directory ) )
+        {
+            return true;
+        }
+        auto sink = FileOutputSink::Create( directory );
+        if ( !sink )
+        {
+            return false;
+        }
+        spool_ = sink.get();
+        StreamTo( std::move( sink ) );
+        return true;
+    }
+
+    void WindowStitcher::StreamTo( std::unique_ptr<OutputSink> sink )
+    {
+        if ( sink.get() != spool_ )
+        {
+            spool_ = nullptr;
+        }
+        sink_     = std::move( sink );
+        capacity_ = static_cast<size_t>( std::max( 1, std::min( windowLength_, length_ ) ) );
+        coverage_.assign( capacity_, 0.0f );
+    }
+
+    bool WindowStitcher::Add( size_t windowIndex, const MNN::Tensor &output )
+    {
+        const int start = starts_[windowIndex];
+        if ( channels_ == 0 )
+        {
+            source_   = GetSourceLayout( output );
+            channels_ = source_.channels;
+            const size_t channels = static_cast<size_t>( channels_ );
+            auto         shape    = layout_ == Layout::ChannelsFirst ? std::vector<size_t>{ channels, capacity_ }
+                                                                     : std::vector<size_t>{ capacity_, channels };
+            output_ = OutputBuffer( OutputBuffer::ElementType::Float32, std::move( shape ) );
+            // Channels first rows of several channels reach the sink interleaved, not in byte order
+            hashWhileWriting_ = layout_ == Layout::ChannelsLast || channels_ == 1;
+        }
+
+        // Windows arrive in order of their start, so no later window reaches the positions before it
+        if ( sink_ && !FlushUntil( start ) )
+        {
+            return false;
+        }
+
+        if ( source_.length != windowLength_ )
+        {
+            return true;
+        }
+
+        // A streamed window can wrap around the end of the slots, add it in at most two runs
+        const float *data  = output.host<float>();
+        const size_t count = static_cast<size_t>( std::min( windowLength_, length_ - start ) );
+        size_t       offset = 0;
+        while ( offset < count )
+        {
+            const size_t slot = ( static_cast<size_t>( start ) + offset ) % capacity_;
+            const size_t run  = std::min( count - offset, capacity_ - slot );
+            AddRun( data, offset, slot, run );
+            offset += run;
+        }
+        return true;
+    }
+
+    void WindowStitcher::AddRun( const float *data, size_t offset, size_t slot, size_t count )
+    {
+        const size_t channels = static_cast<size_t>( channels_ );
+        const float *weights  = kernel_.empty() ? nullptr : kernel_.data() + offset;
+        const float *source   = data + offset * source_.positionStride;
+
+        for ( size_t i = 0; i < count; ++i )
+        {
+            coverage_[slot + i] += weights ? weights[i] : 1.0f;
+        }
+
+        if ( layout_ == Layout::ChannelsFirst )
+        {
+            for ( size_t c = 0; c < channels; ++c )
+            {
+                AddStrided( Values() + c * capacity_ + slot,
+                            source + c * source_.channelStride,
+                            weights,
+                            count,
+                            source_.positionStride );
+            }
+            return;
+        }
+
+        float *destination = Values() + slot * channels;
+        if ( !weights && source_.channelStride == 1 && source_.positionStride == channels )
+        {
+            // Channels last on both sides, the whole run is contiguous
+            AddRow( destination, source, count * channels );
+            return;
+        }
+        for ( size_t i = 0; i < count; ++i )
+        {
+            const float weight = weights ? weights[i] : 1.0f;
+            for ( size_t c = 0; c < channels; ++c )
+            {
+                destination[i * channels + c] += source[c * source_.channelStride + i * source_.positionStride] * weight;
+            }
+        }
+    }
+
+    bool WindowStitcher::FlushUntil( int end )
+    {
+        const size_t channels = static_cast<size_t>( channels_ );
+        while ( flushed_ < end )
+        {
+            const size_t slot = static_cast<size_t>( flushed_ ) % capacity_;
+            const size_t run  = std::min( static_cast<size_t>( end - flushed_ ), capacity_ - slot );
+
+            // Dividing by one leaves an uncovered position untouched, so the division needs no branch
+            float *coverage = coverage_.data() + slot;
+            for ( size_t i = 0; i < run; ++i )
+            {
+                if ( coverage[i] <= 0.0f )
+                {
+                    coverage[i] = 1.0f;
+                }
+            }
+            if ( layout_ == Layout::ChannelsFirst )
+            {
+                for ( size_t c = 0; c < channels; ++c )
+                {
+                    float *row = Values() + c * capacity_ + slot;
+                    for ( size_t i = 0; i < run; ++i )
+                    {
+                        row[i] /= coverage[i];
+                    }
+                }
+            }
+            else
+            {
+                float *values = Values() + slot * channels;
+                for ( size_t i = 0; i < run; ++i )
+                {
+                    for ( size_t c = 0; c < channels; ++c )
+                    {
+                        values[i * channels + c] /= coverage[i];
+                    }
+                }
+            }
+
+            if ( sink_ )
+            {
+                if ( !WriteRun( flushed_, slot, run ) )
+                {
+                    return false;
+                }
+                // The slots are reused for the positions one capacity further on
+                std::fill( coverage, coverage + run, 0.0f );
+                if ( layout_ == Layout::ChannelsFirst )
+                {
+                    for ( size_t c = 0; c < channels; ++c )
+                    {
+                        std::fill_n( Values() + c * capacity_ + slot, run, 0.0f );
+                    }
+                }
+                else
+                {
+                    std::fill_n( Values() + slot * channels, run * channels, 0.0f );
+                }
+            }
+            flushed_ += static_cast<int>( run );
+        }
+        return true;
+    }
+
+    bool WindowStitcher::WriteRun( int position, size_t slot, size_t count )
+    {
+        const size_t channels = static_cast<size_t>( channels_ );
+        if ( layout_ == Layout::ChannelsFirst )
+        {
+            for ( size_t c = 0; c < channels; ++c )
+            {
+                const gsl::span<const char> bytes( reinterpret_cast<const char *>( Values() + c * capacity_ + slot ),
+                                                   count * sizeof( float ) );
+                const uint64_t offset = ( static_cast<uint64_t>( c ) * length_ + position ) * sizeof( float );
+                if ( !sink_->Write( offset, bytes ) )
+                {
+                    return false;
+                }
+                if ( hashWhileWriting_ )
+                {
+                    hasher_.Update( bytes.data(), bytes.size() );
+                }
+            }
+            return true;
+        }
+
+        const gsl::span<const char> bytes( reinterpret_cast<const char *>( Values() + slot * channels ),
+                                           count * channels * sizeof( float ) );
+        if ( !sink_->Write( static_cast<uint64_t>( position ) * channels * sizeof( float ), bytes ) )
+        {
+            return false;
+        }
+        hasher_.Update( bytes.data(), bytes.size() );
+        return true;
+    }
+
+    bool WindowStitcher::Finish()
+    {
+        if ( channels_ > 0 && !FlushUntil( length_ ) )
+        {
+            return false;
+        }
+        if ( !sink_ )
+        {
+            return true;
+        }
+        if ( !sink_->Flush() )
+        {
+            return false;
+        }
+        if ( channels_ > 0 && !hashWhileWriting_ && !HashSink() )
+        {
+            return false;
+        }
+        digest_ = hasher_.Finalize();
+        return true;
+    }
+
+    bool WindowStitcher::HashSink()
+    {
+        // Read the finished output back in byte order, a bounded piece at a time
+        constexpr size_t  READ_SIZE = size_t( 1 ) << 20;
+        const uint64_t    total     = static_cast<uint64_t>( channels_ ) * length_ * sizeof( float );
+        std::vector<char> piece( static_cast<size_t>( std::min<uint64_t>( total, READ_SIZE ) ) );
+        for ( uint64_t offset = 0; offset < total; )
+        {
+            const size_t count = static_cast<size_t>( std::min<uint64_t>( total - offset, piece.size() ) );
+            if ( !sink_->Read( offset, gsl::span<char>( piece.data(), count ) ) )
+            {
+                return false;
+            }
+            hasher_.Update( piece.data(), count );
+            offset += count;
+        }
+        return true;
+    }
+
+    sgprocmanagersha::Sha256Digest WindowStitcher::HashOutput()
+    {
+        if ( sink_ )
+        {
+            return digest_;
+        }
+        const auto bytes = output_.GetBytes();
+        return hasher_.Digest( bytes.data(), bytes.size() );
+    }
+
+    OutputBuffer WindowStitcher::TakeOutput()
+    {
+        if ( !sink_ )
+        {
+            return std::move( output_ );
+        }
+        if ( !spool_ || channels_ == 0 )
+        {
+            return {};
+        }
+
+        // The file outlives the sink and belongs to the returned buffer from here on
+        spool_->Keep();
+        std::filesystem::path file     = spool_->GetPath();
+        const size_t          channels = static_cast<size_t>( channels_ );
+        const size_t          length   = static_cast<size_t>( length_ );
+        sink_.reset();
+        spool_ = nullptr;
+        return OutputBuffer::FromFile( OutputBuffer::ElementType::Float32,
+                                       layout_ == Layout::ChannelsFirst ? std::vector<size_t>{ channels, length }
+                                                                        : std::vector<size_t>{ length, channels },
+                                       std::move( file ) );
+    }
+
+    WindowStitcher::SourceLayout WindowStitcher::GetSourceLayout( const MNN::Tensor &tensor )
+    {
+        SourceLayout layout;
+        const int    dims    = tensor.dimensions();
+        const auto   dimType = tensor.getDimensionType();
+
+        if ( dims == 4 )
+        {
+            // The signal runs along the longer of the two spatial axes
+            const bool caffe = dimType == MNN::Tensor::CAFFE;
+            const int  h     = tensor.length( caffe ? 2 : 1 );
+            const int  w     = tensor.length( caffe ? 3 : 2 );
+            layout.channels  = tensor.length( caffe ? 1 : 3 );
+            layout.length    = std::max( h, w );
+
+            const size_t spatialStride = h >= w ? static_cast<size_t>( w ) : 1;
+            if ( caffe )
+            {
+                layout.channelStride  = static_cast<size_t>( h ) * w;
+                layout.positionStride = spatialStride;
+            }
+            else
+            {
+                layout.channelStride  = 1;
+                layout.positionStride = spatialStride * layout.channels;
+            }
+        }
+        else if ( dims == 3 )
+        {
+            if ( dimType == MNN::Tensor::CAFFE )
+            {
+                layout.channels       = tensor.length( 1 );
+                layout.length         = tensor.length( 2 );
+                layout.channelStride  = static_cast<size_t>( layout.length );
+                layout.positionStride = 1;
+            }
+            else
+            {
+                layout.channels       = tensor.length( 2 );
+                layout.length         = tensor.length( 1 );
+                layout.channelStride  = 1;
+                layout.positionStride = static_cast<size_t>( layout.channels );
+            }
+        }
+        else if ( dims == 2 )
+        {
+            layout.length = tensor.length( 1 );
+        }
+        else
+        {
+            layout.length = static_cast<int>( tensor.elementSize() );
+        }
+
+        return layout;
+    }
+}
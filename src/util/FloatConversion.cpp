@@ -0,0 +1,278 @@
+#include "util/FloatConversion.hpp"
+
+#include <cstring>
+
+#if ( defined( __x86_64__ ) || defined( __i386__ ) ) && ( defined( __GNUC__ ) || defined( __clang__ ) )
+#define SGPROCMGR_FLOAT_CONVERSION_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined( __aarch64__ ) || defined( _M_ARM64 )
+#define SGPROCMGR_FLOAT_CONVERSION_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace sgns::sgprocessing
+{
+    namespace
+    {
+        void ConvertHalfToFloatScalar( const uint16_t *input, float *output, size_t count )
+        {
+            for ( size_t i = 0; i < count; ++i )
+            {
+                output[i] = HalfToFloat( input[i] );
+            }
+        }
+
+        template <typename T>
+        void ConvertIntToFloatScalar( const T *input, float *output, size_t count, float scale, float zeroPoint )
+        {
+            for ( size_t i = 0; i < count; ++i )
+            {
+                output[i] = ( static_cast<float>( input[i] ) - zeroPoint ) * scale;
+            }
+        }
+
+#if defined( SGPROCMGR_FLOAT_CONVERSION_X86 )
+        bool OsSavesYmm( unsigned int ecx )
+        {
+            if ( !( ecx & bit_OSXSAVE ) || !( ecx & bit_AVX ) )
+            {
+                return false;
+            }
+            // The OS has to save the upper halves of the YMM registers
+            unsigned int xcr0Low = 0, xcr0High = 0;
+            __asm__( "xgetbv" : "=a"( xcr0Low ), "=d"( xcr0High ) : "c"( 0 ) );
+            return ( xcr0Low & 0x6 ) == 0x6;
+        }
+
+        bool DetectF16c()
+        {
+            unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+            if ( !__get_cpuid( 1, &eax, &ebx, &ecx, &edx ) )
+            {
+                return false;
+            }
+            return ( ecx & bit_F16C ) && OsSavesYmm( ecx );
+        }
+
+        bool DetectAvx2()
+        {
+            unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+            if ( !__get_cpuid( 1, &eax, &ebx, &ecx, &edx ) || !OsSavesYmm( ecx ) )
+            {
+                return false;
+            }
+            if ( !__get_cpuid_count( 7, 0, &eax, &ebx, &ecx, &edx ) )
+            {
+                return false;
+            }
+            return ( ebx & bit_AVX2 ) != 0;
+        }
+
+        bool HasAvx2()
+        {
+            static const bool hasAvx2 = DetectAvx2();
+            return hasAvx2;
+        }
+
+        __attribute__( ( target( "avx,f16c" ) ) ) void ConvertHalfToFloatF16c( const uint16_t *input,
+                                                                               float          *output,
+                                                                               size_t          count )
+        {
+            size_t i = 0;
+            for ( ; i + 8 <= count; i += 8 )
+            {
+                const __m128i halves = _mm_loadu_si128( reinterpret_cast<const __m128i *>( input + i ) );
+                _mm256_storeu_ps( output + i, _mm256_cvtph_ps( halves ) );
+            }
+            ConvertHalfToFloatScalar( input + i, output + i, count - i );
+        }
+
+        // Integers are widened to 32 bits, converted with round to nearest like static_cast, then
+        // dequantized with a separate subtract and multiply so the scalar tail gives the same bits
+        __attribute__( ( target( "avx2" ) ) ) void ConvertInt8ToFloatAvx2( const int8_t *input,
+                                                                           float        *output,
+                                                                           size_t        count,
+                                                                           float         scale,
+                                                                           float         zeroPoint )
+        {
+            const __m256 scales     = _mm256_set1_ps( scale );
+            const __m256 zeroPoints = _mm256_set1_ps( zeroPoint );
+            size_t       i          = 0;
+            for ( ; i + 8 <= count; i += 8 )
+            {
+                const __m128i bytes  = _mm_loadl_epi64( reinterpret_cast<const __m128i *>( input + i ) );
+                const __m256  values = _mm256_cvtepi32_ps( _mm256_cvtepi8_epi32( bytes ) );
+                _mm256_storeu_ps( output + i, _mm256_mul_ps( _mm256_sub_ps( values, zeroPoints ), scales ) );
+            }
+            ConvertIntToFloatScalar( input + i, output + i, count - i, scale, zeroPoint );
+        }
+
+        __attribute__( ( target( "avx2" ) ) ) void ConvertInt16ToFloatAvx2( const int16_t *input,
+                                                                            float         *output,
+                                                                            size_t         count,
+                                                                            float          scale,
+                                                                            float          zeroPoint )
+        {
+            const __m256 scales     = _mm256_set1_ps( scale );
+            const __m256 zeroPoints = _mm256_set1_ps( zeroPoint );
+            size_t       i          = 0;
+            for ( ; i + 8 <= count; i += 8 )
+            {
+                const __m128i words  = _mm_loadu_si128( reinterpret_cast<const __m128i *>( input + i ) );
+                const __m256  values = _mm256_cvtepi32_ps( _mm256_cvtepi16_epi32( words ) );
+                _mm256_storeu_ps( output + i, _mm256_mul_ps( _mm256_sub_ps( values, zeroPoints ), scales ) );
+            }
+            ConvertIntToFloatScalar( input + i, output + i, count - i, scale, zeroPoint );
+        }
+
+        __attribute__( ( target( "avx2" ) ) ) void ConvertInt32ToFloatAvx2( const int32_t *input,
+                                                                            float         *output,
+                                                                            size_t         count,
+                                                                            float          scale,
+                                                                            float          zeroPoint )
+        {
+            const __m256 scales     = _mm256_set1_ps( scale );
+            const __m256 zeroPoints = _mm256_set1_ps( zeroPoint );
+            size_t       i          = 0;
+            for ( ; i + 8 <= count; i += 8 )
+            {
+                const __m256i dwords = _mm256_loadu_si256( reinterpret_cast<const __m256i *>( input + i ) );
+                const __m256  values = _mm256_cvtepi32_ps( dwords );
+                _mm256_storeu_ps( output + i, _mm256_mul_ps( _mm256_sub_ps( values, zeroPoints ), scales ) );
+            }
+            ConvertIntToFloatScalar( input + i, output + i, count - i, scale, zeroPoint );
+        }
+#elif defined( SGPROCMGR_FLOAT_CONVERSION_NEON )
+        inline float32x4_t Dequantize( int32x4_t values, float32x4_t scales, float32x4_t zeroPoints )
+        {
+            return vmulq_f32( vsubq_f32( vcvtq_f32_s32( values ), zeroPoints ), scales );
+        }
+#endif
+    }
+
+    float HalfToFloat( uint16_t value )
+    {
+        const uint32_t sign     = static_cast<uint32_t>( value & 0x8000 ) << 16;
+        const uint32_t exponent = ( value >> 10 ) & 0x1F;
+        const uint32_t mantissa = value & 0x03FF;
+
+        uint32_t bits = 0;
+        if ( exponent == 0 )
+        {
+            // Zero or subnormal, mantissa * 2^-24 is exact in float
+            float magnitude = static_cast<float>( mantissa ) * 5.9604644775390625e-8f;
+            std::memcpy( &bits, &magnitude, sizeof( bits ) );
+            bits |= sign;
+        }
+        else if ( exponent == 31 )
+        {
+            // Infinity, or NaN made quiet the way F16C and NEON convert it
+            bits = sign | 0x7F800000u | ( mantissa << 13 ) | ( mantissa != 0 ? 0x00400000u : 0u );
+        }
+        else
+        {
+            bits = sign | ( ( exponent + ( 127 - 15 ) ) << 23 ) | ( mantissa << 13 );
+        }
+
+        float result = 0.0f;
+        std::memcpy( &result, &bits, sizeof( result ) );
+        return result;
+    }
+
+    void ConvertHalfToFloat( gsl::span<const uint16_t> input, gsl::span<float> output )
+    {
+        const size_t count = input.size();
+#if defined( SGPROCMGR_FLOAT_CONVERSION_X86 )
+        static const bool hasF16c = DetectF16c();
+        if ( hasF16c )
+        {
+            ConvertHalfToFloatF16c( input.data(), output.data(), count );
+            return;
+        }
+#elif defined( SGPROCMGR_FLOAT_CONVERSION_NEON )
+        size_t i = 0;
+        for ( ; i + 4 <= count; i += 4 )
+        {
+            const float16x4_t halves = vreinterpret_f16_u16( vld1_u16( input.data() + i ) );
+            vst1q_f32( output.data() + i, vcvt_f32_f16( halves ) );
+        }
+        ConvertHalfToFloatScalar( input.data() + i, output.data() + i, count - i );
+        return;
+#endif
+        ConvertHalfToFloatScalar( input.data(), output.data(), count );
+    }
+
+    void ConvertInt8ToFloat( gsl::span<const int8_t> input, gsl::span<float> output, float scale, float zeroPoint )
+    {
+        const size_t count = input.size();
+#if defined( SGPROCMGR_FLOAT_CONVERSION_X86 )
+        if ( HasAvx2() )
+        {
+            ConvertInt8ToFloatAvx2( input.data(), output.data(), count, scale, zeroPoint );
+            return;
+        }
+#elif defined( SGPROCMGR_FLOAT_CONVERSION_NEON )
+        const float32x4_t scales     = vdupq_n_f32( scale );
+        const float32x4_t zeroPoints = vdupq_n_f32( zeroPoint );
+        size_t            i          = 0;
+        for ( ; i + 8 <= count; i += 8 )
+        {
+            const int16x8_t words = vmovl_s8( vld1_s8( input.data() + i ) );
+            vst1q_f32( output.data() + i, Dequantize( vmovl_s16( vget_low_s16( words ) ), scales, zeroPoints ) );
+            vst1q_f32( output.data() + i + 4, Dequantize( vmovl_s16( vget_high_s16( words ) ), scales, zeroPoints ) );
+        }
+        ConvertIntToFloatScalar( input.data() + i, output.data() + i, count - i, scale, zeroPoint );
+        return;
+#endif
+        ConvertIntToFloatScalar( input.data(), output.data(), count, scale, zeroPoint );
+    }
+
+    void ConvertInt16ToFloat( gsl::span<const int16_t> input, gsl::span<float> output, float scale, float zeroPoint )
+    {
+        const size_t count = input.size();
+#if defined( SGPROCMGR_FLOAT_CONVERSION_X86 )
+        if ( HasAvx2() )
+        {
+            ConvertInt16ToFloatAvx2( input.data(), output.data(), count, scale, zeroPoint );
+            return;
+        }
+#elif defined( SGPROCMGR_FLOAT_CONVERSION_NEON )
+        const float32x4_t scales     = vdupq_n_f32( scale );
+        const float32x4_t zeroPoints = vdupq_n_f32( zeroPoint );
+        size_t            i          = 0;
+        for ( ; i + 8 <= count; i += 8 )
+        {
+            const int16x8_t words = vld1q_s16( input.data() + i );
+            vst1q_f32( output.data() + i, Dequantize( vmovl_s16( vget_low_s16( words ) ), scales, zeroPoints ) );
+            vst1q_f32( output.data() + i + 4, Dequantize( vmovl_s16( vget_high_s16( words ) ), scales, zeroPoints ) );
+        }
+        ConvertIntToFloatScalar( input.data() + i, output.data() + i, count - i, scale, zeroPoint );
+        return;
+#endif
+        ConvertIntToFloatScalar( input.data(), output.data(), count, scale, zeroPoint );
+    }
+
+    void ConvertInt32ToFloat( gsl::span<const int32_t> input, gsl::span<float> output, float scale, float zeroPoint )
+    {
+        const size_t count = input.size();
+#if defined( SGPROCMGR_FLOAT_CONVERSION_X86 )
+        if ( HasAvx2() )
+        {
+            ConvertInt32ToFloatAvx2( input.data(), output.data(), count, scale, zeroPoint );
+            return;
+        }
+#elif defined( SGPROCMGR_FLOAT_CONVERSION_NEON )
+        const float32x4_t scales     = vdupq_n_f32( scale );
+        const float32x4_t zeroPoints = vdupq_n_f32( zeroPoint );
+        size_t            i          = 0;
+        for ( ; i + 4 <= count; i += 4 )
+        {
+            vst1q_f32( output.data() + i, Dequantize( vld1q_s32( input.data() + i ), scales, zeroPoints ) );
+        }
+        ConvertIntToFloatScalar( input.data() + i, output.data() + i, count - i, scale, zeroPoint );
+        return;
+#endif
+        ConvertIntToFloatScalar( input.data(), output.data(), count, scale, zeroPoint );
+    }
+}
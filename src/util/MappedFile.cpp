@@ -0,0 +1,120 @@
+#include "util/MappedFile.hpp"
+
+#if defined( _WIN32 )
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace sgns::sgprocessing
+{
+#if defined( _WIN32 )
+    std::shared_ptr<MappedFile> MappedFile::Open( const std::string &path )
+    {
+        HANDLE file = CreateFileA( path.c_str(),
+                                   GENERIC_READ,
+                                   FILE_SHARE_READ,
+                                   nullptr,
+                                   OPEN_EXISTING,
+                                   FILE_ATTRIBUTE_NORMAL,
+                                   nullptr );
+        if ( file == INVALID_HANDLE_VALUE )
+        {
+            return nullptr;
+        }
+
+        LARGE_INTEGER fileSize;
+        if ( !GetFileSizeEx( file, &fileSize ) || fileSize.QuadPart <= 0 )
+        {
+            CloseHandle( file );
+            return nullptr;
+        }
+
+        HANDLE mapping = CreateFileMappingA( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+        if ( !mapping )
+        {
+            CloseHandle( file );
+            return nullptr;
+        }
+
+        void *view = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+        if ( !view )
+        {
+            CloseHandle( mapping );
+            CloseHandle( file );
+            return nullptr;
+        }
+
+        auto mapped      = std::shared_ptr<MappedFile>( new MappedFile() );
+        mapped->data_    = static_cast<const char *>( view );
+        mapped->size_    = static_cast<size_t>( fileSize.QuadPart );
+        mapped->file_    = file;
+        mapped->mapping_ = mapping;
+        return mapped;
+    }
+
+    MappedFile::~MappedFile()
+    {
+        if ( data_ )
+        {
+            UnmapViewOfFile( data_ );
+        }
+        if ( mapping_ )
+        {
+            CloseHandle( mapping_ );
+        }
+        if ( file_ )
+        {
+            CloseHandle( file_ );
+        }
+    }
+#else
+    std::shared_ptr<MappedFile> MappedFile::Open( const std::string &path )
+    {
+        const int fd = ::open( path.c_str(), O_RDONLY );
+        if ( fd < 0 )
+        {
+            return nullptr;
+        }
+
+        struct stat info;
+        if ( ::fstat( fd, &info ) != 0 || !S_ISREG( info.st_mode ) || info.st_size <= 0 )
+        {
+            ::close( fd );
+            return nullptr;
+        }
+
+        const size_t size = static_cast<size_t>( info.st_size );
+        // A private mapping never writes back and is not affected by writes through our own view.
+        // It still faults in from the file, so truncation by another process raises SIGBUS.
+        void        *view = ::mmap( nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        // The mapping keeps its own reference to the file
+        ::close( fd );
+        if ( view == MAP_FAILED )
+        {
+            return nullptr;
+        }
+
+        auto mapped   = std::shared_ptr<MappedFile>( new MappedFile() );
+        mapped->data_ = static_cast<const char *>( view );
+        mapped->size_ = size;
+        return mapped;
+    }
+
+    MappedFile::~MappedFile()
+    {
+        if ( data_ )
+        {
+            ::munmap( const_cast<char *>( data_ ), size_ );
+        }
+    }
+#endif
+
+    gsl::span<const char> MappedFile::GetData() const
+    {
+        return gsl::span<const char>( data_, size_ );
+    }
+}
@@ -0,0 +1,132 @@
+#include "util/OutputSink.hpp"
+
+#include <cerrno>
+#include <random>
+#include <system_error>
+
+#if defined( _WIN32 )
+#include <fcntl.h>
+#include <io.h>
+#include <share.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace sgns::sgprocessing
+{
+    namespace
+    {
+        /** Open a file for reading and writing, failing if it already exists
+        */
+        std::FILE *CreateExclusive( const std::string &path )
+        {
+#if defined( _WIN32 )
+            int fd = -1;
+            if ( _sopen_s( &fd,
+                           path.c_str(),
+                           _O_CREAT | _O_EXCL | _O_RDWR | _O_BINARY,
+                           _SH_DENYNO,
+                           _S_IREAD | _S_IWRITE ) != 0 )
+            {
+                return nullptr;
+            }
+            std::FILE *file = _fdopen( fd, "w+b" );
+            if ( !file )
+            {
+                _close( fd );
+            }
+#else
+            const int fd = ::open( path.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0600 );
+            if ( fd < 0 )
+            {
+                return nullptr;
+            }
+            std::FILE *file = ::fdopen( fd, "w+b" );
+            if ( !file )
+            {
+                ::close( fd );
+            }
+#endif
+            return file;
+        }
+    }
+
+    FileOutputSink::FileOutputSink( std::string path, std::FILE *file ) :
+        path_( std::move( path ) ), file_( file )
+    {
+    }
+
+    FileOutputSink::~FileOutputSink()
+    {
+        std::fclose( file_ );
+        if ( !keep_ )
+        {
+            std::error_code error;
+            std::filesystem::remove( path_, error );
+        }
+    }
+
+    std::unique_ptr<FileOutputSink> FileOutputSink::Create( const std::filesystem::path &directory )
+    {
+        thread_local std::mt19937_64 random( std::random_device{}() );
+        static const char            digits[] = "0123456789abcdef";
+
+        // A handful of attempts only fails if the directory is unusable, not on name clashes
+        for ( int attempt = 0; attempt < 16; ++attempt )
+        {
+            uint64_t    value = random();
+            std::string name  = "stream-";
+            for ( int i = 0; i < 16; ++i, value >>= 4 )
+            {
+                name.push_back( digits[value & 0x0F] );
+            }
+            name += ".raw";
+
+            const std::string path = ( directory / name ).string();
+            if ( std::FILE *file = CreateExclusive( path ) )
+            {
+                return std::unique_ptr<FileOutputSink>( new FileOutputSink( path, file ) );
+            }
+            if ( errno != EEXIST )
+            {
+                return nullptr;
+            }
+        }
+        return nullptr;
+    }
+
+    bool FileOutputSink::Write( uint64_t offset, gsl::span<const char> data )
+    {
+        return Seek( offset ) && std::fwrite( data.data(), 1, data.size(), file_ ) == data.size();
+    }
+
+    bool FileOutputSink::Read( uint64_t offset, gsl::span<char> data )
+    {
+        // Seeking is also what lets a stream opened for update switch from writing to reading
+        return Seek( offset ) && std::fread( data.data(), 1, data.size(), file_ ) == data.size();
+    }
+
+    bool FileOutputSink::Seek( uint64_t offset )
+    {
+#if defined( _WIN32 )
+        return _fseeki64( file_, static_cast<__int64>( offset ), SEEK_SET ) == 0;
+#else
+        return ::fseeko( file_, static_cast<off_t>( offset ), SEEK_SET ) == 0;
+#endif
+    }
+
+    bool FileOutputSink::Flush()
+    {
+        if ( std::fflush( file_ ) != 0 )
+        {
+            return false;
+        }
+#if defined( _WIN32 )
+        return _commit( _fileno( file_ ) ) == 0;
+#else
+        return ::fsync( ::fileno( file_ ) ) == 0;
+#endif
+    }
+}
@@ -0,0 +1,81 @@
+#include "util/ProgressiveInput.hpp"
+
+#include <cstring>
+
+namespace sgns::sgprocessing
+{
+    bool ProgressiveInput::SetSize( size_t size )
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        if ( sized_ || finished_ )
+        {
+            return false;
+        }
+        data_.resize( size );
+        sized_ = true;
+        arrived_.notify_all();
+        return true;
+    }
+
+    bool ProgressiveInput::Append( gsl::span<const char> bytes )
+    {
+        size_t offset = 0;
+        {
+            std::lock_guard<std::mutex> lock( mutex_ );
+            if ( !sized_ || finished_ || bytes.size() > data_.size() - available_ )
+            {
+                return false;
+            }
+            offset = available_;
+        }
+        // Readers never look past available_, so the copy needs no lock
+        std::memcpy( data_.data() + offset, bytes.data(), bytes.size() );
+
+        std::lock_guard<std::mutex> lock( mutex_ );
+        available_ += bytes.size();
+        arrived_.notify_all();
+        return true;
+    }
+
+    void ProgressiveInput::Finish( bool succeeded )
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        if ( finished_ )
+        {
+            return;
+        }
+        finished_ = true;
+        failed_   = !succeeded || !sized_ || available_ < data_.size();
+        arrived_.notify_all();
+    }
+
+    std::optional<size_t> ProgressiveInput::WaitForSize() const
+    {
+        std::unique_lock<std::mutex> lock( mutex_ );
+        arrived_.wait( lock, [this] { return sized_ || finished_; } );
+        if ( !sized_ || failed_ )
+        {
+            return std::nullopt;
+        }
+        return data_.size();
+    }
+
+    bool ProgressiveInput::WaitFor( size_t bytes ) const
+    {
+        std::unique_lock<std::mutex> lock( mutex_ );
+        arrived_.wait( lock, [this, bytes] { return finished_ || ( sized_ && available_ >= bytes ); } );
+        return !failed_ && sized_ && available_ >= bytes;
+    }
+
+    gsl::span<const char> ProgressiveInput::GetData() const
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        return gsl::span<const char>( data_.data(), data_.size() );
+    }
+
+    size_t ProgressiveInput::GetAvailable() const
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        return available_;
+    }
+}
@@ -2,21 +2,447 @@
 
 #include "util/sha256.hpp"
 
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <thread>
 #include <openssl/evp.h>
 
+#if ( defined( __x86_64__ ) || defined( __i386__ ) ) && ( defined( __GNUC__ ) || defined( __clang__ ) )
+#define SGPROCMGR_SHA256_AVX2 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
 namespace sgns::sgprocmanagersha
 {
+    namespace
+    {
+        constexpr uint8_t MERKLE_LEAF_PREFIX = 0x00;
+        constexpr uint8_t MERKLE_NODE_PREFIX = 0x01;
+
+        // Below this many hashes per thread, starting threads costs more than it saves
+        constexpr size_t MIN_HASHES_PER_WORKER = 256;
+
+        Sha256Digest MerkleLeaf( Sha256Hasher &hasher, const Sha256Digest &chunkDigest )
+        {
+            return hasher.Update( &MERKLE_LEAF_PREFIX, 1 ).Update( chunkDigest.data(), chunkDigest.size() ).Finalize();
+        }
+
+        Sha256Digest MerkleNode( Sha256Hasher &hasher, const Sha256Digest &left, const Sha256Digest &right )
+        {
+            return hasher.Update( &MERKLE_NODE_PREFIX, 1 )
+                .Update( left.data(), left.size() )
+                .Update( right.data(), right.size() )
+                .Finalize();
+        }
+
+        /** Run body( hasher, index ) for every index in [0, count), spread over up to workerCount threads
+        */
+        template <typename Body>
+        void ParallelHash( size_t count, size_t workerCount, const Body &body )
+        {
+            const size_t workers = std::max<size_t>(
+                1,
+                std::min( workerCount, count / MIN_HASHES_PER_WORKER ) );
+            auto range = [&]( size_t begin, size_t end )
+            {
+                Sha256Hasher hasher;
+                for ( size_t i = begin; i < end; ++i )
+                {
+                    body( hasher, i );
+                }
+            };
+            if ( workers == 1 )
+            {
+                range( 0, count );
+                return;
+            }
+
+            const size_t             perWorker = ( count + workers - 1 ) / workers;
+            std::vector<std::thread> threads;
+            threads.reserve( workers );
+            for ( size_t begin = 0; begin < count; begin += perWorker )
+            {
+                threads.emplace_back( range, begin, std::min( count, begin + perWorker ) );
+            }
+            for ( auto &thread : threads )
+            {
+                thread.join();
+            }
+        }
+
+        /** AVX2 and SHA-NI support of the CPU, including the OS saving the YMM registers
+        */
+        struct CpuFeatures
+        {
+            bool avx2  = false;
+            bool shaNi = false;
+        };
+
+#if defined( SGPROCMGR_SHA256_AVX2 )
+        constexpr size_t SHA256_LANES = 8;
+        constexpr size_t SHA256_BLOCK = 64;
+
+        constexpr uint32_t ROUND_CONSTANTS[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+
+        constexpr uint32_t INITIAL_STATE[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                                0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+
+#define SGPROCMGR_ROTR( x, n ) _mm256_or_si256( _mm256_srli_epi32( x, n ), _mm256_slli_epi32( x, 32 - ( n ) ) )
+
+        uint32_t LoadBigEndian( const uint8_t *bytes )
+        {
+            return ( static_cast<uint32_t>( bytes[0] ) << 24 ) | ( static_cast<uint32_t>( bytes[1] ) << 16 ) |
+                   ( static_cast<uint32_t>( bytes[2] ) << 8 ) | static_cast<uint32_t>( bytes[3] );
+        }
+
+        /** One compression round over a 64 byte block from each of the eight lanes
+        */
+        __attribute__( ( target( "avx2" ) ) ) void Compress8( __m256i state[8], const uint8_t *const blocks[SHA256_LANES] )
+        {
+            __m256i w[64];
+            for ( int t = 0; t < 16; ++t )
+            {
+                w[t] = _mm256_setr_epi32( static_cast<int>( LoadBigEndian( blocks[0] + 4 * t ) ),
+                                          static_cast<int>( LoadBigEndian( blocks[1] + 4 * t ) ),
+                                          static_cast<int>( LoadBigEndian( blocks[2] + 4 * t ) ),
+                                          static_cast<int>( LoadBigEndian( blocks[3] + 4 * t ) ),
+                                          static_cast<int>( LoadBigEndian( blocks[4] + 4 * t ) ),
+                                          static_cast<int>( LoadBigEndian( blocks[5] + 4 * t ) ),
+                                          static_cast<int>( LoadBigEndian( blocks[6] + 4 * t ) ),
+                                          static_cast<int>( LoadBigEndian( blocks[7] + 4 * t ) ) );
+            }
+            for ( int t = 16; t < 64; ++t )
+            {
+                const __m256i s0 = _mm256_xor_si256(
+                    _mm256_xor_si256( SGPROCMGR_ROTR( w[t - 15], 7 ), SGPROCMGR_ROTR( w[t - 15], 18 ) ),
+                    _mm256_srli_epi32( w[t - 15], 3 ) );
+                const __m256i s1 = _mm256_xor_si256(
+                    _mm256_xor_si256( SGPROCMGR_ROTR( w[t - 2], 17 ), SGPROCMGR_ROTR( w[t - 2], 19 ) ),
+                    _mm256_srli_epi32( w[t - 2], 10 ) );
+                w[t] = _mm256_add_epi32( _mm256_add_epi32( w[t - 16], s0 ), _mm256_add_epi32( w[t - 7], s1 ) );
+            }
+
+            __m256i a = state[0], b = state[1], c = state[2], d = state[3];
+            __m256i e = state[4], f = state[5], g = state[6], h = state[7];
+            for ( int t = 0; t < 64; ++t )
+            {
+                const __m256i bigSigma1 = _mm256_xor_si256(
+                    _mm256_xor_si256( SGPROCMGR_ROTR( e, 6 ), SGPROCMGR_ROTR( e, 11 ) ), SGPROCMGR_ROTR( e, 25 ) );
+                const __m256i choose = _mm256_xor_si256( _mm256_and_si256( e, f ), _mm256_andnot_si256( e, g ) );
+                const __m256i t1     = _mm256_add_epi32(
+                    _mm256_add_epi32( _mm256_add_epi32( h, bigSigma1 ), choose ),
+                    _mm256_add_epi32( _mm256_set1_epi32( static_cast<int>( ROUND_CONSTANTS[t] ) ), w[t] ) );
+                const __m256i bigSigma0 = _mm256_xor_si256(
+                    _mm256_xor_si256( SGPROCMGR_ROTR( a, 2 ), SGPROCMGR_ROTR( a, 13 ) ), SGPROCMGR_ROTR( a, 22 ) );
+                const __m256i majority = _mm256_xor_si256(
+                    _mm256_xor_si256( _mm256_and_si256( a, b ), _mm256_and_si256( a, c ) ), _mm256_and_si256( b, c ) );
+                const __m256i t2 = _mm256_add_epi32( bigSigma0, majority );
+                h                = g;
+                g                = f;
+                f                = e;
+                e                = _mm256_add_epi32( d, t1 );
+                d                = c;
+                c                = b;
+                b                = a;
+                a                = _mm256_add_epi32( t1, t2 );
+            }
+
+            state[0] = _mm256_add_epi32( state[0], a );
+            state[1] = _mm256_add_epi32( state[1], b );
+            state[2] = _mm256_add_epi32( state[2], c );
+            state[3] = _mm256_add_epi32( state[3], d );
+            state[4] = _mm256_add_epi32( state[4], e );
+            state[5] = _mm256_add_epi32( state[5], f );
+            state[6] = _mm256_add_epi32( state[6], g );
+            state[7] = _mm256_add_epi32( state[7], h );
+        }
+
+#undef SGPROCMGR_ROTR
+
+        /** Hash up to eight messages of the same size, unused lanes repeat the first message
+        */
+        __attribute__( ( target( "avx2" ) ) ) void HashLanes( const Sha256Input *inputs,
+                                                              size_t             count,
+                                                              Sha256Digest      *digests )
+        {
+            const size_t size       = inputs[0].size;
+            const size_t fullBlocks = size / SHA256_BLOCK;
+            const size_t remainder  = size % SHA256_BLOCK;
+            // Padding is a 0x80 byte and the 64 bit bit length, which may spill into a second block
+            const size_t tailBlocks = remainder + 9 > SHA256_BLOCK ? 2 : 1;
+
+            uint8_t        tails[SHA256_LANES][2 * SHA256_BLOCK];
+            const uint8_t *messages[SHA256_LANES];
+            for ( size_t lane = 0; lane < SHA256_LANES; ++lane )
+            {
+                const auto &input = inputs[lane < count ? lane : 0];
+                messages[lane]    = static_cast<const uint8_t *>( input.data );
+
+                uint8_t *tail = tails[lane];
+                std::memset( tail, 0, sizeof( tails[lane] ) );
+                if ( remainder > 0 )
+                {
+                    std::memcpy( tail, messages[lane] + fullBlocks * SHA256_BLOCK, remainder );
+                }
+                tail[remainder]           = 0x80;
+                const uint64_t bitLength  = static_cast<uint64_t>( size ) * 8;
+                uint8_t       *lengthEnd  = tail + tailBlocks * SHA256_BLOCK;
+                for ( int i = 1; i <= 8; ++i )
+                {
+                    lengthEnd[-i] = static_cast<uint8_t>( bitLength >> ( 8 * ( i - 1 ) ) );
+                }
+            }
+
+            __m256i state[8];
+            for ( int i = 0; i < 8; ++i )
+            {
+                state[i] = _mm256_set1_epi32( static_cast<int>( INITIAL_STATE[i] ) );
+            }
+
+            const uint8_t *blocks[SHA256_LANES];
+            for ( size_t block = 0; block < fullBlocks + tailBlocks; ++block )
+            {
+                for ( size_t lane = 0; lane < SHA256_LANES; ++lane )
+                {
+                    blocks[lane] = block < fullBlocks ? messages[lane] + block * SHA256_BLOCK
+                                                      : tails[lane] + ( block - fullBlocks ) * SHA256_BLOCK;
+                }
+                Compress8( state, blocks );
+            }
+
+            alignas( 32 ) uint32_t words[8][SHA256_LANES];
+            for ( int i = 0; i < 8; ++i )
+            {
+                _mm256_store_si256( reinterpret_cast<__m256i *>( words[i] ), state[i] );
+            }
+            for ( size_t lane = 0; lane < count; ++lane )
+            {
+                for ( int i = 0; i < 8; ++i )
+                {
+                    digests[lane][4 * i]     = static_cast<uint8_t>( words[i][lane] >> 24 );
+                    digests[lane][4 * i + 1] = static_cast<uint8_t>( words[i][lane] >> 16 );
+                    digests[lane][4 * i + 2] = static_cast<uint8_t>( words[i][lane] >> 8 );
+                    digests[lane][4 * i + 3] = static_cast<uint8_t>( words[i][lane] );
+                }
+            }
+        }
+
+        CpuFeatures DetectCpuFeatures()
+        {
+            unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+            if ( !__get_cpuid( 1, &eax, &ebx, &ecx, &edx ) )
+            {
+                return {};
+            }
+            if ( !( ecx & bit_OSXSAVE ) || !( ecx & bit_AVX ) )
+            {
+                return {};
+            }
+            unsigned int xcr0Low = 0, xcr0High = 0;
+            __asm__( "xgetbv" : "=a"( xcr0Low ), "=d"( xcr0High ) : "c"( 0 ) );
+            const bool osSavesYmm = ( xcr0Low & 0x6 ) == 0x6;
+            if ( !osSavesYmm || !__get_cpuid_count( 7, 0, &eax, &ebx, &ecx, &edx ) )
+            {
+                return {};
+            }
+            return CpuFeatures{ ( ebx & bit_AVX2 ) != 0, ( ebx & bit_SHA ) != 0 };
+        }
+#else
+        CpuFeatures DetectCpuFeatures()
+        {
+            return {};
+        }
+#endif
+    }
+
     std::vector<uint8_t> sha256(const void* data, size_t dataSize) {
-        std::vector<uint8_t> hash(EVP_MAX_MD_SIZE);
-        unsigned int hashLen;
+        // One context per thread instead of one per call
+        thread_local Sha256Hasher hasher;
+        const auto                digest = hasher.Digest( data, dataSize );
+        return std::vector<uint8_t>( digest.begin(), digest.end() );
+    }
+
+    Sha256Backend GetSha256Backend()
+    {
+        // SHA-NI in OpenSSL beats eight AVX2 lanes, so only go multi-buffer without it
+        static const CpuFeatures features = DetectCpuFeatures();
+        return features.avx2 && !features.shaNi ? Sha256Backend::Avx2MultiBuffer : Sha256Backend::OpenSsl;
+    }
+
+    std::vector<Sha256Digest> sha256Batch( gsl::span<const Sha256Input> inputs )
+    {
+        return sha256Batch( inputs, GetSha256Backend() );
+    }
+
+    std::vector<Sha256Digest> sha256Batch( gsl::span<const Sha256Input> inputs, Sha256Backend backend )
+    {
+        std::vector<Sha256Digest> digests( inputs.size() );
+        std::vector<size_t>       order( inputs.size() );
+        std::iota( order.begin(), order.end(), 0 );
+
+#if defined( SGPROCMGR_SHA256_AVX2 )
+        static const bool hasAvx2 = DetectCpuFeatures().avx2;
+        if ( backend == Sha256Backend::Avx2MultiBuffer && hasAvx2 )
+        {
+            // Lanes share one block count, so hash runs of equally sized messages together
+            std::stable_sort( order.begin(),
+                              order.end(),
+                              [&]( size_t lhs, size_t rhs ) { return inputs[lhs].size < inputs[rhs].size; } );
+            std::vector<size_t> remaining;
+            size_t              runStart = 0;
+            while ( runStart < order.size() )
+            {
+                size_t runEnd = runStart + 1;
+                while ( runEnd < order.size() && runEnd - runStart < SHA256_LANES &&
+                        inputs[order[runEnd]].size == inputs[order[runStart]].size )
+                {
+                    ++runEnd;
+                }
+                if ( runEnd - runStart == 1 )
+                {
+                    remaining.push_back( order[runStart] );
+                }
+                else
+                {
+                    Sha256Input  lanes[SHA256_LANES];
+                    Sha256Digest laneDigests[SHA256_LANES];
+                    for ( size_t i = runStart; i < runEnd; ++i )
+                    {
+                        lanes[i - runStart] = inputs[order[i]];
+                    }
+                    HashLanes( lanes, runEnd - runStart, laneDigests );
+                    for ( size_t i = runStart; i < runEnd; ++i )
+                    {
+                        digests[order[i]] = laneDigests[i - runStart];
+                    }
+                }
+                runStart = runEnd;
+            }
+            order = std::move( remaining );
+        }
+#endif
+
+        Sha256Hasher hasher;
+        for ( auto index : order )
+        {
+            digests[index] = hasher.Digest( inputs[index].data, inputs[index].size );
+        }
+        return digests;
+    }
+
+    Sha256Hasher::Sha256Hasher() : ctx_( EVP_MD_CTX_new() )
+    {
+        Reset();
+    }
+
+    Sha256Hasher::~Sha256Hasher()
+    {
+        EVP_MD_CTX_free( static_cast<EVP_MD_CTX *>( ctx_ ) );
+    }
+
+    Sha256Hasher &Sha256Hasher::Update( const void *data, size_t dataSize )
+    {
+        EVP_DigestUpdate( static_cast<EVP_MD_CTX *>( ctx_ ), data, dataSize );
+        return *this;
+    }
+
+    Sha256Digest Sha256Hasher::Finalize()
+    {
+        Sha256Digest digest{};
+        unsigned int digestLen = 0;
+        EVP_DigestFinal_ex( static_cast<EVP_MD_CTX *>( ctx_ ), digest.data(), &digestLen );
+        Reset();
+        return digest;
+    }
+
+    Sha256Digest Sha256Hasher::Digest( const void *data, size_t dataSize )
+    {
+        return Update( data, dataSize ).Finalize();
+    }
+
+    void Sha256Hasher::Reset()
+    {
+        EVP_DigestInit_ex( static_cast<EVP_MD_CTX *>( ctx_ ), EVP_sha256(), nullptr );
+    }
+
+    Sha256Digest Sha256Chain::Append( const void *data, size_t dataSize )
+    {
+        const auto chunkDigest = hasher_.Digest( data, dataSize );
+        AppendDigest( chunkDigest );
+        return chunkDigest;
+    }
+
+    void Sha256Chain::AppendDigest( const Sha256Digest &chunkDigest )
+    {
+        hash_ = hasher_.Update( hash_.data(), hash_.size() ).Update( chunkDigest.data(), chunkDigest.size() ).Finalize();
+    }
+
+    void Sha256MerkleTree::AppendDigest( const Sha256Digest &chunkDigest )
+    {
+        Subtree subtree{ MerkleLeaf( hasher_, chunkDigest ), 1 };
+        // Same sized neighbours always merge, like carries in a binary counter
+        while ( !subtrees_.empty() && subtrees_.back().leaves == subtree.leaves )
+        {
+            subtree.root    = MerkleNode( hasher_, subtrees_.back().root, subtree.root );
+            subtree.leaves *= 2;
+            subtrees_.pop_back();
+        }
+        subtrees_.push_back( subtree );
+        ++leafCount_;
+    }
+
+    Sha256Digest Sha256MerkleTree::GetRoot() const
+    {
+        if ( subtrees_.empty() )
+        {
+            return hasher_.Digest( nullptr, 0 );
+        }
+        // Smaller subtrees hang off the right edge of the larger ones
+        Sha256Digest root = subtrees_.back().root;
+        for ( auto it = subtrees_.rbegin() + 1; it != subtrees_.rend(); ++it )
+        {
+            root = MerkleNode( hasher_, it->root, root );
+        }
+        return root;
+    }
+
+    Sha256Digest Sha256MerkleTree::ComputeRoot( gsl::span<const Sha256Digest> chunkDigests, size_t workerCount )
+    {
+        if ( chunkDigests.empty() )
+        {
+            return Sha256Hasher().Digest( nullptr, 0 );
+        }
 
-        EVP_MD_CTX* ctx = EVP_MD_CTX_new();
-        EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr);
-        EVP_DigestUpdate(ctx, data, dataSize);
-        EVP_DigestFinal_ex(ctx, hash.data(), &hashLen);
-        EVP_MD_CTX_free(ctx);
+        std::vector<Sha256Digest> level( chunkDigests.size() );
+        ParallelHash( level.size(),
+                      workerCount,
+                      [&]( Sha256Hasher &hasher, size_t i ) { level[i] = MerkleLeaf( hasher, chunkDigests[i] ); } );
 
-        hash.resize(hashLen);
-        return hash;
+        // Pairing neighbours level by level and carrying an odd last node up unchanged gives the
+        // same tree as splitting at the largest power of two
+        while ( level.size() > 1 )
+        {
+            std::vector<Sha256Digest> next( ( level.size() + 1 ) / 2 );
+            ParallelHash( level.size() / 2,
+                          workerCount,
+                          [&]( Sha256Hasher &hasher, size_t i )
+                          { next[i] = MerkleNode( hasher, level[2 * i], level[2 * i + 1] ); } );
+            if ( level.size() % 2 != 0 )
+            {
+                next.back() = level.back();
+            }
+            level = std::move( next );
+        }
+        return level.front();
     }
 } // namepace sgns::sgprocmanagersha
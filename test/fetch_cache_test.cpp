@@ -0,0 +1,191 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "processingbase/FetchCache.hpp"
+
+using sgns::sgprocessing::FetchCache;
+
+class FetchCacheTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        std::random_device random;
+        directory_ = std::filesystem::temp_directory_path() / ( "fetch-cache-test-" + std::to_string( random() ) );
+    }
+
+    void TearDown() override
+    {
+        std::error_code error;
+        std::filesystem::remove_all( directory_, error );
+    }
+
+    /** Get the cached content files, everything in the cache directory but the index
+    */
+    std::vector<std::filesystem::path> CachedFiles() const
+    {
+        std::vector<std::filesystem::path> files;
+        for ( const auto &item : std::filesystem::directory_iterator( directory_ ) )
+        {
+            if ( item.path().filename() != "index" )
+            {
+                files.push_back( item.path() );
+            }
+        }
+        return files;
+    }
+
+    static std::string Contents( const std::shared_ptr<sgns::sgprocessing::MappedFile> &mapping )
+    {
+        return std::string( mapping->GetData().begin(), mapping->GetData().end() );
+    }
+
+    std::filesystem::path directory_;
+};
+
+TEST_F( FetchCacheTest, StoredSourceIsFoundAgainAfterReopening )
+{
+    const std::string uri  = "file:///models/model.mnn";
+    const std::string data = "model bytes";
+    {
+        FetchCache cache( directory_, 1024 );
+        EXPECT_EQ( cache.Find( uri ), nullptr );
+        ASSERT_TRUE( cache.Store( uri, data ) );
+        auto mapping = cache.Find( uri );
+        ASSERT_NE( mapping, nullptr );
+        EXPECT_EQ( Contents( mapping ), data );
+        EXPECT_EQ( cache.GetSize(), data.size() );
+    }
+
+    FetchCache reopened( directory_, 1024 );
+    auto       mapping = reopened.Find( uri );
+    ASSERT_NE( mapping, nullptr );
+    EXPECT_EQ( Contents( mapping ), data );
+}
+
+TEST_F( FetchCacheTest, SourcesSharingContentAreStoredOnce )
+{
+    FetchCache cache( directory_, 1024 );
+    ASSERT_TRUE( cache.Store( "file:///a/input.raw", std::string( "same" ) ) );
+    ASSERT_TRUE( cache.Store( "file:///b/input.raw", std::string( "same" ) ) );
+    EXPECT_EQ( cache.GetSize(), 4u );
+    EXPECT_EQ( CachedFiles().size(), 1u );
+}
+
+TEST_F( FetchCacheTest, LeastRecentlyUsedSourceIsEvicted )
+{
+    FetchCache cache( directory_, 10 );
+    ASSERT_TRUE( cache.Store( "file:///a.raw", std::string( "aaaa" ) ) );
+    ASSERT_TRUE( cache.Store( "file:///b.raw", std::string( "bbbb" ) ) );
+    ASSERT_NE( cache.Find( "file:///a.raw" ), nullptr );
+    ASSERT_TRUE( cache.Store( "file:///c.raw", std::string( "cccc" ) ) );
+
+    EXPECT_NE( cache.Find( "file:///a.raw" ), nullptr );
+    EXPECT_EQ( cache.Find( "file:///b.raw" ), nullptr );
+    EXPECT_NE( cache.Find( "file:///c.raw" ), nullptr );
+    EXPECT_EQ( cache.GetSize(), 8u );
+    EXPECT_EQ( CachedFiles().size(), 2u );
+}
+
+TEST_F( FetchCacheTest, SourceLargerThanCacheIsNotStored )
+{
+    FetchCache cache( directory_, 4 );
+    EXPECT_FALSE( cache.Store( "file:///large.raw", std::string( "too large" ) ) );
+    EXPECT_EQ( cache.Find( "file:///large.raw" ), nullptr );
+    EXPECT_EQ( cache.GetSize(), 0u );
+}
+
+TEST_F( FetchCacheTest, CorruptedEntryIsDropped )
+{
+    const std::string uri = "file:///models/model.mnn";
+    FetchCache        cache( directory_, 1024 );
+    ASSERT_TRUE( cache.Store( uri, std::string( "model bytes" ) ) );
+    ASSERT_NE( cache.Find( uri ), nullptr );
+
+    // Same size, different bytes, and a new modification time so the cache checks the file again
+    auto files = CachedFiles();
+    ASSERT_EQ( files.size(), 1u );
+    const auto modified = std::filesystem::last_write_time( files[0] );
+    {
+        std::ofstream out( files[0], std::ios::binary | std::ios::trunc );
+        out << "MODEL BYTES";
+    }
+    std::filesystem::last_write_time( files[0], modified + std::chrono::seconds( 1 ) );
+
+    EXPECT_EQ( cache.Find( uri ), nullptr );
+    EXPECT_TRUE( CachedFiles().empty() );
+    EXPECT_EQ( cache.GetSize(), 0u );
+}
+
+TEST_F( FetchCacheTest, RemovedFileIsAMiss )
+{
+    const std::string uri = "file:///inputs/input.raw";
+    FetchCache        cache( directory_, 1024 );
+    ASSERT_TRUE( cache.Store( uri, std::string( "input bytes" ) ) );
+    for ( const auto &file : CachedFiles() )
+    {
+        std::filesystem::remove( file );
+    }
+
+    EXPECT_EQ( cache.Find( uri ), nullptr );
+    EXPECT_EQ( cache.GetSize(), 0u );
+}
+
+TEST_F( FetchCacheTest, IndexEntryWithInvalidHashIsIgnored )
+{
+    // A file outside the cache that a crafted index points at
+    std::filesystem::create_directories( directory_ / "cache" );
+    {
+        std::ofstream outside( directory_ / "outside" );
+        outside << "keep";
+    }
+    {
+        std::ofstream index( directory_ / "cache" / "index" );
+        index << "../outside 4 1 file:///outside.raw\n";
+    }
+
+    {
+        FetchCache cache( directory_ / "cache", 1024 );
+        EXPECT_EQ( cache.GetSize(), 0u );
+        EXPECT_EQ( cache.Find( "file:///outside.raw" ), nullptr );
+    }
+    EXPECT_TRUE( std::filesystem::exists( directory_ / "outside" ) );
+}
+
+TEST_F( FetchCacheTest, ConcurrentStoresLeaveNoTemporaryFiles )
+{
+    constexpr size_t         THREAD_COUNT = 8;
+    FetchCache               cache( directory_, 1 << 20 );
+    std::vector<std::thread> threads;
+    for ( size_t t = 0; t < THREAD_COUNT; ++t )
+    {
+        threads.emplace_back(
+            [&cache, t]
+            {
+                // Every thread stores the same content under its own URI and a distinct content
+                EXPECT_TRUE( cache.Store( "file:///shared/" + std::to_string( t ), std::string( 4096, 's' ) ) );
+                EXPECT_TRUE( cache.Store( "file:///own/" + std::to_string( t ), std::string( 4096, 'a' + t ) ) );
+                EXPECT_NE( cache.Find( "file:///shared/" + std::to_string( t ) ), nullptr );
+            } );
+    }
+    for ( auto &thread : threads )
+    {
+        thread.join();
+    }
+    cache.Flush();
+
+    EXPECT_EQ( CachedFiles().size(), THREAD_COUNT + 1 );
+    EXPECT_EQ( cache.GetSize(), ( THREAD_COUNT + 1 ) * 4096 );
+    for ( const auto &file : CachedFiles() )
+    {
+        EXPECT_NE( file.extension(), ".tmp" ) << file;
+    }
+}
@@ -0,0 +1,214 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "util/FloatConversion.hpp"
+
+using namespace sgns::sgprocessing;
+
+namespace
+{
+    uint32_t Bits( float value )
+    {
+        uint32_t bits = 0;
+        std::memcpy( &bits, &value, sizeof( bits ) );
+        return bits;
+    }
+
+    /** Half precision value computed from its definition, independent of the code under test
+    */
+    float ReferenceHalf( uint16_t value )
+    {
+        const bool negative = ( value & 0x8000 ) != 0;
+        const int  exponent = ( value >> 10 ) & 0x1F;
+        const int  mantissa = value & 0x03FF;
+
+        float magnitude = 0.0f;
+        if ( exponent == 0 )
+        {
+            magnitude = std::ldexp( static_cast<float>( mantissa ), -24 );
+        }
+        else if ( exponent == 31 )
+        {
+            magnitude = mantissa == 0 ? std::numeric_limits<float>::infinity()
+                                      : std::numeric_limits<float>::quiet_NaN();
+        }
+        else
+        {
+            magnitude = std::ldexp( static_cast<float>( 1024 + mantissa ), exponent - 25 );
+        }
+        return negative ? -magnitude : magnitude;
+    }
+
+    std::vector<uint16_t> AllHalves()
+    {
+        std::vector<uint16_t> halves( 65536 );
+        for ( size_t i = 0; i < halves.size(); ++i )
+        {
+            halves[i] = static_cast<uint16_t>( i );
+        }
+        return halves;
+    }
+}
+
+TEST( FloatConversionTest, HalfToFloatMatchesDefinitionForAllValues )
+{
+    for ( uint32_t i = 0; i < 65536; ++i )
+    {
+        const auto  half      = static_cast<uint16_t>( i );
+        const float converted = HalfToFloat( half );
+        const float expected  = ReferenceHalf( half );
+        if ( std::isnan( expected ) )
+        {
+            ASSERT_TRUE( std::isnan( converted ) ) << "half 0x" << std::hex << i;
+            ASSERT_EQ( std::signbit( converted ), std::signbit( expected ) ) << "half 0x" << std::hex << i;
+            // Payload kept and made quiet, as F16C and NEON convert it
+            ASSERT_EQ( Bits( converted ) & 0x003FE000u, static_cast<uint32_t>( half & 0x01FF ) << 13 );
+            ASSERT_NE( Bits( converted ) & 0x00400000u, 0u );
+        }
+        else
+        {
+            ASSERT_EQ( Bits( converted ), Bits( expected ) ) << "half 0x" << std::hex << i;
+        }
+    }
+}
+
+TEST( FloatConversionTest, BulkHalfConversionMatchesScalarForAllValues )
+{
+    const auto         halves = AllHalves();
+    std::vector<float> output( halves.size() );
+    ConvertHalfToFloat( halves, output );
+    for ( size_t i = 0; i < halves.size(); ++i )
+    {
+        ASSERT_EQ( Bits( output[i] ), Bits( HalfToFloat( halves[i] ) ) ) << "half 0x" << std::hex << i;
+    }
+}
+
+TEST( FloatConversionTest, BulkHalfConversionHandlesOddLengthsAndOffsets )
+{
+    const auto halves = AllHalves();
+    // Lengths around the vector widths, starting off alignment, so vector bodies and scalar tails both run
+    for ( size_t offset = 0; offset < 4; ++offset )
+    {
+        for ( size_t count = 0; count <= 37; ++count )
+        {
+            const size_t       first = 0x3C00 - 16 + offset * 997;
+            std::vector<float> output( count + 1, -1.0f );
+            ConvertHalfToFloat( gsl::span<const uint16_t>( halves.data() + first, count ),
+                                gsl::span<float>( output.data(), count ) );
+            for ( size_t i = 0; i < count; ++i )
+            {
+                ASSERT_EQ( Bits( output[i] ), Bits( HalfToFloat( halves[first + i] ) ) )
+                    << "offset " << offset << " count " << count << " index " << i;
+            }
+            // Nothing written past the end
+            ASSERT_EQ( output[count], -1.0f );
+        }
+    }
+}
+
+namespace
+{
+    struct Quantization
+    {
+        float scale;
+        float zeroPoint;
+    };
+
+    const Quantization QUANTIZATIONS[] = { { 1.0f, 0.0f }, { 0.5f, -3.0f }, { 0.0123f, 128.5f }, { -2.0f, 7.0f } };
+
+    template <typename T>
+    float ReferenceInt( T value, const Quantization &quantization )
+    {
+        return ( static_cast<float>( value ) - quantization.zeroPoint ) * quantization.scale;
+    }
+
+    template <typename T, typename Convert>
+    void ExpectIntConversion( const std::vector<T> &values, Convert convert )
+    {
+        for ( const auto &quantization : QUANTIZATIONS )
+        {
+            // Whole buffer, then lengths around the vector widths at unaligned offsets for the tails
+            std::vector<float> output( values.size() );
+            convert( gsl::span<const T>( values ), gsl::span<float>( output ), quantization );
+            for ( size_t i = 0; i < values.size(); ++i )
+            {
+                ASSERT_EQ( Bits( output[i] ), Bits( ReferenceInt( values[i], quantization ) ) )
+                    << "value " << +values[i] << " scale " << quantization.scale;
+            }
+
+            for ( size_t offset = 0; offset < 4; ++offset )
+            {
+                for ( size_t count = 0; count <= 37 && offset + count <= values.size(); ++count )
+                {
+                    std::vector<float> partial( count + 1, -1.0f );
+                    convert( gsl::span<const T>( values.data() + offset, count ),
+                             gsl::span<float>( partial.data(), count ),
+                             quantization );
+                    for ( size_t i = 0; i < count; ++i )
+                    {
+                        ASSERT_EQ( Bits( partial[i] ), Bits( ReferenceInt( values[offset + i], quantization ) ) )
+                            << "offset " << offset << " count " << count << " index " << i;
+                    }
+                    ASSERT_EQ( partial[count], -1.0f );
+                }
+            }
+        }
+    }
+}
+
+TEST( FloatConversionTest, Int8MatchesScalarForAllValues )
+{
+    std::vector<int8_t> values;
+    for ( int i = -128; i < 128; ++i )
+    {
+        values.push_back( static_cast<int8_t>( i ) );
+    }
+    ExpectIntConversion( values,
+                         []( gsl::span<const int8_t> input, gsl::span<float> output, const Quantization &q )
+                         { ConvertInt8ToFloat( input, output, q.scale, q.zeroPoint ); } );
+}
+
+TEST( FloatConversionTest, Int16MatchesScalarForAllValues )
+{
+    std::vector<int16_t> values;
+    for ( int i = -32768; i < 32768; ++i )
+    {
+        values.push_back( static_cast<int16_t>( i ) );
+    }
+    ExpectIntConversion( values,
+                         []( gsl::span<const int16_t> input, gsl::span<float> output, const Quantization &q )
+                         { ConvertInt16ToFloat( input, output, q.scale, q.zeroPoint ); } );
+}
+
+TEST( FloatConversionTest, Int32MatchesScalarIncludingRoundedValues )
+{
+    // Small values, the edges of exact float integers, and values that have to round
+    std::vector<int32_t> values = { 0,
+                                    1,
+                                    -1,
+                                    127,
+                                    -128,
+                                    65535,
+                                    ( 1 << 24 ) - 1,
+                                    1 << 24,
+                                    ( 1 << 24 ) + 1,
+                                    ( 1 << 24 ) + 3,
+                                    -( ( 1 << 24 ) + 1 ),
+                                    std::numeric_limits<int32_t>::max(),
+                                    std::numeric_limits<int32_t>::min(),
+                                    std::numeric_limits<int32_t>::max() - 64,
+                                    123456789,
+                                    -987654321 };
+    for ( int32_t i = 0; i < 100; ++i )
+    {
+        values.push_back( static_cast<int32_t>( static_cast<uint32_t>( i ) * 2654435761u ) );
+    }
+    ExpectIntConversion( values,
+                         []( gsl::span<const int32_t> input, gsl::span<float> output, const Quantization &q )
+                         { ConvertInt32ToFloat( input, output, q.scale, q.zeroPoint ); } );
+}
@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "datasplitter/ImageSplitter.hpp"
+#include "util/sha256.hpp"
+
+using sgns::sgprocessing::ImageSplitter;
+
+namespace
+{
+    constexpr uint64_t BLOCK_LEN = 16;
+
+    /** Image of one contiguous block per value, each filled with its value
+    */
+    std::vector<uint8_t> MakeImage( const std::vector<uint8_t> &blockValues )
+    {
+        std::vector<uint8_t> image;
+        for ( auto value : blockValues )
+        {
+            image.insert( image.end(), BLOCK_LEN, value );
+        }
+        return image;
+    }
+
+    std::vector<uint8_t> Cid( const std::vector<uint8_t> &bytes )
+    {
+        return sgns::sgprocmanagersha::sha256( bytes.data(), bytes.size() );
+    }
+}
+
+TEST( ImageSplitterTest, FindsEveryPartByCid )
+{
+    std::vector<uint8_t> values;
+    for ( int i = 0; i < 200; ++i )
+    {
+        values.push_back( static_cast<uint8_t>( i ) );
+    }
+    const auto    image = MakeImage( values );
+    ImageSplitter splitter( image, BLOCK_LEN, 0, BLOCK_LEN, 1 );
+    ASSERT_EQ( splitter.GetPartCount(), values.size() );
+
+    std::vector<std::vector<uint8_t>> cids;
+    for ( size_t part = 0; part < values.size(); ++part )
+    {
+        const auto cid = splitter.GetPartCID( static_cast<int>( part ) );
+        EXPECT_EQ( cid, Cid( splitter.GetPart( static_cast<int>( part ) ) ) );
+        EXPECT_EQ( splitter.GetPartByCid( cid ), part );
+        cids.push_back( cid );
+    }
+
+    const auto parts = splitter.GetPartsByCid( cids );
+    for ( size_t part = 0; part < parts.size(); ++part )
+    {
+        EXPECT_EQ( parts[part], part );
+    }
+}
+
+TEST( ImageSplitterTest, IdenticalBlocksResolveToTheFirstPart )
+{
+    // Parts 1, 3 and 6 share their bytes and so their CID
+    const auto    image = MakeImage( { 1, 7, 2, 7, 3, 4, 7, 5 } );
+    ImageSplitter splitter( image, BLOCK_LEN, 0, BLOCK_LEN, 1 );
+
+    EXPECT_EQ( splitter.GetPartCID( 1 ), splitter.GetPartCID( 3 ) );
+    EXPECT_EQ( splitter.GetPartCID( 1 ), splitter.GetPartCID( 6 ) );
+    EXPECT_EQ( splitter.GetPartByCid( splitter.GetPartCID( 6 ) ), 1u );
+    EXPECT_EQ( splitter.GetPartByCid( splitter.GetPartCID( 5 ) ), 5u );
+    EXPECT_EQ( splitter.GetPartByCid( splitter.GetPartCID( 7 ) ), 7u );
+}
+
+TEST( ImageSplitterTest, UnknownCidIsNotFound )
+{
+    const auto    image = MakeImage( { 1, 2, 3, 4 } );
+    ImageSplitter splitter( image, BLOCK_LEN, 0, BLOCK_LEN, 1 );
+
+    EXPECT_EQ( splitter.GetPartByCid( Cid( std::vector<uint8_t>( BLOCK_LEN, 9 ) ) ), static_cast<size_t>( -1 ) );
+    EXPECT_EQ( splitter.GetPartByCid( std::vector<uint8_t>( 5, 1 ) ), static_cast<size_t>( -1 ) );
+    EXPECT_EQ( splitter.GetPartByCid( {} ), static_cast<size_t>( -1 ) );
+}
+
+TEST( ImageSplitterTest, CidsDoNotDependOnWorkerCount )
+{
+    // Enough parts for several hashing threads, with a run of duplicates spread over them
+    std::vector<uint8_t> values;
+    for ( int i = 0; i < 1000; ++i )
+    {
+        values.push_back( static_cast<uint8_t>( i % 251 ) );
+    }
+    const auto image = MakeImage( values );
+
+    ImageSplitter single( image, BLOCK_LEN, 0, BLOCK_LEN, 1 );
+    single.SetWorkerCount( 1 );
+    ImageSplitter parallel( image, BLOCK_LEN, 0, BLOCK_LEN, 1 );
+    parallel.SetWorkerCount( 8 );
+
+    for ( int part = 0; part < static_cast<int>( values.size() ); ++part )
+    {
+        const auto cid = single.GetPartCID( part );
+        EXPECT_EQ( parallel.GetPartCID( part ), cid );
+        EXPECT_EQ( parallel.GetPartByCid( cid ), static_cast<size_t>( part % 251 ) );
+    }
+}
+
+TEST( ImageSplitterTest, StridedPartsHashLikeTheirCopies )
+{
+    // 4 x 4 image of 2 x 2 blocks, one byte per pixel, split by rows of blocks
+    std::vector<uint8_t> image( 16 );
+    for ( size_t i = 0; i < image.size(); ++i )
+    {
+        image[i] = static_cast<uint8_t>( i );
+    }
+    ImageSplitter rows( image, 4, 0, 8, 1 );
+    ASSERT_EQ( rows.GetPartCount(), 2u );
+
+    ImageSplitter blocks( rows.GetPartView( 1 ), 2, 2, 4, 1 );
+    ASSERT_EQ( blocks.GetPartCount(), 2u );
+    for ( int part = 0; part < 2; ++part )
+    {
+        const auto bytes = blocks.GetPart( part );
+        EXPECT_EQ( blocks.GetPartCID( part ), Cid( bytes ) );
+        EXPECT_EQ( blocks.GetPartByCid( Cid( bytes ) ), static_cast<size_t>( part ) );
+    }
+}
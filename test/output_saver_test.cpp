@@ -0,0 +1,137 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "processingbase/OutputSaver.hpp"
+
+using sgns::sgprocessing::OutputSaver;
+
+class OutputSaverTest : public ::testing::Test
+{
+protected:
+    /** Save function that only records each save, the test completes them itself
+    */
+    OutputSaver::SaveFunction RecordingSave()
+    {
+        return [this]( const std::string &url,
+                       OutputSaver::SaveBuffers,
+                       const std::shared_ptr<boost::asio::io_context> &,
+                       std::function<void( bool )> done )
+        {
+            std::lock_guard<std::mutex> lock( mutex_ );
+            urls_.push_back( url );
+            completions_.push_back( std::move( done ) );
+        };
+    }
+
+    /** Wait until the saver thread started the given number of saves
+    */
+    bool WaitForSaves( size_t count )
+    {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds( 5 );
+        while ( std::chrono::steady_clock::now() < deadline )
+        {
+            {
+                std::lock_guard<std::mutex> lock( mutex_ );
+                if ( completions_.size() >= count )
+                {
+                    return true;
+                }
+            }
+            std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+        }
+        return false;
+    }
+
+    std::function<void( bool )> Completion( size_t index )
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        return completions_.at( index );
+    }
+
+    static std::vector<std::pair<std::string, OutputSaver::SaveBuffers>> MakeSaves( size_t count )
+    {
+        std::vector<std::pair<std::string, OutputSaver::SaveBuffers>> saves;
+        for ( size_t i = 0; i < count; ++i )
+        {
+            saves.emplace_back( "file:///out/" + std::to_string( i ),
+                                std::make_shared<std::pair<std::vector<std::string>, std::vector<std::vector<char>>>>() );
+        }
+        return saves;
+    }
+
+    static bool IsReady( const std::shared_future<bool> &future )
+    {
+        return future.wait_for( std::chrono::seconds( 0 ) ) == std::future_status::ready;
+    }
+
+    std::mutex                               mutex_;
+    std::vector<std::string>                 urls_;
+    std::vector<std::function<void( bool )>> completions_;
+};
+
+TEST_F( OutputSaverTest, JobResolvesOnceEverySaveFinished )
+{
+    OutputSaver saver( OutputSaver::DEFAULT_SHUTDOWN_TIMEOUT, RecordingSave() );
+    auto        saved = saver.SaveAll( MakeSaves( 3 ) );
+    ASSERT_TRUE( WaitForSaves( 3 ) );
+    EXPECT_EQ( saver.GetPendingCount(), 3u );
+
+    // Completions arrive on whatever thread the loader finishes on
+    std::thread( Completion( 0 ), true ).join();
+    std::thread( Completion( 1 ), true ).join();
+    EXPECT_FALSE( IsReady( saved ) );
+    EXPECT_EQ( saver.GetPendingCount(), 1u );
+
+    std::thread( Completion( 2 ), true ).join();
+    ASSERT_TRUE( IsReady( saved ) );
+    EXPECT_TRUE( saved.get() );
+    EXPECT_TRUE( saver.WaitIdle( std::chrono::milliseconds( 0 ) ) );
+}
+
+TEST_F( OutputSaverTest, OneFailedSaveFailsTheJob )
+{
+    OutputSaver saver( OutputSaver::DEFAULT_SHUTDOWN_TIMEOUT, RecordingSave() );
+    auto        saved = saver.SaveAll( MakeSaves( 2 ) );
+    ASSERT_TRUE( WaitForSaves( 2 ) );
+    Completion( 0 )( false );
+    Completion( 1 )( true );
+    ASSERT_TRUE( IsReady( saved ) );
+    EXPECT_FALSE( saved.get() );
+}
+
+TEST_F( OutputSaverTest, EarlierFailureCarriesIntoTheJob )
+{
+    OutputSaver saver( OutputSaver::DEFAULT_SHUTDOWN_TIMEOUT, RecordingSave() );
+    EXPECT_FALSE( saver.SaveAll( {}, false ).get() );
+
+    auto saved = saver.SaveAll( MakeSaves( 1 ), false );
+    ASSERT_TRUE( WaitForSaves( 1 ) );
+    Completion( 0 )( true );
+    EXPECT_FALSE( saved.get() );
+}
+
+TEST_F( OutputSaverTest, TimedOutShutdownFailsTheJobAndIgnoresLateSaves )
+{
+    std::shared_future<bool> saved;
+    {
+        OutputSaver saver( std::chrono::milliseconds( 50 ), RecordingSave() );
+        saved = saver.SaveAll( MakeSaves( 2 ) );
+        ASSERT_TRUE( WaitForSaves( 2 ) );
+        Completion( 0 )( true );
+    }
+    ASSERT_TRUE( IsReady( saved ) );
+    EXPECT_FALSE( saved.get() );
+
+    // The saver is gone, a save finishing now must neither crash nor complete the job again
+    std::thread( Completion( 1 ), true ).join();
+    EXPECT_FALSE( saved.get() );
+}
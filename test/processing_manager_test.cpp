@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+
+#include "processingbase/ProcessingManager.hpp"
+#include "processors/processing_window_stitcher.hpp"
+
+using sgns::sgprocessing::OutputBuffer;
+using sgns::sgprocessing::ProcessingManager;
+using sgns::sgprocessing::WindowStitcher;
+
+namespace
+{
+    constexpr int LENGTH        = 500;
+    constexpr int WINDOW_LENGTH = 64;
+    constexpr int STRIDE        = 48;
+    constexpr int CHANNELS      = 2;
+
+    /** Processing json with one texture3D input and one output at outputUrl
+    */
+    std::string MakeJson( const std::string &outputUrl )
+    {
+        return R"({
+            "name": "stream-test",
+            "version": "1.0.0",
+            "gnus_spec_version": 1.0,
+            "inputs": [ {
+                "name": "inputVolume",
+                "source_uri_param": "file:///nonexistent/input.raw",
+                "type": "texture3D",
+                "dimensions": { "width": 8, "height": 8, "chunk_count": 1, "chunk_subchunk_width": 8,
+                                "chunk_subchunk_height": 8, "block_len": 8 },
+                "format": "FLOAT32"
+            } ],
+            "outputs": [ { "name": "stitched", "source_uri_param": ")" +
+               outputUrl + R"(", "type": "tensor" } ],
+            "parameters": [ { "name": "streamOutput", "type": "int", "default": 1 } ],
+            "passes": [ {
+                "name": "inference",
+                "type": "inference",
+                "model": {
+                    "source_uri_param": "file:///nonexistent/model.mnn",
+                    "format": "MNN",
+                    "input_nodes": [ { "name": "input", "type": "tensor", "source": "input:inputVolume" } ],
+                    "output_nodes": [ { "name": "output", "type": "tensor", "target": "output:stitched" } ]
+                }
+            } ]
+        })";
+    }
+
+    /** Stitch the same window outputs into stitcher and hand out the result
+    */
+    OutputBuffer Stitch( WindowStitcher &stitcher )
+    {
+        const auto starts = WindowStitcher::ComputeWindowStarts( LENGTH, WINDOW_LENGTH, STRIDE );
+        for ( size_t window = 0; window < starts.size(); ++window )
+        {
+            std::vector<float> values( static_cast<size_t>( CHANNELS ) * WINDOW_LENGTH );
+            for ( size_t i = 0; i < values.size(); ++i )
+            {
+                values[i] = static_cast<float>( ( window * 31 + i * 7 ) % 53 ) / 3.0f;
+            }
+            std::unique_ptr<MNN::Tensor> output(
+                MNN::Tensor::create<float>( { 1, CHANNELS, WINDOW_LENGTH }, values.data(), MNN::Tensor::CAFFE ) );
+            EXPECT_TRUE( stitcher.Add( window, *output ) );
+        }
+        EXPECT_TRUE( stitcher.Finish() );
+        return stitcher.TakeOutput();
+    }
+
+    class ProcessingManagerStreamTest : public ::testing::Test
+    {
+    protected:
+        void SetUp() override
+        {
+            std::random_device random;
+            root_ = std::filesystem::temp_directory_path() /
+                    ( "sgprocmanager-stream-test-" + std::to_string( random() ) );
+            std::filesystem::create_directories( root_ / "spool" );
+            std::filesystem::create_directories( root_ / "out" );
+        }
+
+        void TearDown() override
+        {
+            std::error_code error;
+            std::filesystem::remove_all( root_, error );
+        }
+
+        std::filesystem::path root_;
+    };
+}
+
+TEST_F( ProcessingManagerStreamTest, StreamedOutputLandsAtDeclaredUrl )
+{
+    const auto destination = root_ / "out" / "stitched.raw";
+    auto       manager     = ProcessingManager::Create( MakeJson( "file://" + destination.generic_string() ) );
+    ASSERT_TRUE( manager );
+    manager.value()->SetStreamDirectory( root_ / "spool" );
+
+    const auto processing = manager.value()->GetProcessingData();
+    const auto parameters = processing.get_parameters();
+    ASSERT_TRUE( parameters );
+
+    const auto     starts = WindowStitcher::ComputeWindowStarts( LENGTH, WINDOW_LENGTH, STRIDE );
+    WindowStitcher inMemory( starts, LENGTH, WINDOW_LENGTH );
+    const auto     expected = Stitch( inMemory );
+
+    WindowStitcher streamed( starts, LENGTH, WINDOW_LENGTH );
+    ASSERT_TRUE( streamed.StreamFromParameters( &parameters.value(), root_ / "spool" ) );
+    std::vector<OutputBuffer> outputs;
+    outputs.push_back( Stitch( streamed ) );
+    ASSERT_FALSE( outputs[0].GetFile().empty() );
+
+    manager.value()->SaveOutputs( std::make_shared<boost::asio::io_context>(), outputs );
+    EXPECT_TRUE( manager.value()->GetOutputsSaved().get() );
+
+    std::ifstream     saved( destination, std::ios::binary );
+    std::vector<char> bytes( ( std::istreambuf_iterator<char>( saved ) ), std::istreambuf_iterator<char>() );
+    const auto        expectedBytes = expected.GetBytes();
+    ASSERT_EQ( bytes.size(), expectedBytes.size() );
+    EXPECT_TRUE( std::equal( bytes.begin(), bytes.end(), expectedBytes.begin() ) );
+
+    // The spool file was moved into place, nothing is left behind
+    outputs.clear();
+    EXPECT_TRUE( std::filesystem::is_empty( root_ / "spool" ) );
+}
@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+
+#include "util/ProgressiveInput.hpp"
+
+using sgns::sgprocessing::ProgressiveInput;
+
+namespace
+{
+    gsl::span<const char> Bytes( const std::string &text )
+    {
+        return gsl::span<const char>( text.data(), text.size() );
+    }
+}
+
+TEST( ProgressiveInputTest, ReaderWaitsForEachPrefix )
+{
+    const std::string data = "0123456789abcdef";
+    ProgressiveInput  input;
+    std::thread       loader(
+        [&]
+        {
+            ASSERT_TRUE( input.SetSize( data.size() ) );
+            for ( size_t offset = 0; offset < data.size(); offset += 3 )
+            {
+                ASSERT_TRUE( input.Append( Bytes( data.substr( offset, 3 ) ) ) );
+            }
+            input.Finish( true );
+        } );
+
+    ASSERT_EQ( input.WaitForSize(), data.size() );
+    for ( size_t prefix = 0; prefix <= data.size(); ++prefix )
+    {
+        ASSERT_TRUE( input.WaitFor( prefix ) );
+        EXPECT_EQ( std::string( input.GetData().data(), prefix ), data.substr( 0, prefix ) );
+    }
+    loader.join();
+    EXPECT_EQ( input.GetAvailable(), data.size() );
+}
+
+TEST( ProgressiveInputTest, AppendPastTheSizeIsRejected )
+{
+    ProgressiveInput input;
+    EXPECT_FALSE( input.Append( Bytes( "early" ) ) );
+    ASSERT_TRUE( input.SetSize( 4 ) );
+    EXPECT_FALSE( input.SetSize( 8 ) );
+    EXPECT_TRUE( input.Append( Bytes( "abc" ) ) );
+    EXPECT_FALSE( input.Append( Bytes( "de" ) ) );
+    EXPECT_EQ( input.GetAvailable(), 3u );
+}
+
+TEST( ProgressiveInputTest, ShortLoadFailsEvenIfReportedAsSucceeded )
+{
+    ProgressiveInput input;
+    ASSERT_TRUE( input.SetSize( 6 ) );
+    ASSERT_TRUE( input.Append( Bytes( "abc" ) ) );
+    input.Finish( true );
+    // A failed load is unusable as a whole, even the bytes that did arrive
+    EXPECT_FALSE( input.WaitFor( 3 ) );
+    EXPECT_FALSE( input.WaitFor( 4 ) );
+    EXPECT_EQ( input.WaitForSize(), std::nullopt );
+}
+
+TEST( ProgressiveInputTest, FailureBeforeTheSizeWakesReaders )
+{
+    ProgressiveInput input;
+    std::thread      loader( [&] { input.Finish( false ); } );
+    EXPECT_EQ( input.WaitForSize(), std::nullopt );
+    EXPECT_FALSE( input.WaitFor( 1 ) );
+    loader.join();
+}
@@ -0,0 +1,238 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <openssl/evp.h>
+
+#include "util/sha256.hpp"
+
+using sgns::sgprocmanagersha::Sha256Backend;
+using sgns::sgprocmanagersha::Sha256Digest;
+using sgns::sgprocmanagersha::Sha256Input;
+using sgns::sgprocmanagersha::Sha256MerkleTree;
+
+namespace
+{
+    /** Digest straight from OpenSSL, independent of the hasher under test
+    */
+    Sha256Digest OpenSslDigest( const std::vector<uint8_t> &message )
+    {
+        Sha256Digest digest{};
+        unsigned int digestLen = 0;
+        EXPECT_EQ( EVP_Digest( message.data(), message.size(), digest.data(), &digestLen, EVP_sha256(), nullptr ), 1 );
+        return digest;
+    }
+
+    std::vector<std::vector<uint8_t>> MakeMessages( const std::vector<size_t> &sizes, uint32_t seed )
+    {
+        std::mt19937                      random( seed );
+        std::vector<std::vector<uint8_t>> messages;
+        for ( auto size : sizes )
+        {
+            std::vector<uint8_t> message( size );
+            for ( auto &byte : message )
+            {
+                byte = static_cast<uint8_t>( random() );
+            }
+            messages.push_back( std::move( message ) );
+        }
+        return messages;
+    }
+
+    /** Merkle tree hash straight from the RFC 6962 definition, MTH( D[n] ) split at the largest
+    * power of two below n, with the chunk digests as leaf data
+    */
+    Sha256Digest Rfc6962Root( const std::vector<Sha256Digest> &leaves, size_t begin, size_t end )
+    {
+        std::vector<uint8_t> message;
+        if ( end - begin == 0 )
+        {
+            return OpenSslDigest( message );
+        }
+        if ( end - begin == 1 )
+        {
+            message.push_back( 0x00 );
+            message.insert( message.end(), leaves[begin].begin(), leaves[begin].end() );
+            return OpenSslDigest( message );
+        }
+        size_t split = 1;
+        while ( split * 2 < end - begin )
+        {
+            split *= 2;
+        }
+        const auto left  = Rfc6962Root( leaves, begin, begin + split );
+        const auto right = Rfc6962Root( leaves, begin + split, end );
+        message.push_back( 0x01 );
+        message.insert( message.end(), left.begin(), left.end() );
+        message.insert( message.end(), right.begin(), right.end() );
+        return OpenSslDigest( message );
+    }
+
+    std::vector<Sha256Digest> MakeDigests( size_t count )
+    {
+        std::vector<Sha256Digest> digests;
+        for ( const auto &message : MakeMessages( std::vector<size_t>( count, 48 ), static_cast<uint32_t>( count ) ) )
+        {
+            digests.push_back( OpenSslDigest( message ) );
+        }
+        return digests;
+    }
+
+    void ExpectMatchesOpenSsl( const std::vector<std::vector<uint8_t>> &messages, Sha256Backend backend )
+    {
+        std::vector<Sha256Input> inputs;
+        for ( const auto &message : messages )
+        {
+            inputs.push_back( Sha256Input{ message.data(), message.size() } );
+        }
+        const auto digests = sgns::sgprocmanagersha::sha256Batch( inputs, backend );
+        ASSERT_EQ( digests.size(), messages.size() );
+        for ( size_t i = 0; i < messages.size(); ++i )
+        {
+            EXPECT_EQ( digests[i], OpenSslDigest( messages[i] ) ) << "message " << i << " of " << messages[i].size()
+                                                                  << " bytes";
+        }
+    }
+}
+
+class Sha256BatchTest : public ::testing::TestWithParam<Sha256Backend>
+{
+};
+
+TEST_P( Sha256BatchTest, EqualSizesAroundBlockBoundaries )
+{
+    // Every padding case: empty, length fitting in the last block, length spilling into an extra block
+    for ( size_t size = 0; size <= 192; ++size )
+    {
+        // Full runs of eight lanes, a partial run, and a message hashed on its own
+        const std::vector<size_t> sizes( 19, size );
+        ExpectMatchesOpenSsl( MakeMessages( sizes, static_cast<uint32_t>( size ) ), GetParam() );
+    }
+}
+
+TEST_P( Sha256BatchTest, MixedSizesKeepInputOrder )
+{
+    std::vector<size_t> sizes;
+    for ( size_t i = 0; i < 64; ++i )
+    {
+        sizes.push_back( ( i * 37 ) % 5 == 0 ? 4099 : 1 + ( i * 37 ) % 131 );
+    }
+    ExpectMatchesOpenSsl( MakeMessages( sizes, 7 ), GetParam() );
+}
+
+TEST_P( Sha256BatchTest, LargeOddSizedMessages )
+{
+    ExpectMatchesOpenSsl( MakeMessages( std::vector<size_t>( 11, 65537 ), 3 ), GetParam() );
+}
+
+TEST_P( Sha256BatchTest, EmptyBatch )
+{
+    EXPECT_TRUE( sgns::sgprocmanagersha::sha256Batch( std::vector<Sha256Input>(), GetParam() ).empty() );
+}
+
+INSTANTIATE_TEST_SUITE_P( Backends,
+                          Sha256BatchTest,
+                          ::testing::Values( Sha256Backend::OpenSsl, Sha256Backend::Avx2MultiBuffer ),
+                          []( const ::testing::TestParamInfo<Sha256Backend> &info )
+                          { return info.param == Sha256Backend::OpenSsl ? "OpenSsl" : "Avx2MultiBuffer"; } );
+
+TEST( Sha256Test, DetectedBackendMatchesOpenSsl )
+{
+    const auto               messages = MakeMessages( std::vector<size_t>( 9, 100 ), 11 );
+    std::vector<Sha256Input> inputs;
+    for ( const auto &message : messages )
+    {
+        inputs.push_back( Sha256Input{ message.data(), message.size() } );
+    }
+    const auto digests = sgns::sgprocmanagersha::sha256Batch( inputs );
+    for ( size_t i = 0; i < messages.size(); ++i )
+    {
+        EXPECT_EQ( digests[i], OpenSslDigest( messages[i] ) );
+    }
+}
+
+TEST( Sha256ChainTest, MatchesLegacyConcatenationChain )
+{
+    // The chain the processors used before Sha256Chain: hash the previous hash and the chunk hash
+    // concatenated as strings, starting from 32 zero bytes
+    const auto           chunks = MakeMessages( { 0, 1, 63, 64, 65, 1000, 4099 }, 5 );
+    std::vector<uint8_t> legacyHash( sgns::sgprocmanagersha::SHA256_SIZE );
+
+    sgns::sgprocmanagersha::Sha256Chain chain;
+    EXPECT_EQ( chain.GetHashBytes(), legacyHash );
+    for ( const auto &chunk : chunks )
+    {
+        const auto  chunkHash = sgns::sgprocmanagersha::sha256( chunk.data(), chunk.size() );
+        std::string hashString( chunkHash.begin(), chunkHash.end() );
+        std::string combinedHash = std::string( legacyHash.begin(), legacyHash.end() ) + hashString;
+        legacyHash               = sgns::sgprocmanagersha::sha256( combinedHash.c_str(), combinedHash.length() );
+
+        const auto chunkDigest = chain.Append( chunk.data(), chunk.size() );
+        EXPECT_EQ( std::vector<uint8_t>( chunkDigest.begin(), chunkDigest.end() ), chunkHash );
+        EXPECT_EQ( chain.GetHashBytes(), legacyHash );
+    }
+}
+
+TEST( Sha256ChainTest, AppendDigestMatchesAppend )
+{
+    const auto                          chunks = MakeMessages( { 3, 64, 200 }, 9 );
+    sgns::sgprocmanagersha::Sha256Chain fromBytes;
+    sgns::sgprocmanagersha::Sha256Chain fromDigests;
+    for ( const auto &chunk : chunks )
+    {
+        fromBytes.Append( chunk.data(), chunk.size() );
+        fromDigests.AppendDigest( OpenSslDigest( chunk ) );
+    }
+    EXPECT_EQ( fromBytes.GetHash(), fromDigests.GetHash() );
+}
+
+TEST( Sha256MerkleTreeTest, EmptyTreeIsHashOfNothing )
+{
+    // RFC 6962 2.1: MTH({}) = SHA-256()
+    const Sha256Digest expected = { 0xe3, 0xb0, 0xc4, 0x42, 0x98, 0xfc, 0x1c, 0x14, 0x9a, 0xfb, 0xf4,
+                                    0xc8, 0x99, 0x6f, 0xb9, 0x24, 0x27, 0xae, 0x41, 0xe4, 0x64, 0x9b,
+                                    0x93, 0x4c, 0xa4, 0x95, 0x99, 0x1b, 0x78, 0x52, 0xb8, 0x55 };
+    EXPECT_EQ( Sha256MerkleTree().GetRoot(), expected );
+    EXPECT_EQ( Sha256MerkleTree::ComputeRoot( std::vector<Sha256Digest>(), 4 ), expected );
+}
+
+TEST( Sha256MerkleTreeTest, MatchesRfc6962Definition )
+{
+    for ( size_t count : { 1, 2, 3, 4, 5, 7, 8, 9, 17, 33 } )
+    {
+        const auto digests  = MakeDigests( count );
+        const auto expected = Rfc6962Root( digests, 0, digests.size() );
+
+        Sha256MerkleTree tree;
+        for ( const auto &digest : digests )
+        {
+            tree.AppendDigest( digest );
+        }
+        EXPECT_EQ( tree.GetLeafCount(), count );
+        EXPECT_EQ( tree.GetRoot(), expected ) << count << " leaves, incremental";
+        EXPECT_EQ( Sha256MerkleTree::ComputeRoot( digests, 1 ), expected ) << count << " leaves, one thread";
+    }
+}
+
+TEST( Sha256MerkleTreeTest, IncrementalMatchesParallelRoot )
+{
+    // Counts past MIN_HASHES_PER_WORKER per thread so ComputeRoot really splits the levels
+    for ( size_t count : { 0, 1, 2, 3, 5, 1025, 4097 } )
+    {
+        const auto       digests = MakeDigests( count );
+        Sha256MerkleTree tree;
+        for ( size_t i = 0; i < digests.size(); ++i )
+        {
+            tree.AppendDigest( digests[i] );
+            // The root is readable at any point and adding more leaves afterwards still works
+            if ( i + 1 == digests.size() / 2 )
+            {
+                EXPECT_EQ( tree.GetRoot(), Rfc6962Root( digests, 0, i + 1 ) );
+            }
+        }
+        EXPECT_EQ( tree.GetRoot(), Sha256MerkleTree::ComputeRoot( digests, 8 ) ) << count << " leaves";
+    }
+}
@@ -0,0 +1,175 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "processors/processing_signal_source.hpp"
+#include "util/FloatConversion.hpp"
+
+using sgns::sgprocessing::ProgressiveInput;
+using sgns::sgprocessing::SignalSource;
+
+namespace
+{
+    constexpr size_t ELEMENTS = 1031;
+
+    template <typename T>
+    gsl::span<const char> Bytes( const std::vector<T> &values )
+    {
+        return gsl::span<const char>( reinterpret_cast<const char *>( values.data() ), values.size() * sizeof( T ) );
+    }
+
+    /** Read the signal in overlapping windows, the last one running past the end, and compare each
+    * window with the same range of the whole signal converted at once
+    */
+    void ExpectWindowsMatch( SignalSource &signal, const std::vector<float> &expected )
+    {
+        for ( bool materialized : { false, true } )
+        {
+            if ( materialized )
+            {
+                signal.Materialize();
+            }
+            constexpr size_t WINDOW = 100;
+            for ( size_t start = 0; start < ELEMENTS; start += 37 )
+            {
+                std::vector<float> window( WINDOW, -7.0f );
+                const size_t       read = signal.Read( start, window );
+                ASSERT_EQ( read, std::min( WINDOW, ELEMENTS - start ) );
+                for ( size_t i = 0; i < WINDOW; ++i )
+                {
+                    // Floats past the signal end keep whatever the caller put there
+                    const float value = i < read ? expected[start + i] : -7.0f;
+                    ASSERT_EQ( window[i], value ) << "start " << start << " index " << i << " materialized "
+                                                  << materialized;
+                }
+            }
+            std::vector<float> past( 4, -7.0f );
+            EXPECT_EQ( signal.Read( ELEMENTS, past ), 0u );
+        }
+    }
+}
+
+TEST( SignalSourceTest, Float32IsReadInPlace )
+{
+    std::vector<float> values( ELEMENTS );
+    for ( size_t i = 0; i < ELEMENTS; ++i )
+    {
+        values[i] = static_cast<float>( i ) * 0.5f - 100.0f;
+    }
+    SignalSource signal( Bytes( values ), sgns::InputFormat::FLOAT32, ELEMENTS );
+    ExpectWindowsMatch( signal, values );
+}
+
+TEST( SignalSourceTest, Float16MatchesWholeConversion )
+{
+    std::mt19937          random( 3 );
+    std::vector<uint16_t> halves( ELEMENTS );
+    for ( auto &half : halves )
+    {
+        // Finite halves only, so every value compares equal to itself
+        half = static_cast<uint16_t>( random() & 0xFBFF );
+    }
+    std::vector<float> expected( ELEMENTS );
+    sgns::sgprocessing::ConvertHalfToFloat( halves, expected );
+
+    SignalSource signal( Bytes( halves ), sgns::InputFormat::FLOAT16, ELEMENTS );
+    ExpectWindowsMatch( signal, expected );
+}
+
+TEST( SignalSourceTest, IntegersAreDequantized )
+{
+    constexpr float scale     = 0.25f;
+    constexpr float zeroPoint = 3.0f;
+
+    std::mt19937         random( 5 );
+    std::vector<int32_t> ints32( ELEMENTS );
+    std::vector<int16_t> ints16( ELEMENTS );
+    std::vector<int8_t>  ints8( ELEMENTS );
+    for ( size_t i = 0; i < ELEMENTS; ++i )
+    {
+        ints32[i] = static_cast<int32_t>( random() % 200001 ) - 100000;
+        ints16[i] = static_cast<int16_t>( random() );
+        ints8[i]  = static_cast<int8_t>( random() );
+    }
+
+    std::vector<float> expected( ELEMENTS );
+    sgns::sgprocessing::ConvertInt32ToFloat( ints32, expected, scale, zeroPoint );
+    SignalSource signal32( Bytes( ints32 ), sgns::InputFormat::INT32, ELEMENTS, scale, zeroPoint );
+    ExpectWindowsMatch( signal32, expected );
+
+    sgns::sgprocessing::ConvertInt16ToFloat( ints16, expected, scale, zeroPoint );
+    SignalSource signal16( Bytes( ints16 ), sgns::InputFormat::INT16, ELEMENTS, scale, zeroPoint );
+    ExpectWindowsMatch( signal16, expected );
+
+    sgns::sgprocessing::ConvertInt8ToFloat( ints8, expected, scale, zeroPoint );
+    SignalSource signal8( Bytes( ints8 ), sgns::InputFormat::INT8, ELEMENTS, scale, zeroPoint );
+    ExpectWindowsMatch( signal8, expected );
+}
+
+TEST( SignalSourceTest, BooleanInt8IsZeroOrOne )
+{
+    std::vector<int8_t> values( ELEMENTS );
+    std::vector<float>  expected( ELEMENTS );
+    for ( size_t i = 0; i < ELEMENTS; ++i )
+    {
+        values[i]   = static_cast<int8_t>( i % 3 == 0 ? 0 : static_cast<int>( i % 256 ) - 128 );
+        expected[i] = values[i] != 0 ? 1.0f : 0.0f;
+    }
+    SignalSource signal( Bytes( values ),
+                         sgns::InputFormat::INT8,
+                         ELEMENTS,
+                         1.0f,
+                         0.0f,
+                         SignalSource::IntegerValues::Boolean );
+    ExpectWindowsMatch( signal, expected );
+}
+
+TEST( SignalSourceTest, ArrivingInputIsReadOnceItsWindowArrived )
+{
+    std::vector<uint16_t> values( ELEMENTS );
+    for ( size_t i = 0; i < ELEMENTS; ++i )
+    {
+        values[i] = static_cast<uint16_t>( 0x3C00 + i );
+    }
+    std::vector<float> expected( ELEMENTS );
+    sgns::sgprocessing::ConvertHalfToFloat( values, expected );
+
+    const auto bytes = Bytes( values );
+    ProgressiveInput input;
+    ASSERT_TRUE( input.SetSize( bytes.size() ) );
+    SignalSource signal( input.GetData(), sgns::InputFormat::FLOAT16, ELEMENTS );
+    signal.SetProgressiveInput( &input );
+
+    // The loader delivers odd sized pieces, splitting values, while the reader waits for each window
+    std::thread loader(
+        [&]
+        {
+            for ( size_t offset = 0; offset < bytes.size(); offset += 61 )
+            {
+                input.Append( bytes.subspan( offset, std::min<size_t>( 61, bytes.size() - offset ) ) );
+            }
+            input.Finish( true );
+        } );
+    ExpectWindowsMatch( signal, expected );
+    loader.join();
+}
+
+TEST( SignalSourceTest, FailedInputReadsNothing )
+{
+    std::vector<float> values( ELEMENTS, 1.5f );
+    const auto         bytes = Bytes( values );
+    ProgressiveInput   input;
+    ASSERT_TRUE( input.SetSize( bytes.size() ) );
+    ASSERT_TRUE( input.Append( bytes.first( 100 * sizeof( float ) ) ) );
+    input.Finish( false );
+
+    SignalSource signal( input.GetData(), sgns::InputFormat::FLOAT32, ELEMENTS );
+    signal.SetProgressiveInput( &input );
+    std::vector<float> window( 50, -7.0f );
+    EXPECT_EQ( signal.Read( 0, window ), 0u );
+    EXPECT_EQ( window, std::vector<float>( 50, -7.0f ) );
+}
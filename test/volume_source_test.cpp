@@ -0,0 +1,221 @@
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "processors/processing_volume_source.hpp"
+#include "util/FloatConversion.hpp"
+
+using sgns::sgprocessing::VolumeLayout;
+using sgns::sgprocessing::VolumeSource;
+
+namespace
+{
+    // Not multiples of the 16 voxel tile, so every kernel also runs partial tiles
+    constexpr int WIDTH  = 37;
+    constexpr int HEIGHT = 29;
+    constexpr int DEPTH  = 41;
+
+    constexpr VolumeLayout ALL_LAYOUTS[] = { VolumeLayout::HWD, VolumeLayout::HDW, VolumeLayout::WHD,
+                                             VolumeLayout::WDH, VolumeLayout::DHW, VolumeLayout::DWH };
+
+    /** Source index of a voxel, the per voxel switch the volume processor used before the layout kernels
+    */
+    size_t LayoutIndex( VolumeLayout layout, int h, int w, int d, int height, int width, int depth )
+    {
+        switch ( layout )
+        {
+            case VolumeLayout::HWD:
+                return ( static_cast<size_t>( h ) * width + static_cast<size_t>( w ) ) * depth + static_cast<size_t>( d );
+            case VolumeLayout::HDW:
+                return ( static_cast<size_t>( h ) * depth + static_cast<size_t>( d ) ) * width + static_cast<size_t>( w );
+            case VolumeLayout::WHD:
+                return ( static_cast<size_t>( w ) * height + static_cast<size_t>( h ) ) * depth + static_cast<size_t>( d );
+            case VolumeLayout::WDH:
+                return ( static_cast<size_t>( w ) * depth + static_cast<size_t>( d ) ) * height + static_cast<size_t>( h );
+            case VolumeLayout::DHW:
+                return ( static_cast<size_t>( d ) * height + static_cast<size_t>( h ) ) * width + static_cast<size_t>( w );
+            case VolumeLayout::DWH:
+                return ( static_cast<size_t>( d ) * width + static_cast<size_t>( w ) ) * height + static_cast<size_t>( h );
+        }
+        return 0;
+    }
+
+    /** Volume in one format together with the float value of every source element
+    */
+    struct TestVolume
+    {
+        sgns::InputFormat     format;
+        std::vector<float>    floats;
+        std::vector<uint16_t> halves;
+        std::vector<float>    values;
+
+        gsl::span<const char> Bytes() const
+        {
+            if ( format == sgns::InputFormat::FLOAT16 )
+            {
+                return gsl::span<const char>( reinterpret_cast<const char *>( halves.data() ),
+                                              halves.size() * sizeof( uint16_t ) );
+            }
+            return gsl::span<const char>( reinterpret_cast<const char *>( floats.data() ), floats.size() * sizeof( float ) );
+        }
+    };
+
+    TestVolume MakeVolume( sgns::InputFormat format )
+    {
+        const size_t voxels = static_cast<size_t>( WIDTH ) * HEIGHT * DEPTH;
+        TestVolume   volume{ format, {}, {}, std::vector<float>( voxels ) };
+        if ( format == sgns::InputFormat::FLOAT16 )
+        {
+            // Finite halves only, so every decoded value compares equal to itself
+            std::mt19937 random( 1 );
+            volume.halves.resize( voxels );
+            for ( auto &half : volume.halves )
+            {
+                half = static_cast<uint16_t>( random() & 0xFBFF );
+            }
+            sgns::sgprocessing::ConvertHalfToFloat( volume.halves, volume.values );
+        }
+        else
+        {
+            // Distinct values, so a voxel read from the wrong place never matches by accident
+            volume.floats.resize( voxels );
+            for ( size_t i = 0; i < voxels; ++i )
+            {
+                volume.floats[i] = static_cast<float>( i );
+            }
+            volume.values = volume.floats;
+        }
+        return volume;
+    }
+
+    /** Gather one patch and compare every voxel with the reference index, zero past the volume bounds
+    */
+    void ExpectPatchMatches( const TestVolume &volume,
+                             VolumeLayout      layout,
+                             int               x,
+                             int               y,
+                             int               z,
+                             int               patchWidth,
+                             int               patchHeight,
+                             int               patchDepth )
+    {
+        const VolumeSource source( volume.Bytes(), volume.format, layout, WIDTH, HEIGHT, DEPTH );
+        std::vector<float> patch( static_cast<size_t>( patchWidth ) * patchHeight * patchDepth, -1.0f );
+        source.GatherPatch( x, y, z, patchWidth, patchHeight, patchDepth, patch.data() );
+
+        size_t mismatches = 0;
+        for ( int h = 0; h < patchHeight; ++h )
+        {
+            for ( int w = 0; w < patchWidth; ++w )
+            {
+                for ( int d = 0; d < patchDepth; ++d )
+                {
+                    const int   sourceW  = x + w;
+                    const int   sourceH  = y + h;
+                    const int   sourceD  = z + d;
+                    const bool  inside   = sourceW < WIDTH && sourceH < HEIGHT && sourceD < DEPTH;
+                    const float expected = inside ? volume.values[LayoutIndex( layout,
+                                                                               sourceH,
+                                                                               sourceW,
+                                                                               sourceD,
+                                                                               HEIGHT,
+                                                                               WIDTH,
+                                                                               DEPTH )]
+                                                  : 0.0f;
+                    const float actual =
+                        patch[( static_cast<size_t>( h ) * patchWidth + static_cast<size_t>( w ) ) * patchDepth +
+                              static_cast<size_t>( d )];
+                    if ( actual != expected && mismatches++ < 5 )
+                    {
+                        ADD_FAILURE() << VolumeSource::LayoutToString( layout ) << " patch at (" << x << ", " << y
+                                      << ", " << z << ") voxel h " << h << " w " << w << " d " << d << ": got "
+                                      << actual << ", expected " << expected;
+                    }
+                }
+            }
+        }
+        EXPECT_EQ( mismatches, 0u ) << VolumeSource::LayoutToString( layout );
+    }
+}
+
+class VolumeSourceTest : public ::testing::TestWithParam<sgns::InputFormat>
+{
+};
+
+TEST_P( VolumeSourceTest, WholeVolumeMatchesReferenceLayout )
+{
+    const auto volume = MakeVolume( GetParam() );
+    for ( auto layout : ALL_LAYOUTS )
+    {
+        ExpectPatchMatches( volume, layout, 0, 0, 0, WIDTH, HEIGHT, DEPTH );
+    }
+}
+
+TEST_P( VolumeSourceTest, InteriorPatchMatchesReferenceLayout )
+{
+    const auto volume = MakeVolume( GetParam() );
+    for ( auto layout : ALL_LAYOUTS )
+    {
+        ExpectPatchMatches( volume, layout, 7, 5, 3, 20, 18, 33 );
+        ExpectPatchMatches( volume, layout, 1, 2, 3, 1, 1, 1 );
+    }
+}
+
+TEST_P( VolumeSourceTest, BoundaryPatchIsClippedAndZeroPadded )
+{
+    const auto volume = MakeVolume( GetParam() );
+    for ( auto layout : ALL_LAYOUTS )
+    {
+        // Past the far edge along each axis alone, along all of them, and a patch larger than the volume
+        ExpectPatchMatches( volume, layout, 30, 0, 0, 16, 16, 16 );
+        ExpectPatchMatches( volume, layout, 0, 25, 0, 16, 16, 16 );
+        ExpectPatchMatches( volume, layout, 0, 0, 35, 16, 16, 16 );
+        ExpectPatchMatches( volume, layout, 30, 25, 35, 20, 18, 33 );
+        ExpectPatchMatches( volume, layout, 0, 0, 0, WIDTH + 5, HEIGHT + 3, DEPTH + 7 );
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P( Formats,
+                          VolumeSourceTest,
+                          ::testing::Values( sgns::InputFormat::FLOAT32, sgns::InputFormat::FLOAT16 ),
+                          []( const ::testing::TestParamInfo<sgns::InputFormat> &info )
+                          { return info.param == sgns::InputFormat::FLOAT16 ? "Float16" : "Float32"; } );
+
+TEST_P( VolumeSourceTest, RowRangesAssembleTheWholePatch )
+{
+    const auto volume = MakeVolume( GetParam() );
+    for ( auto layout : ALL_LAYOUTS )
+    {
+        const VolumeSource source( volume.Bytes(), volume.format, layout, WIDTH, HEIGHT, DEPTH );
+        // An interior patch and one clipped at the far corner, split into uneven row ranges
+        for ( const auto &origin : { std::array<int, 3>{ 7, 5, 3 }, std::array<int, 3>{ 30, 20, 35 } } )
+        {
+            constexpr int      PATCH_WIDTH  = 20;
+            constexpr int      PATCH_HEIGHT = 18;
+            constexpr int      PATCH_DEPTH  = 33;
+            const size_t       patchSize    = static_cast<size_t>( PATCH_WIDTH ) * PATCH_HEIGHT * PATCH_DEPTH;
+            std::vector<float> whole( patchSize, -1.0f );
+            std::vector<float> pieces( patchSize, -1.0f );
+            source.GatherPatch( origin[0], origin[1], origin[2], PATCH_WIDTH, PATCH_HEIGHT, PATCH_DEPTH, whole.data() );
+            const std::pair<int, int> rowRanges[] = { { 0, 5 }, { 5, 6 }, { 6, 13 }, { 13, PATCH_HEIGHT } };
+            for ( const auto &[rowBegin, rowEnd] : rowRanges )
+            {
+                source.GatherPatchRows( origin[0],
+                                        origin[1],
+                                        origin[2],
+                                        PATCH_WIDTH,
+                                        PATCH_HEIGHT,
+                                        PATCH_DEPTH,
+                                        rowBegin,
+                                        rowEnd,
+                                        pieces.data() );
+            }
+            EXPECT_EQ( pieces, whole ) << VolumeSource::LayoutToString( layout ) << " patch at (" << origin[0] << ", "
+                                       << origin[1] << ", " << origin[2] << ")";
+        }
+    }
+}
@@ -0,0 +1,128 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+#include "processors/processing_window_executor.hpp"
+
+using sgns::sgprocessing::WindowExecutor;
+
+namespace
+{
+    constexpr size_t WINDOW_COUNT = 37;
+
+    std::unique_ptr<MNN::Tensor> MakeOutput( size_t windowIndex )
+    {
+        auto output = std::unique_ptr<MNN::Tensor>( MNN::Tensor::create<float>( { 1 }, nullptr, MNN::Tensor::CAFFE ) );
+        output->host<float>()[0] = static_cast<float>( windowIndex );
+        return output;
+    }
+}
+
+TEST( WindowExecutorTest, MergesEveryWindowInOrder )
+{
+    for ( size_t workers : { 1, 4 } )
+    {
+        std::vector<size_t> merged;
+        const bool          success = WindowExecutor( workers ).Run( WINDOW_COUNT,
+                                                            MakeOutput,
+                                                            [&]( size_t windowIndex, MNN::Tensor &output )
+                                                            {
+                                                                EXPECT_EQ( output.host<float>()[0],
+                                                                           static_cast<float>( windowIndex ) );
+                                                                merged.push_back( windowIndex );
+                                                                return true;
+                                                            } );
+        ASSERT_TRUE( success );
+        ASSERT_EQ( merged.size(), WINDOW_COUNT );
+        for ( size_t i = 0; i < WINDOW_COUNT; ++i )
+        {
+            EXPECT_EQ( merged[i], i );
+        }
+    }
+}
+
+TEST( WindowExecutorTest, ThrowingTaskFailsTheRun )
+{
+    for ( size_t workers : { 1, 4 } )
+    {
+        const bool success = WindowExecutor( workers ).Run(
+            WINDOW_COUNT,
+            []( size_t windowIndex ) -> std::unique_ptr<MNN::Tensor>
+            {
+                if ( windowIndex == 11 )
+                {
+                    throw std::bad_alloc();
+                }
+                return MakeOutput( windowIndex );
+            },
+            []( size_t, MNN::Tensor & ) { return true; } );
+        EXPECT_FALSE( success );
+    }
+}
+
+TEST( WindowExecutorTest, ThrowingMergeFailsTheRun )
+{
+    for ( size_t workers : { 1, 4 } )
+    {
+        const bool success = WindowExecutor( workers ).Run( WINDOW_COUNT,
+                                                            MakeOutput,
+                                                            []( size_t windowIndex, MNN::Tensor & )
+                                                            {
+                                                                if ( windowIndex == 5 )
+                                                                {
+                                                                    throw std::runtime_error( "merge failed" );
+                                                                }
+                                                                return true;
+                                                            } );
+        EXPECT_FALSE( success );
+    }
+}
+
+TEST( WindowExecutorTest, NonStandardMergeExceptionFailsTheRun )
+{
+    for ( size_t workers : { 1, 4 } )
+    {
+        const bool success = WindowExecutor( workers ).Run( WINDOW_COUNT,
+                                                            MakeOutput,
+                                                            []( size_t windowIndex, MNN::Tensor & )
+                                                            {
+                                                                if ( windowIndex == 5 )
+                                                                {
+                                                                    throw 42;
+                                                                }
+                                                                return true;
+                                                            } );
+        EXPECT_FALSE( success );
+    }
+}
+
+TEST( WindowExecutorTest, ThrowingBatchFallsBackToBatchOne )
+{
+    std::vector<size_t> merged;
+    const bool          success = WindowExecutor( 4 ).RunBatched(
+        WINDOW_COUNT,
+        8,
+        []( size_t firstWindow, size_t windowCount, size_t batchSize )
+        {
+            if ( batchSize > 1 )
+            {
+                throw std::bad_alloc();
+            }
+            std::vector<std::unique_ptr<MNN::Tensor>> outputs;
+            for ( size_t i = 0; i < windowCount; ++i )
+            {
+                outputs.push_back( MakeOutput( firstWindow + i ) );
+            }
+            return outputs;
+        },
+        [&]( size_t windowIndex, MNN::Tensor & )
+        {
+            merged.push_back( windowIndex );
+            return true;
+        } );
+    EXPECT_TRUE( success );
+    EXPECT_EQ( merged.size(), WINDOW_COUNT );
+}
@@ -0,0 +1,124 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "processors/processing_window_stitcher.hpp"
+#include "util/sha256.hpp"
+
+using sgns::sgprocessing::OutputSink;
+using sgns::sgprocessing::WindowStitcher;
+
+namespace
+{
+    /** Sink that keeps everything written to it, to compare against the in-memory output
+    */
+    class MemorySink : public OutputSink
+    {
+    public:
+        explicit MemorySink( std::vector<char> &bytes ) : bytes_( bytes ) {}
+
+        bool Write( uint64_t offset, gsl::span<const char> data ) override
+        {
+            if ( bytes_.size() < offset + data.size() )
+            {
+                bytes_.resize( offset + data.size() );
+            }
+            std::memcpy( bytes_.data() + offset, data.data(), data.size() );
+            return true;
+        }
+
+        bool Flush() override
+        {
+            return true;
+        }
+
+        bool Read( uint64_t offset, gsl::span<char> data ) override
+        {
+            if ( bytes_.size() < offset + data.size() )
+            {
+                return false;
+            }
+            std::memcpy( data.data(), bytes_.data() + offset, data.size() );
+            return true;
+        }
+
+    private:
+        std::vector<char> &bytes_;
+    };
+}
+
+struct StitchParams
+{
+    int                    channels;
+    WindowStitcher::Layout layout;
+    WindowStitcher::Blend  blend;
+};
+
+class WindowStitcherStreamTest : public ::testing::TestWithParam<StitchParams>
+{
+protected:
+    static constexpr int LENGTH        = 300;
+    static constexpr int WINDOW_LENGTH = 64;
+    static constexpr int STRIDE        = 40;
+
+    /** Add the same window outputs to any stitcher and finish it
+    */
+    void Stitch( WindowStitcher &stitcher )
+    {
+        const auto &params = GetParam();
+        const auto  starts = WindowStitcher::ComputeWindowStarts( LENGTH, WINDOW_LENGTH, STRIDE );
+        for ( size_t window = 0; window < starts.size(); ++window )
+        {
+            std::vector<float> values( static_cast<size_t>( params.channels ) * WINDOW_LENGTH );
+            for ( size_t i = 0; i < values.size(); ++i )
+            {
+                values[i] = static_cast<float>( ( window * 131 + i * 17 ) % 97 ) / 7.0f;
+            }
+            std::unique_ptr<MNN::Tensor> output( MNN::Tensor::create<float>( { 1, params.channels, WINDOW_LENGTH },
+                                                                             values.data(),
+                                                                             MNN::Tensor::CAFFE ) );
+            ASSERT_TRUE( stitcher.Add( window, *output ) );
+        }
+        ASSERT_TRUE( stitcher.Finish() );
+    }
+};
+
+TEST_P( WindowStitcherStreamTest, StreamedOutputMatchesInMemory )
+{
+    const auto &params = GetParam();
+    const auto  starts = WindowStitcher::ComputeWindowStarts( LENGTH, WINDOW_LENGTH, STRIDE );
+
+    WindowStitcher inMemory( starts, LENGTH, WINDOW_LENGTH, params.blend, params.layout );
+    Stitch( inMemory );
+
+    std::vector<char> streamedBytes;
+    WindowStitcher    streamed( starts, LENGTH, WINDOW_LENGTH, params.blend, params.layout );
+    streamed.StreamTo( std::make_unique<MemorySink>( streamedBytes ) );
+    Stitch( streamed );
+
+    const auto inMemoryHash = inMemory.HashOutput();
+    EXPECT_EQ( inMemoryHash, streamed.HashOutput() );
+
+    const auto output = inMemory.TakeOutput();
+    const auto bytes  = output.GetBytes();
+    ASSERT_EQ( bytes.size(), streamedBytes.size() );
+    EXPECT_EQ( 0, std::memcmp( bytes.data(), streamedBytes.data(), bytes.size() ) );
+
+    // Both modes hash the output bytes in their final order
+    sgns::sgprocmanagersha::Sha256Hasher hasher;
+    EXPECT_EQ( inMemoryHash, hasher.Digest( bytes.data(), bytes.size() ) );
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    LayoutsAndBlends,
+    WindowStitcherStreamTest,
+    ::testing::Values( StitchParams{ 1, WindowStitcher::Layout::ChannelsFirst, WindowStitcher::Blend::Uniform },
+                       StitchParams{ 3, WindowStitcher::Layout::ChannelsFirst, WindowStitcher::Blend::Uniform },
+                       StitchParams{ 3, WindowStitcher::Layout::ChannelsFirst, WindowStitcher::Blend::Gaussian },
+                       StitchParams{ 3, WindowStitcher::Layout::ChannelsFirst, WindowStitcher::Blend::Hann },
+                       StitchParams{ 1, WindowStitcher::Layout::ChannelsLast, WindowStitcher::Blend::Uniform },
+                       StitchParams{ 3, WindowStitcher::Layout::ChannelsLast, WindowStitcher::Blend::Uniform },
+                       StitchParams{ 3, WindowStitcher::Layout::ChannelsLast, WindowStitcher::Blend::Gaussian },
+                       StitchParams{ 3, WindowStitcher::Layout::ChannelsLast, WindowStitcher::Blend::Hann } ) );